@@ -1,85 +1,162 @@
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hardware/clocks.h"
 
 #include "gpu/aps6404.h"
 #include "gpu/display.h"
 #include "gpu/sprite_engine.h"
 #include "gpu/command_queue.h"
+#include "gpu/command_exec.h"
 #include "gpu/gpu_protocol.h"
 #include "gpu/gpu_status.h"
+#include "gpu/display_list.h"
+#include "gpu/blitter.h"
+#include "gpu/text_layer.h"
+#include "gpu/surface.h"
+#include "gpu/perf.h"
+#include "gpu/trace.h"
+#include "gpu/self_test.h"
+#include "gpu/capture.h"
+#include "gpu/psram_test.h"
+#include "gpu/psram_tune.h"
+#include "gpu/render.h"
 #include "externs.h"
 #include "pins.h"
 
-static CommandQueue cmd_queue;
+static CommandLanes cmd_lanes;
+#if TAKO_PSRAM_LAYOUT != APS6404_LAYOUT_SINGLE
+static APS6404State psram_second;
+#endif
 static TransferState transfer_state;
 static volatile bool system_initialized = false;
 
+static uint32_t frame_count = 0;
+
 static void init_led(void);
+static void set_led(bool on);
+static void toggle_led(void);
 static bool init_hardware(void);
-static void process_command(const uint8_t* cmd_data, size_t cmd_len);
+static void print_boot_times(void);
+#if TAKO_STATS_STDIO
+static void print_period_stats(const PerfPeriod* period, const DisplayTiming* timing);
+#endif
 
 int main() {
     stdio_init_all();
     printf("\nRetro GPU Starting...\n");
 
     init_led();
-    gpio_put(PIN_LED, 1);  // Turn on LED during init
+    set_led(true);  // Turn on LED during init
 
     if (!init_hardware()) {
         printf("Hardware initialization failed!\n");
         while(1) {
-            gpio_put(PIN_LED, 1);
+            set_led(true);
             sleep_ms(100);
-            gpio_put(PIN_LED, 0);
+            set_led(false);
             sleep_ms(100);
         }
     }
 
-    //printf("Running display test...\n");
-    //run_display_test();
+#if TAKO_SELF_TEST
+    // the tests reset the sprite engine and draw over the frame, so commands
+    // stay queued until they're done rather than being lost to them
+    while (!display_poll_init()) {
+        tight_loop_contents();
+    }
+
+    printf("Running display test...\n");
+    run_display_test();
 
-    //sleep_ms(2000);
+    sleep_ms(2000);
 
-    ///printf("Running sprite test...\n");
-    //run_sprite_test();
+    printf("Running sprite test...\n");
+    if (!run_sprite_test()) {
+        gpu_set_error(GPU_ERROR_SELF_TEST_FAILED);
+    }
+#else
+    // the panel is still waking up, take commands meanwhile. they only set
+    // up state, nothing is presented before the main loop's first frame
+    while (!display_poll_init()) {
+        cmd_exec_drain(frame_count);
+    }
+#endif
 
     printf("Entering main loop\n");
     system_initialized = true;
     
-    uint32_t frame_count = 0;
     uint32_t last_time = time_us_32();
+    bool boot_reported = false;
+    perf_discard_frame();
     
     while (1) {
         frame_count++;
+        gpu_set_frame_count(frame_count);
+        trace_event(TRACE_FRAME_START, 0, (uint16_t)frame_count);
+        capture_start_frame(&cmd_lanes, frame_count);
         
         // process pending commands
-        static uint8_t cmd_buffer[256];
-        uint16_t cmd_len;
-        bool needs_response;
-        uint16_t response_len;
-        
-        while (cmd_queue_has_command(&cmd_queue)) {
-            if (cmd_queue_pop(&cmd_queue, cmd_buffer, &cmd_len,
-                            &needs_response, &response_len)) {
-                process_command(cmd_buffer, cmd_len);
-            }
-        }
+        uint32_t stage_start = perf_cycles();
+        cmd_exec_drain(frame_count);
+        perf_stage_add(PERF_STAGE_COMMANDS, perf_cycles() - stage_start);
 
+        stage_start = perf_cycles();
         sprite_engine_start_frame();
+        perf_stage_add(PERF_STAGE_BINNING, perf_cycles() - stage_start);
+
+        stage_start = perf_cycles();
 
+        render_frame(display_get_next_buffer());
+        perf_stage_add(PERF_STAGE_COMPOSE, perf_cycles() - stage_start);
+
+        // the previous frame is on screen once its scanout finishes
+        stage_start = perf_cycles();
         display_wait_for_frame_complete();
+        perf_stage_add(PERF_STAGE_DISPLAY_WAIT, perf_cycles() - stage_start);
+
+        cmd_exec_retire_fences(frame_count - 1);
+        display_swap_buffers();
+        perf_end_frame();
 
         if ((frame_count % 60) == 0) {
-            gpio_put(PIN_LED, !gpio_get(PIN_LED));
+            toggle_led();
 
             uint32_t current_time = time_us_32();
             float fps = 60.0f / ((current_time - last_time) / 1000000.0f);
             printf("FPS: %.2f\n", fps);
+            gpu_set_frame_rate(fps > 255.0f ? 255 : (uint8_t)fps);
+
+            BlitterStats blits = blitter_take_stats();
+            SurfaceStats fetches = surface_take_stats();
+            PerfPeriod period = {
+                .queue_latency_us = { cmd_lanes.priority.max_latency_us, cmd_lanes.normal.max_latency_us },
+                .blit_pixels = blits.pixels,
+                .blit_us = blits.time_us,
+                .background_lines = fetches.lines,
+                .background_reads = fetches.reads,
+                .background_us = fetches.time_us
+            };
+            perf_set_period(&period);
+
+            DisplayTiming timing = display_take_timing();
+            gpu_set_frame_timing(display_get_pacing(),
+                                 timing.frame_time_us > 0xFFFF ? 0xFFFF : timing.frame_time_us,
+                                 timing.jitter_us > 0xFFFF ? 0xFFFF : timing.jitter_us);
             last_time = current_time;
+
+#if TAKO_STATS_STDIO
+            print_period_stats(&period, &timing);
+#endif
+
+            if (!boot_reported && perf_boot_time(PERF_BOOT_FIRST_PIXEL)) {
+                print_boot_times();
+                boot_reported = true;
+            }
         }
     }
 
@@ -87,43 +164,103 @@ int main() {
 }
 
 static void init_led(void) {
+#if TAKO_PSRAM_LAYOUT == APS6404_LAYOUT_SINGLE
     gpio_init(PIN_LED);
     gpio_set_dir(PIN_LED, GPIO_OUT);
     gpio_put(PIN_LED, 0);
+#endif
+}
+
+static void set_led(bool on) {
+#if TAKO_PSRAM_LAYOUT == APS6404_LAYOUT_SINGLE
+    gpio_put(PIN_LED, on);
+#endif
+}
+
+static void toggle_led(void) {
+#if TAKO_PSRAM_LAYOUT == APS6404_LAYOUT_SINGLE
+    gpio_put(PIN_LED, !gpio_get(PIN_LED));
+#endif
 }
 
+// Bring-up is ordered so nothing waits on anything it doesn't need. The bus
+// comes up first so the host can queue commands straight away, the panel's
+// reset is started next and its waits run out while psram comes up, and the
+// panel itself is finished off from the boot loop in main.
 static bool init_hardware(void) {
     printf("Initializing hardware...\n");
 
+    perf_init();
+
+    // init command queue
+    printf("Initializing command queue...\n");
+    cmd_lanes_init(&cmd_lanes);
+    capture_init();
+
+    // init transfer system
+    printf("Initializing transfer system...\n");
+    if (!transfer_init(&transfer_state, pio0, 1, 2)) {
+        printf("Transfer system initialization failed!\n");
+        return false;
+    }
+    cmd_exec_init(&cmd_lanes, &transfer_state);
+    perf_mark_boot(PERF_BOOT_BUS_READY);
+
+    // start the display's reset
+    printf("Initializing display...\n");
+    if (!display_init(pio0, 0)) {
+        printf("Display initialization failed!\n");
+        return false;
+    }
+
     // initialize PSRAM
     printf("Initializing PSRAM...\n");
-    if (!aps6404_init(&psram, pio0, 0,
-                      PIN_PSRAM_SCK,
-                      PIN_PSRAM_D0,
-                      PIN_PSRAM_D1,
-                      PIN_PSRAM_D2,
-                      PIN_PSRAM_D3,
-                      PIN_PSRAM_CS)) {
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_QMI
+    bool psram_ok = aps6404_init_qmi(&psram, PIN_PSRAM_XIP_CS1);
+#else
+    bool psram_ok = aps6404_init(&psram, pio1, 1,
+                                 PIN_PSRAM_SCK,
+                                 PIN_PSRAM_D0,
+                                 PIN_PSRAM_D1,
+                                 PIN_PSRAM_D2,
+                                 PIN_PSRAM_D3,
+                                 PIN_PSRAM_CS);
+#endif
+    if (!psram_ok) {
         printf("PSRAM initialization failed!\n");
         return false;
     }
+    psram_tune_run(&psram, 0);
 
-    // test PSRAM
+    // a failure here is left for the host to read with CMD_GET_PSRAM_DIAG
     printf("Testing PSRAM...\n");
-    MemTestResult test_result = aps6404_test(&psram);
-    if (!test_result.passed) {
-        printf("PSRAM test failed at address 0x%08x\n", test_result.failed_address);
-        printf("Expected: 0x%02x, Received: 0x%02x\n", 
-               test_result.expected, test_result.received);
+    bool psram_passed = psram_test_chip(&psram, 0, TAKO_PSRAM_TEST);
+
+#if TAKO_PSRAM_LAYOUT != APS6404_LAYOUT_SINGLE
+    // the second chip is tuned and its address lines tested on its own,
+    // then the first routes to it
+    if (!aps6404_init(&psram_second, pio1, 2,
+                      PIN_PSRAM1_SCK,
+                      PIN_PSRAM1_D0,
+                      PIN_PSRAM1_D1,
+                      PIN_PSRAM1_D2,
+                      PIN_PSRAM1_D3,
+                      PIN_PSRAM1_CS)) {
+        printf("Second PSRAM initialization failed!\n");
         return false;
     }
+    psram_tune_run(&psram_second, 1);
+    psram_passed = psram_test_chip(&psram_second, 1, TAKO_PSRAM_TEST) && psram_passed;
+    aps6404_attach(&psram, &psram_second, TAKO_PSRAM_LAYOUT);
+#endif
 
-    // init display
-    printf("Initializing display...\n");
-    if (!display_init(pio1, 0)) {
-        printf("Display initialization failed!\n");
-        return false;
+    if (!psram_test_run(&psram, TAKO_PSRAM_TEST) || !psram_passed) {
+        gpu_set_error(GPU_ERROR_PSRAM_TEST_FAILED);
     }
+    perf_mark_boot(PERF_BOOT_PSRAM_READY);
+
+    display_list_init();
+    surface_init();
 
     // init sprite engine
     printf("Initializing sprite engine...\n");
@@ -132,14 +269,10 @@ static bool init_hardware(void) {
         return false;
     }
 
-    // init command queue
-    printf("Initializing command queue...\n");
-    cmd_queue_init(&cmd_queue);
-
-    // init transfer system
-    printf("Initializing transfer system...\n");
-    if (!transfer_init(&transfer_state, pio0, 1)) {
-        printf("Transfer system initialization failed!\n");
+    // init blitter
+    printf("Initializing blitter...\n");
+    if (!blitter_init()) {
+        printf("Blitter initialization failed!\n");
         return false;
     }
 
@@ -147,149 +280,38 @@ static bool init_hardware(void) {
     return true;
 }
 
-static void process_command(const uint8_t* cmd_data, size_t cmd_len) {
-    if (cmd_len < sizeof(GpuCommandHeader)) return;
+static void print_boot_times(void) {
+    printf("Boot: bus %lu us, psram %lu us, display %lu us, first command %lu us, first pixel %lu us\n",
+           (unsigned long)perf_boot_time(PERF_BOOT_BUS_READY),
+           (unsigned long)perf_boot_time(PERF_BOOT_PSRAM_READY),
+           (unsigned long)perf_boot_time(PERF_BOOT_DISPLAY_READY),
+           (unsigned long)perf_boot_time(PERF_BOOT_FIRST_COMMAND),
+           (unsigned long)perf_boot_time(PERF_BOOT_FIRST_PIXEL));
+}
 
-    GpuCommandHeader* header = (GpuCommandHeader*)cmd_data;
-    const uint8_t* data = cmd_data + sizeof(GpuCommandHeader);
-    
-    // Reset sprite engine if needed
-    if (cmd_resets_state(header)) {
-        //todo
-        //sprite_engine_reset();
+#if TAKO_STATS_STDIO
+// everything here is also in CMD_GET_PERF, CMD_STATUS and the capture
+// status. printing it costs a few ms of blocking uart every stats period
+static void print_period_stats(const PerfPeriod* period, const DisplayTiming* timing) {
+    printf("Max queue latency: priority %lu us, normal %lu us\n",
+           (unsigned long)period->queue_latency_us[0], (unsigned long)period->queue_latency_us[1]);
 
+    if (period->blit_us) {
+        printf("Blit fill rate: %.2f Mpix/s\n", (float)period->blit_pixels / period->blit_us);
     }
-    
-    // handle high priority commands first
-    if (cmd_is_high_priority(header)) {
-        // lol eventually
-    }
-
-    switch(header->cmd) 
-    {
-        case CMD_INIT:
-            if (cmd_needs_response(header)) 
-            {
-                uint8_t ack = 0;
-                transfer_send_response(&transfer_state, &ack, sizeof(ack));
-            }
-            break;
-            
-        case CMD_LOAD_PATTERN: 
-        {
-            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadPatternData)) break;
-            LoadPatternData* pattern = (LoadPatternData*)data;
-            size_t pattern_data_size;
-
-            switch(pattern->size) 
-            {
-                case SPRITE_SIZE_8x8:    
-                    pattern_data_size = 32;   
-                    break;
-                case SPRITE_SIZE_16x16:  
-                    pattern_data_size = 128;  
-                    break;
-                case SPRITE_SIZE_32x32:  
-                    pattern_data_size = 512;  
-                    break;
-                case SPRITE_SIZE_64x64:  
-                    pattern_data_size = 2048; 
-                    break;
-                default: 
-                    if (cmd_needs_response(header)) 
-                    {
-                        bool success = false;
-                        transfer_send_response(&transfer_state, &success, sizeof(success));
-                    }
-                    break;
-            }
 
-            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadPatternData) + pattern_data_size)
-            {   
-                break;
-            } 
-
-            bool success = pattern_load(pattern->pattern_num, data + sizeof(LoadPatternData), pattern->size);
-            
-            if (cmd_needs_response(header)) 
-            {
-                transfer_send_response(&transfer_state, &success, sizeof(success));
-            }
-
-            break;
-        }
-        
-        case CMD_UPDATE_SPRITE: 
-        {
-            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(UpdateSpriteData)) break;
-            UpdateSpriteData* spriteUpdateData = (UpdateSpriteData*)data;
-            
-            // Check if sprite number is within bounds
-            if (spriteUpdateData->sprite_num >= MAX_SPRITES) 
-            {
-                bool success = false;
-                if (cmd_needs_response(header)) 
-                {
-                    transfer_send_response(&transfer_state, &success, sizeof(success));
-                }
-                
-                break;
-            }
-            
-            Sprite sprite;
-            sprite.x = spriteUpdateData->x;
-            sprite.y = spriteUpdateData->y;
-            sprite.pattern = spriteUpdateData->pattern;
-            sprite.attr = spriteUpdateData->attr;
-            sprite.ctrl = spriteUpdateData->ctrl;
-            
-            bool success = sprite_update((uint8_t)spriteUpdateData->sprite_num, &sprite);
-            
-            if (cmd_needs_response(header)) 
-            {
-                transfer_send_response(&transfer_state, &success, sizeof(success));
-            }
-
-            break;
-        }
-        
-        case CMD_LOAD_PALETTE: 
-        {
-            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadPaletteData))
-            { 
-                break;
-            }
-
-            LoadPaletteData* palette = (LoadPaletteData*)data;
-
-            bool success = palette_load(palette->palette_num, (uint16_t*)(data + sizeof(LoadPaletteData)));
-            
-            if (cmd_needs_response(header)) 
-            {
-                transfer_send_response(&transfer_state, &success, sizeof(success));
-            }
+    if (period->background_lines) {
+        printf("Background fetch: %.2f us/line, %lu reads\n", (float)period->background_us / period->background_lines,
+               (unsigned long)period->background_reads);
+    }
 
-            break;
-        }
-        
-        case CMD_STATUS: 
-        {
-            GpuStatus status = gpu_get_status();
-            
-            if (cmd_needs_response(header)) 
-            {
-                transfer_send_response(&transfer_state, &status, sizeof(status));
-            }
-            
-            break;
-        }
+    printf("Frame time: %lu us, jitter %lu us, %lu TE pulses\n", (unsigned long)timing->frame_time_us,
+           (unsigned long)timing->jitter_us, (unsigned long)timing->te_pulses);
 
-        default:
-            if (cmd_needs_response(header)) 
-            {
-                uint8_t error = 1;
-                transfer_send_response(&transfer_state, &error, sizeof(error));
-            }
-            break;
+    CaptureStatus capture = capture_get_status();
+    if (capture.replaying) {
+        printf("Replay: %lu commands over %lu frames, %lu streamed skipped\n", (unsigned long)capture.replayed,
+               (unsigned long)capture.replay_frames, (unsigned long)capture.skipped);
     }
-}
\ No newline at end of file
+}
+#endif
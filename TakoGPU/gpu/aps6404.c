@@ -1,13 +1,122 @@
 // aps6404.c
 #include "aps6404.h"
+
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_PIO
+
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include <string.h>
 #include "aps6404_quad.pio.h"
+#include "perf.h"
 #include "pico/stdlib.h"
 
 // if this doesn't work just adapt https://github.com/polpo/rp2040-psram/blob/main/psram_spi.h
 
+// the chip powers up in spi mode, so the commands that get it into qpi are
+// clocked out by hand before the pins go to the pio
+static void spi_command(APS6404State* psram, uint8_t cmd) 
+{
+    gpio_put(psram->cs_pin, 0);
+
+    for (int bit = 7; bit >= 0; bit--) 
+    {
+        gpio_put(psram->data0_pin, (cmd >> bit) & 1);
+        gpio_put(psram->sck_pin, 1);
+        gpio_put(psram->sck_pin, 0);
+    }
+
+    gpio_put(psram->cs_pin, 1);
+}
+
+// a chip left in qpi by a warm reboot only listens on all four pins, a
+// nibble a clock. one in spi mode sees two clocks of a command on SI and
+// ignores it once cs goes high
+static void qpi_command(APS6404State* psram, uint8_t cmd) 
+{
+    uint32_t data_mask = 0xFu << psram->data0_pin;
+
+    gpio_set_dir_out_masked(data_mask);
+    gpio_put(psram->cs_pin, 0);
+
+    for (int shift = 4; shift >= 0; shift -= 4) 
+    {
+        gpio_put_masked(data_mask, (uint32_t)((cmd >> shift) & 0xF) << psram->data0_pin);
+        gpio_put(psram->sck_pin, 1);
+        gpio_put(psram->sck_pin, 0);
+    }
+
+    gpio_put(psram->cs_pin, 1);
+    gpio_set_dir_in_masked(data_mask & ~(1u << psram->data0_pin));
+}
+
+// both read variants stay loaded, shared by every chip on the pio
+typedef struct {
+    bool loaded;
+    uint rise_offset;
+    uint fall_offset;
+} QuadPrograms;
+
+static QuadPrograms programs[NUM_PIOS];
+
+static void start_program(APS6404State* psram, bool late) 
+{
+    QuadPrograms* loaded = &programs[pio_get_index(psram->pio)];
+    if (!loaded->loaded) 
+    {
+        loaded->rise_offset = pio_add_program(psram->pio, &aps6404_quad_program);
+        loaded->fall_offset = pio_add_program(psram->pio, &aps6404_quad_late_program);
+        loaded->loaded = true;
+    }
+
+    pio_sm_set_enabled(psram->pio, psram->sm, false);
+
+    psram->late_program = late;
+    psram->offset = late ? loaded->fall_offset : loaded->rise_offset;
+
+    pio_sm_config c = late ? aps6404_quad_late_program_get_default_config(psram->offset) :
+                             aps6404_quad_program_get_default_config(psram->offset);
+
+    sm_config_set_out_pins(&c, psram->data0_pin, 4);
+    sm_config_set_set_pins(&c, psram->data0_pin, 4);
+    sm_config_set_in_pins(&c, psram->data0_pin);
+    sm_config_set_sideset_pins(&c, psram->sck_pin);
+
+    // a byte per fifo word each way, high nibble first
+    sm_config_set_out_shift(&c, false, true, 8);
+    sm_config_set_in_shift(&c, false, true, 8);
+    sm_config_set_clkdiv(&c, psram->clkdiv);
+
+    pio_sm_init(psram->pio, psram->sm, psram->offset, &c);
+    pio_sm_set_consecutive_pindirs(psram->pio, psram->sm, psram->sck_pin, 1, true);
+    pio_sm_set_enabled(psram->pio, psram->sm, true);
+}
+
+void aps6404_set_timing(APS6404State* psram, float clkdiv, uint8_t sample_point) 
+{
+    bool late = sample_point >= APS6404_SAMPLE_FALL_SYNC;
+    bool bypass = sample_point == APS6404_SAMPLE_RISE || sample_point == APS6404_SAMPLE_FALL;
+    uint32_t data_mask = 0xFu << psram->data0_pin;
+    bool started = psram->clkdiv != 0.0f;
+
+    psram->clkdiv = clkdiv;
+    psram->sample_point = sample_point;
+    psram->max_burst = aps6404_max_burst(clock_get_hz(clk_sys), clkdiv);
+
+    if (!started || late != psram->late_program) 
+    {
+        start_program(psram, late);
+    }
+    else 
+    {
+        pio_sm_set_clkdiv(psram->pio, psram->sm, clkdiv);
+    }
+
+    if (bypass)
+        psram->pio->input_sync_bypass |= data_mask;
+    else
+        psram->pio->input_sync_bypass &= ~data_mask;
+}
+
 bool aps6404_init(APS6404State* psram, PIO pio, uint sm, uint sck, uint data0, uint data1, uint data2, uint data3, uint cs) 
 {
     psram->pio = pio;
@@ -19,187 +128,218 @@ bool aps6404_init(APS6404State* psram, PIO pio, uint sm, uint sck, uint data0, u
     psram->data2_pin = data2;
     psram->data3_pin = data3;
     psram->quad_mode = false;
+    psram->clkdiv = 0.0f;
+    psram->second = NULL;
+    psram->layout = APS6404_LAYOUT_SINGLE;
+    psram->busy = false;
+
+    // qpi moves four bits per pio pin write, so the data pins have to be in order
+    if (data1 != data0 + 1 || data2 != data0 + 2 || data3 != data0 + 3)
+        return false;
 
     gpio_init(cs);
     gpio_set_dir(cs, GPIO_OUT);
     gpio_put(cs, 1); // deselect PSRAM
 
+    gpio_init(sck);
+    gpio_init(data0);
+    gpio_init(data1);
+    gpio_init(data2);
+    gpio_init(data3);
+    gpio_set_dir(sck, GPIO_OUT);
+    gpio_set_dir(data0, GPIO_OUT);
+    gpio_put(sck, 0);
+
+    // the spi reset is lost on a chip still in qpi from before a warm reboot
+    qpi_command(psram, APS6404_CMD_EXIT_QUAD);
+
+    spi_command(psram, APS6404_CMD_RESET_ENABLE);
+    spi_command(psram, APS6404_CMD_RESET);
+
+    // reset only takes tRST (50 ns), no need to hold boot up for a millisecond
+    sleep_us(10);
+
+    // the chip resets to 1KB linear bursts, which is what we want, and
+    // APS6404_CMD_BURST_LENGTH would toggle it to 32 byte wrapping
+    spi_command(psram, APS6404_CMD_ENTER_QUAD);
+    psram->quad_mode = true;
+
     pio_gpio_init(pio, sck);
     pio_gpio_init(pio, data0);
     pio_gpio_init(pio, data1);
     pio_gpio_init(pio, data2);
     pio_gpio_init(pio, data3);
 
-    psram->offset = pio_add_program(pio, &aps6404_quad_program);
-    pio_sm_config c = aps6404_quad_program_get_default_config(psram->offset);
-    
-    sm_config_set_out_pins(&c, data0, 4);
-    sm_config_set_sideset_pins(&c, sck);
-    
-    // clock 133MHz
-    float div = clock_get_hz(clk_sys) / (133.0f * 1000 * 1000);
-    sm_config_set_clkdiv(&c, div);
-
-    pio_sm_init(pio, sm, psram->offset, &c);
-    pio_sm_set_enabled(pio, sm, true);
-
-    // I think timing is important here for the pio to handle, but i'll try this first!
-    gpio_put(cs, 0);
-    uint8_t reset_enable = APS6404_CMD_RESET_ENABLE;
-    pio_sm_put_blocking(pio, sm, reset_enable);
-    gpio_put(cs, 1);
+    psram->dma_chan = dma_claim_unused_channel(true);
 
-    sleep_us(10);
+    // conservative until psram_tune_run has found the fastest safe setting,
+    // and a whole divider so sck stays even
+    uint32_t clkdiv = (clock_get_hz(clk_sys) + 2 * APS6404_SAFE_SCK_HZ - 1) / (2 * APS6404_SAFE_SCK_HZ);
+    aps6404_set_timing(psram, clkdiv < 1 ? 1 : clkdiv, APS6404_SAMPLE_RISE);
 
-    gpio_put(cs, 0);
-    uint8_t reset = APS6404_CMD_RESET;
-    pio_sm_put_blocking(pio, sm, reset);
-    gpio_put(cs, 1);
+    return true;
+}
 
-    sleep_ms(1);
+// waits for the state machine to shift out everything it was given
+static void wait_idle(APS6404State* psram) 
+{
+    uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + psram->sm);
 
-    // burst length 1024 bytes
-    gpio_put(cs, 0);
-    uint8_t burst_cmd[] = {APS6404_CMD_BURST_LENGTH, 0x02}; // 1024 bytes
-    pio_sm_put_blocking(pio, sm, burst_cmd[0]);
-    pio_sm_put_blocking(pio, sm, burst_cmd[1]);
-    gpio_put(cs, 1);
+    psram->pio->fdebug = stall;
+    while (!(psram->pio->fdebug & stall)) 
+    {
+        tight_loop_contents();
+    }
+}
 
-    // quad mode
-    gpio_put(cs, 0);
-    uint8_t quad_enable = APS6404_CMD_ENTER_QUAD;
-    pio_sm_put_blocking(pio, sm, quad_enable);
-    gpio_put(cs, 1);
+// frames a transfer for the pio: nibble counts, then command and address
+static void start_transfer(APS6404State* psram, uint8_t cmd, uint32_t addr, uint32_t send_bytes, uint32_t receive_bytes) 
+{
+    gpio_put(psram->cs_pin, 0);
 
-    psram->quad_mode = true;
+    pio_sm_put_blocking(psram->pio, psram->sm, (4 + send_bytes) * 2 - 1);
+    pio_sm_put_blocking(psram->pio, psram->sm, receive_bytes * 2);
 
-    psram->dma_chan = dma_claim_unused_channel(true);
-    
-    return true;
+    pio_sm_put_blocking(psram->pio, psram->sm, (uint32_t)cmd << 24);
+    pio_sm_put_blocking(psram->pio, psram->sm, (addr & 0xFF0000) << 8);
+    pio_sm_put_blocking(psram->pio, psram->sm, (addr & 0x00FF00) << 16);
+    pio_sm_put_blocking(psram->pio, psram->sm, (addr & 0x0000FF) << 24);
+}
+
+// bursts are started and finished separately, so with two chips a burst
+// on each can be in flight at once
+static void begin_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len) 
+{
+    start_transfer(psram, APS6404_CMD_WRITE_QUAD, addr, len, 0);
+
+    // byte writes to the fifo land in every lane, so the top byte is the data
+    dma_channel_config config = dma_channel_get_default_config(psram->dma_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, pio_get_dreq(psram->pio, psram->sm, true));
+
+    dma_channel_configure(psram->dma_chan, &config, &psram->pio->txf[psram->sm], data, len, true);
+    psram->busy = true;
+    psram->busy_write = true;
+}
+
+static void begin_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len) 
+{
+    start_transfer(psram, APS6404_CMD_FAST_READ_QUAD, addr, 0, len);
+
+    dma_channel_config config = dma_channel_get_default_config(psram->dma_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, pio_get_dreq(psram->pio, psram->sm, false));
+
+    dma_channel_configure(psram->dma_chan, &config, data, &psram->pio->rxf[psram->sm], len, true);
+    psram->busy = true;
+    psram->busy_write = false;
+}
+
+static void finish_burst(APS6404State* psram) 
+{
+    if (!psram->busy) 
+        return;
+
+    dma_channel_wait_for_finish_blocking(psram->dma_chan);
+
+    // a write isn't done until the state machine has shifted it all out
+    if (psram->busy_write) 
+        wait_idle(psram);
+
+    gpio_put(psram->cs_pin, 1);
+    psram->busy = false;
+}
+
+void aps6404_attach(APS6404State* psram, APS6404State* second, uint8_t layout) 
+{
+    psram->second = second;
+    psram->layout = second ? layout : APS6404_LAYOUT_SINGLE;
+}
+
+uint32_t aps6404_capacity(const APS6404State* psram) 
+{
+    return psram->layout == APS6404_LAYOUT_INTERLEAVED ? APS6404_SIZE * 2 : APS6404_SIZE;
 }
 
 void aps6404_deinit(APS6404State* psram) 
 {
     if (psram->quad_mode) {
-        // exit quad mode
+        // exit quad mode, sent as a qpi command with nothing after it
         gpio_put(psram->cs_pin, 0);
-        uint8_t quad_disable = APS6404_CMD_EXIT_QUAD;
-        pio_sm_put_blocking(psram->pio, psram->sm, quad_disable);
+        pio_sm_put_blocking(psram->pio, psram->sm, 1);
+        pio_sm_put_blocking(psram->pio, psram->sm, 0);
+        pio_sm_put_blocking(psram->pio, psram->sm, (uint32_t)APS6404_CMD_EXIT_QUAD << 24);
+        wait_idle(psram);
         gpio_put(psram->cs_pin, 1);
     }
-    
+
+    // the programs stay loaded for any other chip on the pio
     pio_sm_set_enabled(psram->pio, psram->sm, false);
     dma_channel_unclaim(psram->dma_chan);
 }
 
 bool aps6404_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len) 
 {
-    if (!len) 
+    if (!len)
         return true;
-    
-    gpio_put(psram->cs_pin, 0);
 
-    uint32_t cmd_addr = (psram->quad_mode ? APS6404_CMD_WRITE_QUAD : APS6404_CMD_WRITE) | ((addr & 0xFFFFFF) << 8);
-    
-    pio_sm_put_blocking(psram->pio, psram->sm, cmd_addr);
-    
-    dma_channel_config config = dma_channel_get_default_config(psram->dma_chan);
-    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
-    channel_config_set_read_increment(&config, true);
-    channel_config_set_write_increment(&config, false);
-    channel_config_set_dreq(&config, pio_get_dreq(psram->pio, psram->sm, true));
+    uint32_t start = perf_cycles();
 
-    dma_channel_configure(psram->dma_chan, &config, &psram->pio->txf[psram->sm], data, len,true);
+    while (len) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, addr, &device_addr);
+        size_t chunk = aps6404_burst_chunk(device, device_addr, len);
 
-    dma_channel_wait_for_finish_blocking(psram->dma_chan);
-    
-    gpio_put(psram->cs_pin, 1);
+        finish_burst(device);
+        begin_write(device, device_addr, data, chunk);
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+
+    finish_burst(psram);
+    if (psram->second) 
+        finish_burst(psram->second);
+
+    perf_stage_add(PERF_STAGE_PSRAM, perf_cycles() - start);
 
     return true;
 }
 
 bool aps6404_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len) 
 {
-    if (!len) 
+    if (!len)
         return true;
-    
-    gpio_put(psram->cs_pin, 0);
 
-    uint32_t cmd_addr = (psram->quad_mode ? APS6404_CMD_FAST_READ_QUAD : APS6404_CMD_READ) |((addr & 0xFFFFFF) << 8);
-    
-    pio_sm_put_blocking(psram->pio, psram->sm, cmd_addr);
-    
-    if (psram->quad_mode) {
-        // dummy cycles for qspi
-        pio_sm_put_blocking(psram->pio, psram->sm, 0xFF);
+    uint32_t start = perf_cycles();
+
+    while (len) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, addr, &device_addr);
+        size_t chunk = aps6404_burst_chunk(device, device_addr, len);
+
+        finish_burst(device);
+        begin_read(device, device_addr, data, chunk);
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
     }
-    
-    dma_channel_config config = dma_channel_get_default_config(psram->dma_chan);
-    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
-    channel_config_set_read_increment(&config, false);
-    channel_config_set_write_increment(&config, true);
-    channel_config_set_dreq(&config, pio_get_dreq(psram->pio, psram->sm, false));
 
-    dma_channel_configure(psram->dma_chan, &config, data, &psram->pio->rxf[psram->sm], len, true);
+    finish_burst(psram);
+    if (psram->second) 
+        finish_burst(psram->second);
 
-    dma_channel_wait_for_finish_blocking(psram->dma_chan);
-    
-    gpio_put(psram->cs_pin, 1);
+    perf_stage_add(PERF_STAGE_PSRAM, perf_cycles() - start);
 
     return true;
 }
 
-MemTestResult aps6404_test(APS6404State* psram) 
-{
-    MemTestResult result = {
-        .passed = true,
-        .failed_address = 0,
-        .expected = 0,
-        .received = 0
-    };
-    
-    uint8_t patterns[] = { 0x55, 0xAA, 0x33, 0xCC, 0xF0, 0x0F, 0xFF, 0x00 };
-    
-    uint32_t test_addresses[] = {
-        PSRAM_FRAME_BUFFER_BASE,
-        PSRAM_SPRITE_BASE,
-        PSRAM_TILEMAP_BASE,
-        0x300000  // reserved space
-    };
-    
-    uint8_t read_buffer[sizeof(patterns)];
-    
-    for (size_t i = 0; i < sizeof(test_addresses)/sizeof(test_addresses[0]); i++) 
-    {
-        uint32_t addr = test_addresses[i];
-        
-        // write test pattern
-        if (!aps6404_write(psram, addr, patterns, sizeof(patterns))) {
-            result.passed = false;
-            result.failed_address = addr;
-            return result;
-        }
-        
-        // read back
-        if (!aps6404_read(psram, addr, read_buffer, sizeof(patterns))) {
-            result.passed = false;
-            result.failed_address = addr;
-            return result;
-        }
-        
-        // verify
-        for (size_t j = 0; j < sizeof(patterns); j++) {
-            if (read_buffer[j] != patterns[j]) {
-                result.passed = false;
-                result.failed_address = addr + j;
-                result.expected = patterns[j];
-                result.received = read_buffer[j];
-                return result;
-            }
-        }
-
-        sleep_ms(1);
-    }
-    
-    return result;
-}
\ No newline at end of file
+#endif
@@ -1,6 +1,10 @@
 #pragma once
 #include <stdint.h>
 #include "hardware/pio.h"
+#include "hardware/regs/addressmap.h"
+
+#define APS6404_ADDRESS_BITS       23
+#define APS6404_SIZE               (1u << APS6404_ADDRESS_BITS) // 8MB
 
 // Memory Map
 #define PSRAM_FRAME_BUFFER_BASE    0x000000    // Start of frame buffers
@@ -9,6 +13,12 @@
 #define PSRAM_SPRITE_SIZE          0x0B0000    // 704KB for sprites
 #define PSRAM_TILEMAP_BASE         0x100000    // Start of tile maps
 #define PSRAM_TILEMAP_SIZE         0x100000    // 1MB for tile maps
+#define PSRAM_DISPLAY_LIST_BASE    0x200000    // Start of display lists
+#define PSRAM_DISPLAY_LIST_SIZE    0x100000    // 1MB for display lists
+#define PSRAM_FONT_BASE            0x300000    // Start of the text layer font atlas
+#define PSRAM_FONT_SIZE            0x010000    // 64KB for the font atlas
+#define PSRAM_CAPTURE_BASE         0x400000    // Start of the command capture
+#define PSRAM_CAPTURE_SIZE         0x400000    // 4MB for the command capture
 
 // APS6404L Commands (https://www.pjrc.com/store/APS6404L_3SQR.pdf)
 #define APS6404_CMD_READ           0x03    // Read data
@@ -20,9 +30,50 @@
 #define APS6404_CMD_EXIT_QUAD      0xF5    // Exit quad mode
 #define APS6404_CMD_RESET_ENABLE   0x66    // Reset enable
 #define APS6404_CMD_RESET          0x99    // Reset device
-#define APS6404_CMD_BURST_LENGTH   0xC0    // Set burst length
+#define APS6404_CMD_BURST_LENGTH   0xC0    // Toggle between 32 byte wrapped and 1KB linear bursts
+#define APS6404_CMD_READ_ID        0x9F    // Manufacturer and known good die ids, spi only
+
+#define APS6404_PAGE_SIZE          1024    // bursts never cross a page
+#define APS6404_WAIT_CYCLES        6       // quad fast read, fixed in aps6404_quad.pio
+#define APS6404_MAX_SCK_HZ         133000000
+#define APS6404_SAFE_SCK_HZ        50000000 // used until the timing is tuned
+#define APS6404_MAX_SELECT_NS      8000    // tCEM, chip select can't stay low past a refresh interval
+#define APS6404_SELECT_SLACK_NS    1000    // held back for the cpu to deselect once a burst's dma is done
+#define APS6404_BURST_OVERHEAD     14      // qpi clocks of command, address and read wait before the data
+
+// Read sample points, in order of increasing delay after the rising clock
+// edge (for clock dividers of 2 and up, below that the middle two swap).
+// The synchronizers add two system clocks of input delay.
+#define APS6404_SAMPLE_RISE_SYNC   0 // rising edge, synchronized
+#define APS6404_SAMPLE_RISE        1 // rising edge, synchronizers bypassed
+#define APS6404_SAMPLE_FALL_SYNC   2 // falling edge, synchronized
+#define APS6404_SAMPLE_FALL        3 // falling edge, synchronizers bypassed
+#define APS6404_SAMPLE_POINTS      4
+
+// With a second chip attached the first one's state routes every access.
+#define APS6404_LAYOUT_SINGLE      0
+#define APS6404_LAYOUT_SPLIT       1 // patterns and the font on the second chip, everything else on the first
+#define APS6404_LAYOUT_INTERLEAVED 2 // 1KB pages alternate between the chips, twice the address space
+
+#ifndef TAKO_PSRAM_LAYOUT
+#define TAKO_PSRAM_LAYOUT          APS6404_LAYOUT_SINGLE
+#endif
 
-typedef struct {
+// Backends, picked at build time. The pio one drives the chip on its own
+// pins (aps6404.c). The qmi one puts it on the flash's qspi pins behind the
+// second chip select and maps it into the xip window (aps6404_qmi.c), so
+// it can also be read with plain loads through the xip cache. Both sit
+// behind the same read and write calls.
+#define APS6404_BACKEND_PIO        0
+#define APS6404_BACKEND_QMI        1
+
+#ifndef TAKO_PSRAM_BACKEND
+#define TAKO_PSRAM_BACKEND         APS6404_BACKEND_PIO
+#endif
+
+#define APS6404_XIP_OFFSET         0x01000000 // the second chip select's 16MB of the xip window
+
+typedef struct APS6404State {
     PIO pio;
     uint sm;
     uint offset;
@@ -34,19 +85,85 @@ typedef struct {
     uint data2_pin;
     uint data3_pin;
     bool quad_mode;
+    float clkdiv;         // pio cycles per system clock, sck runs at half the pio rate
+    uint8_t sample_point; // APS6404_SAMPLE_*
+    bool late_program;    // running aps6404_quad_late
+    uint16_t max_burst;   // bytes per burst that keep chip select under tCEM at this clkdiv
+    bool busy;            // a burst is in flight
+    bool busy_write;
+    struct APS6404State* second;
+    uint8_t layout;       // APS6404_LAYOUT_*
 } APS6404State;
 
+// The chip refreshes itself between bursts, so a burst has to end within
+// tCEM, which is shorter than a page below about 130 MHz sck. At two clocks
+// a byte that's this many bytes for a pio clkdiv.
+static inline uint16_t aps6404_max_burst(uint32_t sys_hz, float clkdiv) 
+{
+    uint32_t sck_khz = (uint32_t)(sys_hz / (2.0f * clkdiv) / 1000.0f);
+    uint32_t clocks = sck_khz * (APS6404_MAX_SELECT_NS - APS6404_SELECT_SLACK_NS) / 1000000;
+    uint32_t bytes = clocks > APS6404_BURST_OVERHEAD + 2 ? (clocks - APS6404_BURST_OVERHEAD) / 2 : 1;
+
+    return bytes < APS6404_PAGE_SIZE ? bytes : APS6404_PAGE_SIZE;
+}
+
+// bursts stop at the end of a page and before tCEM runs out
+static inline size_t aps6404_burst_chunk(const APS6404State* device, uint32_t addr, size_t len) 
+{
+    size_t left = APS6404_PAGE_SIZE - (addr & (APS6404_PAGE_SIZE - 1));
+    if (left > device->max_burst)
+        left = device->max_burst;
+
+    return len < left ? len : left;
+}
+
+// picks the chip a page lives on and the address within it. Both layouts
+// only switch chips on a page boundary, so a burst cut by
+// aps6404_burst_chunk never spans the two
+static inline APS6404State* aps6404_route(APS6404State* psram, uint32_t addr, uint32_t* device_addr) 
+{
+    *device_addr = addr;
+
+    switch (psram->layout) 
+    {
+        case APS6404_LAYOUT_SPLIT:
+            if ((addr >= PSRAM_SPRITE_BASE && addr < PSRAM_SPRITE_BASE + PSRAM_SPRITE_SIZE) ||
+                (addr >= PSRAM_FONT_BASE && addr < PSRAM_FONT_BASE + PSRAM_FONT_SIZE)) 
+            {
+                return psram->second;
+            }
+            return psram;
+
+        case APS6404_LAYOUT_INTERLEAVED:
+        {
+            uint32_t page = addr / APS6404_PAGE_SIZE;
+            *device_addr = (page >> 1) * APS6404_PAGE_SIZE + (addr & (APS6404_PAGE_SIZE - 1));
+            return (page & 1) ? psram->second : psram;
+        }
+
+        default:
+            return psram;
+    }
+}
+
 bool aps6404_init(APS6404State* psram, PIO pio, uint sm, uint sck, uint data0, uint data1, uint data2, uint data3, uint cs);
+bool aps6404_init_qmi(APS6404State* psram, uint cs);
 void aps6404_deinit(APS6404State* psram);
+void aps6404_set_timing(APS6404State* psram, float clkdiv, uint8_t sample_point);
+void aps6404_attach(APS6404State* psram, APS6404State* second, uint8_t layout);
+uint32_t aps6404_capacity(const APS6404State* psram);
 
 bool aps6404_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len);
 bool aps6404_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len);
 
-typedef struct {
-    bool passed;
-    uint32_t failed_address;
-    uint32_t expected;
-    uint32_t received;
-} MemTestResult;
-
-MemTestResult aps6404_test(APS6404State* psram);
\ No newline at end of file
+// where addr can be read with plain loads, through the xip cache, or NULL
+// when the backend has no mapping. Anything written with aps6404_write
+// shows up there straight away.
+static inline const uint8_t* aps6404_mapped(const APS6404State* psram, uint32_t addr) 
+{
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_QMI
+    return (const uint8_t*)(uintptr_t)(XIP_BASE + APS6404_XIP_OFFSET + addr);
+#else
+    return NULL;
+#endif
+}
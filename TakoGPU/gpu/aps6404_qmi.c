@@ -0,0 +1,257 @@
+// aps6404_qmi.c
+#include "aps6404.h"
+
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_QMI
+
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/xip_cache.h"
+#include "hardware/structs/qmi.h"
+#include "hardware/structs/xip_ctrl.h"
+#include <string.h>
+#include "perf.h"
+
+#if TAKO_PSRAM_LAYOUT != APS6404_LAYOUT_SINGLE
+#error "the qmi backend has one chip select for psram, TAKO_PSRAM_LAYOUT has to be single"
+#endif
+
+// The chip shares the flash's qspi pins and sits on the second chip select,
+// which the qmi maps at XIP_BASE + APS6404_XIP_OFFSET. aps6404_read and
+// aps6404_write go through the uncached alias, so bulk copies don't push
+// code out of the xip cache and always see the bus, while aps6404_mapped
+// hands out the cached alias for small hot reads. Writes invalidate the
+// lines they touch so the two stay coherent.
+#define APS6404_UNCACHED_BASE   (XIP_NOCACHE_NOALLOC_BASE + APS6404_XIP_OFFSET)
+#define APS6404_DIRECT_CLKDIV   30      // well under the chip's spi limit at any system clock
+#define APS6404_MIN_DESELECT_NS 18      // tCPH
+#define APS6404_KGD_PASS        0x5D    // known good die id
+#define XIP_CACHE_LINE          8
+
+// nothing here can run from flash, the qmi stops serving xip while in direct mode
+static void __no_inline_not_in_flash_func(direct_begin)(void) 
+{
+    hw_set_bits(&qmi_hw->direct_csr, QMI_DIRECT_CSR_ASSERT_CS1N_BITS);
+}
+
+static uint8_t __no_inline_not_in_flash_func(direct_byte)(uint8_t value) 
+{
+    qmi_hw->direct_tx = value;
+
+    while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS) 
+    {
+        tight_loop_contents();
+    }
+
+    return (uint8_t)qmi_hw->direct_rx;
+}
+
+static void __no_inline_not_in_flash_func(direct_end)(void) 
+{
+    hw_clear_bits(&qmi_hw->direct_csr, QMI_DIRECT_CSR_ASSERT_CS1N_BITS);
+}
+
+static void __no_inline_not_in_flash_func(direct_command)(uint8_t cmd) 
+{
+    direct_begin();
+    direct_byte(cmd);
+    direct_end();
+}
+
+// a command at quad width, for a chip in qpi mode
+static void __no_inline_not_in_flash_func(direct_quad_command)(uint8_t cmd) 
+{
+    direct_begin();
+    qmi_hw->direct_tx = QMI_DIRECT_TX_NOPUSH_BITS | QMI_DIRECT_TX_IWIDTH_VALUE_Q << QMI_DIRECT_TX_IWIDTH_LSB | cmd;
+    while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS) 
+    {
+        tight_loop_contents();
+    }
+    direct_end();
+}
+
+// resets the chip, reads its id and puts it in qpi mode, all in spi
+static uint8_t __no_inline_not_in_flash_func(direct_setup)(void) 
+{
+    uint8_t kgd = 0;
+    uint32_t irq = save_and_disable_interrupts();
+
+    qmi_hw->direct_csr = APS6404_DIRECT_CLKDIV << QMI_DIRECT_CSR_CLKDIV_LSB | QMI_DIRECT_CSR_EN_BITS;
+    while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS) 
+    {
+        tight_loop_contents();
+    }
+
+    // a chip still in qpi from before a warm reboot won't take the spi
+    // reset, one in spi mode sees two clocks of a command and drops it
+    direct_quad_command(APS6404_CMD_EXIT_QUAD);
+
+    // the reset takes tRST (50 ns), a byte at this divider is longer
+    direct_command(APS6404_CMD_RESET_ENABLE);
+    direct_command(APS6404_CMD_RESET);
+
+    // command, three address bytes, then the manufacturer and die ids
+    direct_begin();
+    direct_byte(APS6404_CMD_READ_ID);
+    for (int n = 0; n < 3; n++) 
+    {
+        direct_byte(0);
+    }
+    direct_byte(0);
+    kgd = direct_byte(0);
+    direct_end();
+
+    if (kgd == APS6404_KGD_PASS)
+        direct_command(APS6404_CMD_ENTER_QUAD);
+
+    hw_clear_bits(&qmi_hw->direct_csr, QMI_DIRECT_CSR_EN_BITS);
+    restore_interrupts(irq);
+
+    return kgd;
+}
+
+static void __no_inline_not_in_flash_func(direct_exit_quad)(void) 
+{
+    uint32_t irq = save_and_disable_interrupts();
+
+    qmi_hw->direct_csr = APS6404_DIRECT_CLKDIV << QMI_DIRECT_CSR_CLKDIV_LSB | QMI_DIRECT_CSR_EN_BITS;
+    while (qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS) 
+    {
+        tight_loop_contents();
+    }
+
+    direct_quad_command(APS6404_CMD_EXIT_QUAD);
+
+    hw_clear_bits(&qmi_hw->direct_csr, QMI_DIRECT_CSR_EN_BITS);
+    restore_interrupts(irq);
+}
+
+// The sweep's clkdiv is in pio units, where sck is half the pio clock, so
+// the qmi divider is twice it. Sample points become rx delays of that many
+// half system clocks, which keeps them in order of increasing delay.
+void aps6404_set_timing(APS6404State* psram, float clkdiv, uint8_t sample_point) 
+{
+    uint32_t sys_mhz = clock_get_hz(clk_sys) / 1000000;
+    uint32_t divider = (uint32_t)(clkdiv * 2.0f + 0.5f);
+    uint32_t max_select = (APS6404_MAX_SELECT_NS * sys_mhz) / (64 * 1000);
+    uint32_t min_deselect = (APS6404_MIN_DESELECT_NS * sys_mhz + 999) / 1000;
+
+    psram->clkdiv = clkdiv;
+    psram->sample_point = sample_point;
+
+    qmi_hw->m[1].timing = 1 << QMI_M1_TIMING_COOLDOWN_LSB |
+                          QMI_M1_TIMING_PAGEBREAK_VALUE_1024 << QMI_M1_TIMING_PAGEBREAK_LSB |
+                          max_select << QMI_M1_TIMING_MAX_SELECT_LSB |
+                          min_deselect << QMI_M1_TIMING_MIN_DESELECT_LSB |
+                          (uint32_t)sample_point << QMI_M1_TIMING_RXDELAY_LSB |
+                          divider << QMI_M1_TIMING_CLKDIV_LSB;
+
+    // anything cached was read at the old timing
+    xip_cache_invalidate_all();
+}
+
+bool aps6404_init_qmi(APS6404State* psram, uint cs) 
+{
+    memset(psram, 0, sizeof(*psram));
+    psram->cs_pin = cs;
+    psram->layout = APS6404_LAYOUT_SINGLE;
+
+    gpio_set_function(cs, GPIO_FUNC_XIP_CS1);
+
+    if (direct_setup() != APS6404_KGD_PASS)
+        return false;
+
+    psram->quad_mode = true;
+
+    // fast quad read with its 6 wait cycles, and quad write
+    qmi_hw->m[1].rfmt = QMI_M1_RFMT_PREFIX_WIDTH_VALUE_Q << QMI_M1_RFMT_PREFIX_WIDTH_LSB |
+                        QMI_M1_RFMT_ADDR_WIDTH_VALUE_Q << QMI_M1_RFMT_ADDR_WIDTH_LSB |
+                        QMI_M1_RFMT_SUFFIX_WIDTH_VALUE_Q << QMI_M1_RFMT_SUFFIX_WIDTH_LSB |
+                        QMI_M1_RFMT_DUMMY_WIDTH_VALUE_Q << QMI_M1_RFMT_DUMMY_WIDTH_LSB |
+                        QMI_M1_RFMT_DATA_WIDTH_VALUE_Q << QMI_M1_RFMT_DATA_WIDTH_LSB |
+                        QMI_M1_RFMT_PREFIX_LEN_VALUE_8 << QMI_M1_RFMT_PREFIX_LEN_LSB |
+                        APS6404_WAIT_CYCLES << QMI_M1_RFMT_DUMMY_LEN_LSB; // in nibbles, one per quad clock
+    qmi_hw->m[1].rcmd = APS6404_CMD_FAST_READ_QUAD << QMI_M1_RCMD_PREFIX_LSB;
+
+    qmi_hw->m[1].wfmt = QMI_M1_WFMT_PREFIX_WIDTH_VALUE_Q << QMI_M1_WFMT_PREFIX_WIDTH_LSB |
+                        QMI_M1_WFMT_ADDR_WIDTH_VALUE_Q << QMI_M1_WFMT_ADDR_WIDTH_LSB |
+                        QMI_M1_WFMT_SUFFIX_WIDTH_VALUE_Q << QMI_M1_WFMT_SUFFIX_WIDTH_LSB |
+                        QMI_M1_WFMT_DUMMY_WIDTH_VALUE_Q << QMI_M1_WFMT_DUMMY_WIDTH_LSB |
+                        QMI_M1_WFMT_DATA_WIDTH_VALUE_Q << QMI_M1_WFMT_DATA_WIDTH_LSB |
+                        QMI_M1_WFMT_PREFIX_LEN_VALUE_8 << QMI_M1_WFMT_PREFIX_LEN_LSB;
+    qmi_hw->m[1].wcmd = APS6404_CMD_WRITE_QUAD << QMI_M1_WCMD_PREFIX_LSB;
+
+    // conservative until psram_tune_run has found the fastest safe setting
+    float clkdiv = clock_get_hz(clk_sys) / (2.0f * APS6404_SAFE_SCK_HZ);
+    aps6404_set_timing(psram, clkdiv < 1.0f ? 1.0f : clkdiv, APS6404_SAMPLE_RISE);
+
+    hw_set_bits(&xip_ctrl_hw->ctrl, XIP_CTRL_WRITABLE_M1_BITS);
+
+    return true;
+}
+
+void aps6404_deinit(APS6404State* psram) 
+{
+    hw_clear_bits(&xip_ctrl_hw->ctrl, XIP_CTRL_WRITABLE_M1_BITS);
+
+    if (psram->quad_mode) 
+    {
+        direct_exit_quad();
+        psram->quad_mode = false;
+    }
+
+    xip_cache_invalidate_all();
+}
+
+// one chip select, nothing to attach
+void aps6404_attach(APS6404State* psram, APS6404State* second, uint8_t layout) 
+{
+    psram->second = NULL;
+    psram->layout = APS6404_LAYOUT_SINGLE;
+}
+
+uint32_t aps6404_capacity(const APS6404State* psram) 
+{
+    return APS6404_SIZE;
+}
+
+// whole cache lines, any that hold part of the range go
+static void invalidate(uint32_t addr, size_t len) 
+{
+    uint32_t first = (APS6404_XIP_OFFSET + addr) & ~(XIP_CACHE_LINE - 1);
+    uint32_t end = (APS6404_XIP_OFFSET + addr + len + XIP_CACHE_LINE - 1) & ~(XIP_CACHE_LINE - 1);
+
+    xip_cache_invalidate_range(first, end - first);
+}
+
+// the qmi breaks bursts at pages itself
+bool aps6404_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len) 
+{
+    if (!len)
+        return true;
+
+    uint32_t start = perf_cycles();
+
+    memcpy((void*)(uintptr_t)(APS6404_UNCACHED_BASE + addr), data, len);
+    invalidate(addr, len);
+
+    perf_stage_add(PERF_STAGE_PSRAM, perf_cycles() - start);
+
+    return true;
+}
+
+bool aps6404_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len) 
+{
+    if (!len)
+        return true;
+
+    uint32_t start = perf_cycles();
+
+    memcpy(data, (const void*)(uintptr_t)(APS6404_UNCACHED_BASE + addr), len);
+
+    perf_stage_add(PERF_STAGE_PSRAM, perf_cycles() - start);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+// Blend modes for RGB565 sprites. The pair functions work on two native
+// order pixels packed in one 32-bit word (SWAR), the pixel functions are
+// the per-channel reference they must match exactly.
+#define BLEND_NONE      0
+#define BLEND_AVERAGE   1 // (dst + src) / 2
+#define BLEND_ADD       2 // dst + src, saturating
+#define BLEND_SUBTRACT  3 // dst - src, saturating at 0
+
+// every channel's lowest and highest bit, two pixels per word
+#define BLEND_LOW_BITS  0x08210821u
+#define BLEND_HIGH_BITS 0x84108410u
+
+static inline uint32_t blend_pair_average(uint32_t dst, uint32_t src) 
+{
+    // dropping each channel's low bit before the shift keeps it from
+    // spilling into the channel below
+    return (dst & src) + (((dst ^ src) & ~BLEND_LOW_BITS) >> 1);
+}
+
+static inline uint32_t blend_pair_add(uint32_t dst, uint32_t src) 
+{
+    // add everything below each channel's top bit, so no carry leaves a channel
+    uint32_t low = (dst & ~BLEND_HIGH_BITS) + (src & ~BLEND_HIGH_BITS);
+    uint32_t sum = low ^ ((dst ^ src) & BLEND_HIGH_BITS);
+    uint32_t carry = ((dst & src) | ((dst ^ src) & low)) & BLEND_HIGH_BITS;
+
+    // spread each carry down over its channel, red/blue are 5 bits and green is 6
+    uint32_t carry_rb = carry & 0x80108010u;
+    uint32_t carry_g = carry & 0x04000400u;
+    uint32_t saturate = (carry_rb - (carry_rb >> 4)) | (carry_g - (carry_g >> 5)) | carry;
+
+    return sum | saturate;
+}
+
+static inline uint32_t blend_pair_subtract(uint32_t dst, uint32_t src) 
+{
+    // max(dst - src, 0) == max - min(max, (max - dst) + src)
+    return ~blend_pair_add(~dst, src);
+}
+
+static inline uint32_t blend_pair(uint32_t dst, uint32_t src, uint8_t mode) 
+{
+    switch (mode) 
+    {
+        case BLEND_AVERAGE:
+            return blend_pair_average(dst, src);
+        case BLEND_ADD:
+            return blend_pair_add(dst, src);
+        case BLEND_SUBTRACT:
+            return blend_pair_subtract(dst, src);
+        default:
+            return src;
+    }
+}
+
+static inline uint16_t blend_pixel(uint16_t dst, uint16_t src, uint8_t mode) 
+{
+    int dr = dst >> 11, dg = (dst >> 5) & 0x3F, db = dst & 0x1F;
+    int sr = src >> 11, sg = (src >> 5) & 0x3F, sb = src & 0x1F;
+    int r, g, b;
+
+    switch (mode) 
+    {
+        case BLEND_AVERAGE:
+            r = (dr + sr) >> 1;
+            g = (dg + sg) >> 1;
+            b = (db + sb) >> 1;
+            break;
+        case BLEND_ADD:
+            r = dr + sr > 0x1F ? 0x1F : dr + sr;
+            g = dg + sg > 0x3F ? 0x3F : dg + sg;
+            b = db + sb > 0x1F ? 0x1F : db + sb;
+            break;
+        case BLEND_SUBTRACT:
+            r = dr > sr ? dr - sr : 0;
+            g = dg > sg ? dg - sg : 0;
+            b = db > sb ? db - sb : 0;
+            break;
+        default:
+            return src;
+    }
+
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+// display order <-> native order for both pixels of a word (rev16)
+static inline uint32_t blend_swap_pixels(uint32_t pixels) 
+{
+    return ((pixels & 0x00FF00FFu) << 8) | ((pixels >> 8) & 0x00FF00FFu);
+}
@@ -0,0 +1,279 @@
+#include "blitter.h"
+#include "display.h"
+#include "hardware/dma.h"
+#include "pico/time.h"
+#include "../externs.h"
+#include <string.h>
+
+static BlitOp ops[MAX_BLIT_OPS];
+static uint8_t op_count;
+static uint8_t banded_count; // ops ahead of the first copy
+
+static int dma_chan_fill;
+static uint32_t fill_word;
+
+static uint16_t surface_row[DISPLAY_WIDTH];
+
+static BlitterStats stats;
+
+bool blitter_init(void) 
+{
+    op_count = 0;
+    banded_count = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    dma_chan_fill = dma_claim_unused_channel(true);
+
+    return true;
+}
+
+// clips a destination rect to the screen and the band, moving the source
+// offset along with it. false if nothing is left.
+static bool clip_rect(const BlitOp* op, int16_t first_line, int16_t end_line, 
+                      int16_t* x, int16_t* y, int16_t* w, int16_t* h, int16_t* sx, int16_t* sy) 
+{
+    *x = op->x;
+    *y = op->y;
+    *w = op->width;
+    *h = op->height;
+    *sx = 0;
+    *sy = 0;
+
+    if (*x < 0) 
+    {
+        *sx -= *x;
+        *w += *x;
+        *x = 0;
+    }
+
+    if (*y < first_line) 
+    {
+        *sy += first_line - *y;
+        *h -= first_line - *y;
+        *y = first_line;
+    }
+
+    if (*x + *w > DISPLAY_WIDTH) 
+        *w = DISPLAY_WIDTH - *x;
+
+    if (*y + *h > end_line) 
+        *h = end_line - *y;
+
+    return *w > 0 && *h > 0;
+}
+
+// the dma channel repeats one word, two pixels at a time
+static void fill_span(uint16_t* dst, uint16_t count, uint16_t color) 
+{
+    if (((uintptr_t)dst & 2) && count) 
+    {
+        *dst++ = color;
+        count--;
+    }
+
+    if (count >= 2) 
+    {
+        fill_word = ((uint32_t)color << 16) | color;
+
+        dma_channel_config config = dma_channel_get_default_config(dma_chan_fill);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+
+        dma_channel_configure(dma_chan_fill, &config, dst, &fill_word, count / 2, true);
+        dma_channel_wait_for_finish_blocking(dma_chan_fill);
+
+        dst += count & ~1;
+    }
+
+    if (count & 1) 
+    {
+        *dst = color;
+    }
+}
+
+static void run_fill(const BlitOp* op, uint16_t* frame, int16_t first_line, int16_t end_line) 
+{
+    int16_t x, y, w, h, sx, sy;
+    if (!clip_rect(op, first_line, end_line, &x, &y, &w, &h, &sx, &sy)) 
+        return;
+
+    // full width rows are contiguous, one transfer covers them all
+    if (w == DISPLAY_WIDTH) 
+    {
+        fill_span(frame + (y * DISPLAY_WIDTH), w * h, op->color);
+    }
+    else 
+    {
+        for (int16_t row = 0; row < h; row++) 
+        {
+            fill_span(frame + ((y + row) * DISPLAY_WIDTH) + x, w, op->color);
+        }
+    }
+
+    stats.pixels += w * h;
+}
+
+static void copy_span(uint16_t* dst, const uint16_t* src, uint16_t count) 
+{
+    // same row overlap, or halves that never line up on a word
+    if ((dst < src + count && src < dst + count) || (((uintptr_t)dst ^ (uintptr_t)src) & 2)) 
+    {
+        memmove(dst, src, count * sizeof(uint16_t));
+        return;
+    }
+
+    if (((uintptr_t)dst & 2) && count) 
+    {
+        *dst++ = *src++;
+        count--;
+    }
+
+    uint32_t* dst32 = (uint32_t*)dst;
+    const uint32_t* src32 = (const uint32_t*)src;
+    for (uint16_t n = count / 2; n; n--) 
+    {
+        *dst32++ = *src32++;
+    }
+
+    if (count & 1) 
+    {
+        dst[count - 1] = src[count - 1];
+    }
+}
+
+static void run_copy(const BlitOp* op, uint16_t* frame) 
+{
+    int16_t x, y, w, h, sx, sy;
+    if (!clip_rect(op, 0, DISPLAY_HEIGHT, &x, &y, &w, &h, &sx, &sy)) 
+        return;
+
+    sx += op->src_x;
+    sy += op->src_y;
+
+    // the source has to be on screen too
+    if (sx < 0) 
+    {
+        x -= sx;
+        w += sx;
+        sx = 0;
+    }
+
+    if (sy < 0) 
+    {
+        y -= sy;
+        h += sy;
+        sy = 0;
+    }
+
+    if (sx + w > DISPLAY_WIDTH) 
+        w = DISPLAY_WIDTH - sx;
+
+    if (sy + h > DISPLAY_HEIGHT) 
+        h = DISPLAY_HEIGHT - sy;
+
+    if (w <= 0 || h <= 0) 
+        return;
+
+    // walk rows away from the overlap
+    bool upward = sy < y;
+    for (int16_t n = 0; n < h; n++) 
+    {
+        int16_t row = upward ? (h - 1 - n) : n;
+        copy_span(frame + ((y + row) * DISPLAY_WIDTH) + x, frame + ((sy + row) * DISPLAY_WIDTH) + sx, w);
+    }
+
+    stats.pixels += w * h;
+}
+
+static void run_surface(const BlitOp* op, uint16_t* frame, int16_t first_line, int16_t end_line) 
+{
+    int16_t x, y, w, h, sx, sy;
+    if (!clip_rect(op, first_line, end_line, &x, &y, &w, &h, &sx, &sy)) 
+        return;
+
+    bool keyed = (op->flags & BLIT_FLAG_COLOR_KEY) != 0;
+
+    for (int16_t row = 0; row < h; row++) 
+    {
+        uint32_t addr = op->src_addr + ((sy + row) * op->src_stride) + (sx * sizeof(uint16_t));
+        uint16_t* dst = frame + ((y + row) * DISPLAY_WIDTH) + x;
+
+        if (!keyed) 
+        {
+            aps6404_read(&psram, addr, (uint8_t*)dst, w * sizeof(uint16_t));
+            continue;
+        }
+
+        aps6404_read(&psram, addr, (uint8_t*)surface_row, w * sizeof(uint16_t));
+        for (int16_t px = 0; px < w; px++) 
+        {
+            if (surface_row[px] != op->color) 
+                dst[px] = surface_row[px];
+        }
+    }
+
+    stats.pixels += w * h;
+}
+
+bool blitter_queue(const BlitOp* op) 
+{
+    if (op_count >= MAX_BLIT_OPS || op->op > BLIT_OP_SURFACE) 
+        return false;
+
+    if (banded_count == op_count && op->op != BLIT_OP_COPY) 
+        banded_count++;
+
+    ops[op_count++] = *op;
+    return true;
+}
+
+bool blitter_has_copies(void) 
+{
+    return banded_count < op_count;
+}
+
+// fills and surface blits only touch their own rows, so the ones queued
+// ahead of any copy run as soon as the sprites for a band are composed
+void blitter_run_band(uint16_t* frame, uint16_t first_line, uint16_t end_line) 
+{
+    uint32_t start = time_us_32();
+
+    for (uint8_t i = 0; i < banded_count; i++) 
+    {
+        if (ops[i].op == BLIT_OP_FILL) 
+            run_fill(&ops[i], frame, first_line, end_line);
+        else 
+            run_surface(&ops[i], frame, first_line, end_line);
+    }
+
+    stats.time_us += time_us_32() - start;
+}
+
+// a copy reads back from the whole frame, so it and everything queued after
+// it run in queue order once every band is done
+void blitter_finish_frame(uint16_t* frame) 
+{
+    uint32_t start = time_us_32();
+
+    for (uint8_t i = banded_count; i < op_count; i++) 
+    {
+        if (ops[i].op == BLIT_OP_COPY) 
+            run_copy(&ops[i], frame);
+        else if (ops[i].op == BLIT_OP_FILL) 
+            run_fill(&ops[i], frame, 0, DISPLAY_HEIGHT);
+        else 
+            run_surface(&ops[i], frame, 0, DISPLAY_HEIGHT);
+    }
+
+    op_count = 0;
+    banded_count = 0;
+    stats.time_us += time_us_32() - start;
+}
+
+BlitterStats blitter_take_stats(void) 
+{
+    BlitterStats taken = stats;
+    memset(&stats, 0, sizeof(stats));
+    return taken;
+}
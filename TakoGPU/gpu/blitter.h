@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_BLIT_OPS            32
+
+#define BLIT_OP_FILL            0 // solid rectangle
+#define BLIT_OP_COPY            1 // rectangle within the frame buffer
+#define BLIT_OP_SURFACE         2 // rgb565 surface in psram to the frame buffer
+
+#define BLIT_FLAG_COLOR_KEY     0x01 // surface pixels equal to color are skipped
+
+// colors are in display byte order, like the frame buffer
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    int16_t src_x;       // BLIT_OP_COPY
+    int16_t src_y;
+    uint32_t src_addr;   // BLIT_OP_SURFACE, first pixel of the source rect
+    uint16_t src_stride; // BLIT_OP_SURFACE, bytes per source row
+    uint16_t color;      // fill color or color key
+} BlitOp;
+
+typedef struct {
+    uint32_t pixels;
+    uint32_t time_us;
+} BlitterStats;
+
+bool blitter_init(void);
+
+// ops queued while commands are processed are drawn over the next frame,
+// in queue order. fills and surface blits ahead of the first copy run band
+// by band, the first copy and everything after it once the bands are done,
+// so a frame with copies has its text layer and surface captures done after
+// blitter_finish_frame (see render.c) to keep text above every blit
+bool blitter_queue(const BlitOp* op);
+bool blitter_has_copies(void);
+
+void blitter_run_band(uint16_t* frame, uint16_t first_line, uint16_t end_line);
+void blitter_finish_frame(uint16_t* frame);
+
+BlitterStats blitter_take_stats(void);
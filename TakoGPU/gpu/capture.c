@@ -0,0 +1,240 @@
+#include "capture.h"
+#include "aps6404.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+#include "../externs.h"
+#include <stdio.h>
+#include <string.h>
+
+static spin_lock_t* lock;
+
+// the pusher fills one buffer while the frame loop writes the other out
+static uint8_t staging[2][CAPTURE_STAGING_SIZE];
+static uint16_t staged[2];
+static volatile uint8_t active;
+
+static volatile bool capturing;
+static volatile uint32_t capture_frame;
+static volatile uint32_t frame_start_us;
+static uint32_t start_frame;
+
+static bool replaying;
+static bool replay_max_speed;
+static bool replay_loaded;
+static uint32_t replay_pos;
+static uint32_t replay_start_us;
+static CaptureRecord replay_record;
+static uint8_t replay_command[CMD_DATA_BUFFER_SIZE];
+
+static CaptureStatus status;
+
+void capture_init(void) 
+{
+    lock = spin_lock_init(spin_lock_claim_unused(true));
+
+    memset(&status, 0, sizeof(status));
+    staged[0] = staged[1] = 0;
+    active = 0;
+    capturing = false;
+    replaying = false;
+}
+
+bool capture_start(void) 
+{
+    if (replaying) 
+        return false;
+
+    uint32_t save = spin_lock_blocking(lock);
+    staged[0] = staged[1] = 0;
+    status.length = 0;
+    status.commands = 0;
+    status.dropped = 0;
+    start_frame = capture_frame;
+    capturing = true;
+    spin_unlock(lock, save);
+
+    return true;
+}
+
+void capture_stop(void) 
+{
+    capturing = false;
+}
+
+bool capture_replay(bool max_speed) 
+{
+    if (capturing || replaying || !status.length) 
+        return false;
+
+    replaying = true;
+    replay_max_speed = max_speed;
+    replay_loaded = false;
+    replay_pos = 0;
+    replay_start_us = time_us_32();
+    status.replayed = 0;
+    status.skipped = 0;
+    status.replay_frames = 0;
+    status.replay_us = 0;
+
+    return true;
+}
+
+CaptureStatus capture_get_status(void) 
+{
+    status.capturing = capturing;
+    status.replaying = replaying;
+    return status;
+}
+
+// called by the pusher for every accepted command
+void capture_record(const void* cmd_data, uint16_t cmd_len) 
+{
+    if (!capturing) 
+        return;
+
+    // reading the capture back shouldn't end up in it
+    uint8_t cmd = ((const GpuCommandHeader*)cmd_data)->cmd;
+    if (cmd == CMD_CAPTURE || cmd == CMD_READ_CAPTURE) 
+        return;
+
+    uint32_t save = spin_lock_blocking(lock);
+
+    uint8_t buffer = active;
+    if (staged[buffer] + sizeof(CaptureRecord) + cmd_len > CAPTURE_STAGING_SIZE) 
+    {
+        status.dropped++;
+        spin_unlock(lock, save);
+        return;
+    }
+
+    CaptureRecord record = {
+        .frame = capture_frame - start_frame,
+        .frame_us = time_us_32() - frame_start_us,
+        .length = cmd_len
+    };
+
+    memcpy(&staging[buffer][staged[buffer]], &record, sizeof(record));
+    memcpy(&staging[buffer][staged[buffer] + sizeof(record)], cmd_data, cmd_len);
+    staged[buffer] += sizeof(record) + cmd_len;
+
+    spin_unlock(lock, save);
+}
+
+static void flush_staging(void) 
+{
+    uint32_t save = spin_lock_blocking(lock);
+    uint8_t buffer = active;
+    active = !active;
+    spin_unlock(lock, save);
+
+    uint16_t length = staged[buffer];
+    if (!length) 
+        return;
+
+    // records never straddle the end, a capture that fills up just stops
+    if (status.length + length > PSRAM_CAPTURE_SIZE) 
+    {
+        capturing = false;
+        status.dropped++;
+    }
+    else 
+    {
+        aps6404_write(&psram, PSRAM_CAPTURE_BASE + status.length, staging[buffer], length);
+        status.length += length;
+
+        for (uint16_t pos = 0; pos < length; status.commands++) 
+        {
+            CaptureRecord record;
+            memcpy(&record, &staging[buffer][pos], sizeof(record));
+            pos += sizeof(record) + record.length;
+        }
+    }
+
+    staged[buffer] = 0;
+}
+
+// pushes what's due until the queue is full or the capture runs out,
+// returns how many commands went in
+static uint32_t replay_push(CommandLanes* lanes) 
+{
+    uint32_t pushed = 0;
+
+    while (replaying) 
+    {
+        if (!replay_loaded) 
+        {
+            if (replay_pos >= status.length) 
+            {
+                replaying = false;
+                status.replay_us = time_us_32() - replay_start_us;
+#if TAKO_STATS_STDIO
+                printf("Replay done: %lu commands over %lu frames in %lu us\n", (unsigned long)status.replayed,
+                       (unsigned long)status.replay_frames, (unsigned long)status.replay_us);
+#endif
+                break;
+            }
+
+            aps6404_read(&psram, PSRAM_CAPTURE_BASE + replay_pos, (uint8_t*)&replay_record, sizeof(replay_record));
+            aps6404_read(&psram, PSRAM_CAPTURE_BASE + replay_pos + sizeof(replay_record), replay_command, replay_record.length);
+            replay_pos += sizeof(replay_record) + replay_record.length;
+
+            // its payload was never captured, the command would wait on the bus for it
+            if (cmd_is_streamed((const GpuCommandHeader*)replay_command)) 
+            {
+                status.skipped++;
+                continue;
+            }
+
+            // responses would confuse a host that never sent the command
+            ((GpuCommandHeader*)replay_command)->flags &= ~CMD_FLAG_NEEDS_RESPONSE;
+            replay_loaded = true;
+        }
+
+        if (!replay_max_speed && replay_record.frame > status.replay_frames) 
+            break;
+
+        // a full queue just holds the command over
+        if (!cmd_lanes_push(lanes, replay_command, replay_record.length, false, 0)) 
+            break;
+
+        replay_loaded = false;
+        status.replayed++;
+        pushed++;
+    }
+
+    return pushed;
+}
+
+bool capture_replaying_max(void) 
+{
+    return replaying && replay_max_speed;
+}
+
+bool capture_replay_refill(CommandLanes* lanes) 
+{
+    return capture_replaying_max() && replay_push(lanes);
+}
+
+void capture_start_frame(CommandLanes* lanes, uint32_t frame) 
+{
+    capture_frame = frame;
+    frame_start_us = time_us_32();
+
+    flush_staging();
+    replay_push(lanes);
+
+    if (replaying) 
+        status.replay_frames++;
+}
+
+uint16_t capture_read(uint32_t offset, uint8_t* data, uint16_t len) 
+{
+    if (offset >= status.length) 
+        return 0;
+
+    if (len > status.length - offset) 
+        len = status.length - offset;
+
+    aps6404_read(&psram, PSRAM_CAPTURE_BASE + offset, data, len);
+    return len;
+}
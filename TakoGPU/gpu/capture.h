@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "command_queue.h"
+
+// Command stream capture. While capturing, every command accepted by
+// cmd_lanes_push is copied into the psram capture region as a
+// CaptureRecord followed by the command bytes, so real host traffic can be
+// read back, or replayed through the queue as a repeatable workload.
+// Records are staged in sram by the pusher and written out once a frame.
+// A streamed command's payload goes straight from the bus to its
+// destination and isn't captured, so its record is the command alone and
+// replay skips it.
+#define CAPTURE_STAGING_SIZE    4096
+#define CAPTURE_READ_CHUNK      256
+
+#define CAPTURE_ACTION_STOP     0
+#define CAPTURE_ACTION_START    1 // discards the previous capture
+#define CAPTURE_ACTION_REPLAY   2 // pushes records on the frames they were captured on
+#define CAPTURE_ACTION_REPLAY_MAX 3 // pushes records as fast as they execute, see cmd_exec_drain
+#define CAPTURE_ACTION_STATUS   4 // responds with CaptureStatus
+
+typedef struct __attribute__((packed)) {
+    uint32_t frame;    // frames since the capture started
+    uint32_t frame_us; // time into that frame the command was pushed
+    uint16_t length;   // command bytes that follow
+} CaptureRecord;
+
+typedef struct __attribute__((packed)) {
+    uint8_t capturing;
+    uint8_t replaying;
+    uint32_t length;   // bytes in the capture region
+    uint32_t commands;
+    uint32_t dropped;  // commands lost to a full staging buffer or region
+    uint32_t replayed; // commands pushed by the current or last replay
+    uint32_t skipped;  // streamed commands the replay left out
+    uint32_t replay_frames;
+    uint32_t replay_us;
+} CaptureStatus;
+
+// response to CMD_READ_CAPTURE, only count bytes of data are sent
+typedef struct __attribute__((packed)) {
+    uint32_t offset;
+    uint16_t count;  // 0 past the end of the capture
+    uint8_t data[CAPTURE_READ_CHUNK];
+} CaptureChunk;
+
+void capture_init(void);
+
+bool capture_start(void);
+void capture_stop(void);
+bool capture_replay(bool max_speed);
+CaptureStatus capture_get_status(void);
+
+void capture_record(const void* cmd_data, uint16_t cmd_len);
+void capture_start_frame(CommandLanes* lanes, uint32_t frame);
+
+// a max speed replay tops the lanes up whenever the drain empties them
+bool capture_replaying_max(void);
+bool capture_replay_refill(CommandLanes* lanes);
+
+uint16_t capture_read(uint32_t offset, uint8_t* data, uint16_t len);
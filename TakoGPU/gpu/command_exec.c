@@ -0,0 +1,938 @@
+#include "command_exec.h"
+#include "aps6404.h"
+#include "blitter.h"
+#include "capture.h"
+#include "display.h"
+#include "display_list.h"
+#include "gpu_status.h"
+#include "perf.h"
+#include "psram_test.h"
+#include "rle.h"
+#include "sprite_engine.h"
+#include "surface.h"
+#include "text_layer.h"
+#include "trace.h"
+#include "hardware/clocks.h"
+#include "pico/time.h"
+#include "../externs.h"
+#include <string.h>
+
+typedef struct {
+    uint16_t fence_id;
+    uint32_t frame;
+} PendingFence;
+
+static CommandLanes* lanes;
+static TransferState* transfer;
+static uint32_t current_frame;
+
+static PendingFence pending_fences[MAX_PENDING_FENCES];
+static uint8_t pending_fence_count;
+
+static bool upload_payload(const GpuCommandHeader* header, const uint8_t* payload, size_t available,
+                           uint32_t size, RleWriteFn write, void* ctx, UploadStats* stats);
+static void send_upload_response(const GpuCommandHeader* header, const UploadStats* stats);
+static void drain_payload(const GpuCommandHeader* header, const uint8_t* payload, size_t available);
+static void drain_rejected(const GpuCommandHeader* header, const uint8_t* data, size_t len);
+static bool psram_write_at(void* ctx, uint32_t offset, const uint8_t* data, size_t len);
+static bool sram_write_at(void* ctx, uint32_t offset, const uint8_t* data, size_t len);
+
+void cmd_exec_init(CommandLanes* cmd_lanes, TransferState* transfer_state) 
+{
+    lanes = cmd_lanes;
+    transfer = transfer_state;
+    current_frame = 0;
+    pending_fence_count = 0;
+}
+
+// applies the commands due on this frame, normal lane commands only up to
+// the frame's bulk budget. a replay at max speed refills the lanes from the
+// capture as they run dry and isn't held to the budget, so it goes as fast
+// as the commands execute rather than a queue's worth a frame
+void cmd_exec_drain(uint32_t frame) 
+{
+    static uint8_t cmd_buffer[CMD_DATA_BUFFER_SIZE];
+    uint16_t cmd_len;
+    bool needs_response;
+    uint16_t response_len;
+    bool was_priority;
+    uint32_t bulk_bytes = 0;
+    bool unbudgeted = capture_replaying_max();
+
+    current_frame = frame;
+
+    while (true) 
+    {
+        if (!cmd_lanes_pop(lanes, frame, unbudgeted || bulk_bytes < CMD_BULK_BYTES_PER_FRAME,
+                           cmd_buffer, &cmd_len, &needs_response, &response_len, &was_priority)) 
+        {
+            if (unbudgeted && capture_replay_refill(lanes))
+                continue;
+
+            break;
+        }
+
+        perf_mark_boot(PERF_BOOT_FIRST_COMMAND);
+
+        trace_event(TRACE_CMD_BEGIN, cmd_buffer[0], cmd_len);
+        cmd_execute(cmd_buffer, cmd_len);
+        trace_event(TRACE_CMD_END, cmd_buffer[0], 0);
+
+        if (!was_priority) 
+        {
+            bulk_bytes += cmd_len;
+        }
+    }
+
+    transfer_flush_responses(transfer);
+}
+
+void cmd_execute(const uint8_t* cmd_data, size_t cmd_len) 
+{
+    if (cmd_len < sizeof(GpuCommandHeader)) 
+        return;
+
+    GpuCommandHeader* header = (GpuCommandHeader*)cmd_data;
+    const uint8_t* data = cmd_data + sizeof(GpuCommandHeader);
+
+    // while a list is being recorded the drawing and state commands up to
+    // CMD_END_LIST go into it, priority commands and queries still run now
+    if (display_list_recording() && header->cmd != CMD_END_LIST && header->cmd != CMD_CAPTURE &&
+        !cmd_is_high_priority(header) && !cmd_is_priority_type(header->cmd) && !cmd_is_query(header->cmd)) 
+    {
+        bool success = display_list_record(cmd_data, cmd_len);
+        if (!success) 
+        {
+            drain_rejected(header, data, cmd_len - sizeof(GpuCommandHeader));
+        }
+        if (cmd_needs_response(header)) 
+        {
+            transfer_send_ack(transfer, success);
+        }
+        return;
+    }
+
+    perf_count_command(header->cmd);
+
+    // the queue already scheduled the command, step over its target frame
+    if (cmd_has_target_frame(header)) 
+    {
+        if (cmd_len < sizeof(GpuCommandHeader) + sizeof(uint32_t)) return;
+        data += sizeof(uint32_t);
+        cmd_len -= sizeof(uint32_t);
+    }
+    
+    // Reset sprite engine if needed
+    if (cmd_resets_state(header)) 
+    {
+        sprite_engine_reset();
+    }
+    
+    // high priority commands were already routed to their own lane by cmd_lanes_push
+
+    switch(header->cmd) 
+    {
+        case CMD_INIT:
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, true);
+            }
+            break;
+            
+        case CMD_LOAD_PATTERN: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadPatternData)) break;
+            LoadPatternData* pattern = (LoadPatternData*)data;
+            uint32_t size = pattern_data_size(pattern->size);
+            size_t available = cmd_len - sizeof(GpuCommandHeader) - sizeof(LoadPatternData);
+            UploadStats stats = { 0 };
+
+            if (size && pattern->pattern_num < MAX_PATTERNS) 
+            {
+                uint32_t addr = pattern_address(pattern->pattern_num);
+
+                upload_payload(header, data + sizeof(LoadPatternData), available, size, psram_write_at, &addr, &stats);
+            }
+            else 
+            {
+                drain_payload(header, data + sizeof(LoadPatternData), available);
+            }
+            
+            send_upload_response(header, &stats);
+            break;
+        }
+        
+        case CMD_UPDATE_SPRITE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(UpdateSpriteData)) break;
+            UpdateSpriteData* spriteUpdateData = (UpdateSpriteData*)data;
+            
+            // Check if sprite number is within bounds
+            if (spriteUpdateData->sprite_num >= MAX_SPRITES) 
+            {
+                bool success = false;
+                if (cmd_needs_response(header)) 
+                {
+                    transfer_send_ack(transfer, success);
+                }
+                
+                break;
+            }
+            
+            Sprite sprite;
+            sprite.x = spriteUpdateData->x;
+            sprite.y = spriteUpdateData->y;
+            sprite.pattern = spriteUpdateData->pattern;
+            sprite.attr = spriteUpdateData->attr;
+            sprite.ctrl = spriteUpdateData->ctrl;
+            sprite.ext = spriteUpdateData->ext;
+            
+            bool success = sprite_update((uint8_t)spriteUpdateData->sprite_num, &sprite);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+        
+        case CMD_LOAD_PALETTE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadPaletteData)) 
+            { 
+                break;
+            }
+
+            LoadPaletteData* palette = (LoadPaletteData*)data;
+            uint16_t colors[COLORS_PER_PALETTE];
+            size_t available = cmd_len - sizeof(GpuCommandHeader) - sizeof(LoadPaletteData);
+            UploadStats stats = { 0 };
+
+            if (upload_payload(header, data + sizeof(LoadPaletteData), available, sizeof(colors), sram_write_at, colors, &stats)) 
+            {
+                stats.success = palette_load(palette->palette_num, colors);
+            }
+            
+            send_upload_response(header, &stats);
+            break;
+        }
+
+        case CMD_LOAD_TILEMAP: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadTilemapData)) break;
+            LoadTilemapData* tilemap = (LoadTilemapData*)data;
+            size_t available = cmd_len - sizeof(GpuCommandHeader) - sizeof(LoadTilemapData);
+            UploadStats stats = { 0 };
+
+            if (tilemap->offset <= PSRAM_TILEMAP_SIZE && tilemap->length <= PSRAM_TILEMAP_SIZE - tilemap->offset) 
+            {
+                uint32_t addr = PSRAM_TILEMAP_BASE + tilemap->offset;
+
+                upload_payload(header, data + sizeof(LoadTilemapData), available, tilemap->length, psram_write_at, &addr, &stats);
+            }
+            else 
+            {
+                drain_payload(header, data + sizeof(LoadTilemapData), available);
+            }
+
+            send_upload_response(header, &stats);
+            break;
+        }
+        
+        case CMD_STATUS: 
+        {
+            GpuStatus status = gpu_get_status();
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, &status, sizeof(status));
+            }
+            
+            break;
+        }
+
+        case CMD_GET_PERF: 
+        {
+            PerfReport report;
+            perf_get_report(&report);
+            report.queue_rejected[0] = lanes->priority.rejected;
+            report.queue_rejected[1] = lanes->normal.rejected;
+
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, &report, sizeof(report));
+            }
+
+            break;
+        }
+
+        case CMD_GET_PSRAM_DIAG: 
+        {
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, psram_test_results(), sizeof(PsramDiagnostics));
+            }
+
+            break;
+        }
+
+        case CMD_GET_TRACE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(GetTraceData)) break;
+            GetTraceData* request = (GetTraceData*)data;
+
+            if (request->flags & TRACE_REQUEST_STDIO) 
+            {
+                trace_dump();
+
+                if (cmd_needs_response(header)) 
+                {
+                    transfer_send_ack(transfer, true);
+                }
+
+                break;
+            }
+
+            static TraceChunk chunk;
+            uint32_t first;
+            chunk.cpu_hz = clock_get_hz(clk_sys);
+            chunk.head = trace_head;
+            chunk.count = trace_read(request->from, chunk.events, TRACE_CHUNK_EVENTS, &first);
+            chunk.first = first;
+
+            if (cmd_needs_response(header)) 
+            {
+                size_t unused = (TRACE_CHUNK_EVENTS - chunk.count) * sizeof(TraceEvent);
+                transfer_send_response(transfer, &chunk, sizeof(chunk) - unused);
+            }
+
+            break;
+        }
+
+        case CMD_CAPTURE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(CaptureData)) break;
+            CaptureData* capture = (CaptureData*)data;
+            bool success = true;
+
+            switch (capture->action) 
+            {
+                case CAPTURE_ACTION_STOP:
+                    capture_stop();
+                    break;
+                case CAPTURE_ACTION_START:
+                    success = capture_start();
+                    break;
+                case CAPTURE_ACTION_REPLAY:
+                case CAPTURE_ACTION_REPLAY_MAX:
+                    success = capture_replay(capture->action == CAPTURE_ACTION_REPLAY_MAX);
+                    break;
+                case CAPTURE_ACTION_STATUS:
+                {
+                    CaptureStatus status = capture_get_status();
+                    if (cmd_needs_response(header)) 
+                    {
+                        transfer_send_response(transfer, &status, sizeof(status));
+                    }
+                    break;
+                }
+                default:
+                    success = false;
+                    break;
+            }
+
+            if (capture->action != CAPTURE_ACTION_STATUS && cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_READ_CAPTURE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(ReadCaptureData)) break;
+            ReadCaptureData* read = (ReadCaptureData*)data;
+
+            static CaptureChunk chunk;
+            chunk.offset = read->offset;
+            chunk.count = capture_read(read->offset, chunk.data, read->length < sizeof(chunk.data) ? read->length : sizeof(chunk.data));
+
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, &chunk, sizeof(chunk) - sizeof(chunk.data) + chunk.count);
+            }
+
+            break;
+        }
+
+        case CMD_GET_COLLISIONS: 
+        {
+            CollisionReport report;
+            sprite_engine_get_collisions(&report);
+
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, &report, sizeof(report));
+            }
+
+            break;
+        }
+
+        case CMD_SET_COLLISION_MODE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(SetCollisionModeData)) break;
+            SetCollisionModeData* modeData = (SetCollisionModeData*)data;
+
+            bool success = modeData->mode <= COLLISION_MODE_PIXEL;
+            if (success) 
+            {
+                sprite_engine_set_collision_mode(modeData->mode);
+            }
+
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_FENCE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(FenceData)) break;
+            FenceData* fence = (FenceData*)data;
+
+            if (!cmd_needs_response(header)) 
+            {
+                break;
+            }
+
+            if (pending_fence_count >= MAX_PENDING_FENCES) 
+            {
+                gpu_set_error(GPU_ERROR_MEMORY_FULL);
+                break;
+            }
+
+            pending_fences[pending_fence_count].fence_id = fence->fence_id;
+            pending_fences[pending_fence_count].frame = current_frame;
+            pending_fence_count++;
+            
+            break;
+        }
+
+        case CMD_SET_SPRITE_GROUP: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(SetSpriteGroupData)) break;
+            SetSpriteGroupData* group = (SetSpriteGroupData*)data;
+            bool success = false;
+
+            if (cmd_len >= sizeof(GpuCommandHeader) + sizeof(SetSpriteGroupData) + (group->count * sizeof(SpriteGroupMember))) 
+            {
+                success = sprite_group_set(group->group, (const SpriteGroupMember*)(data + sizeof(SetSpriteGroupData)), group->count);
+            }
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_MOVE_GROUP: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(MoveGroupData)) break;
+            MoveGroupData* move = (MoveGroupData*)data;
+
+            bool success = sprite_group_move(move->group, move->x, move->y, move->flip);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_LOAD_ANIMATION: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadAnimationData)) break;
+            LoadAnimationData* anim = (LoadAnimationData*)data;
+            bool success = false;
+
+            if (cmd_len >= sizeof(GpuCommandHeader) + sizeof(LoadAnimationData) + (anim->count * sizeof(AnimationStep))) 
+            {
+                success = animation_load(anim->anim, (const AnimationStep*)(data + sizeof(LoadAnimationData)), anim->count, anim->flags);
+            }
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_BIND_ANIMATION: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(BindAnimationData)) break;
+            BindAnimationData* bind = (BindAnimationData*)data;
+
+            bool success = sprite_bind_animation(bind->sprite_num, bind->anim, bind->start_step);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_FILL_RECT: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(FillRectData)) break;
+            FillRectData* fill = (FillRectData*)data;
+
+            BlitOp op = {
+                .op = BLIT_OP_FILL,
+                .x = fill->x,
+                .y = fill->y,
+                .width = fill->width,
+                .height = fill->height,
+                .color = __builtin_bswap16(fill->color)
+            };
+            bool success = blitter_queue(&op);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_COPY_RECT: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(CopyRectData)) break;
+            CopyRectData* copy = (CopyRectData*)data;
+
+            BlitOp op = {
+                .op = BLIT_OP_COPY,
+                .x = copy->x,
+                .y = copy->y,
+                .width = copy->width,
+                .height = copy->height,
+                .src_x = copy->src_x,
+                .src_y = copy->src_y
+            };
+            bool success = blitter_queue(&op);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_BLIT_SURFACE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(BlitSurfaceData)) break;
+            BlitSurfaceData* blit = (BlitSurfaceData*)data;
+
+            BlitOp op = {
+                .op = BLIT_OP_SURFACE,
+                .flags = blit->flags,
+                .x = blit->x,
+                .y = blit->y,
+                .width = blit->width,
+                .height = blit->height,
+                .src_addr = blit->src_addr,
+                .src_stride = blit->src_stride,
+                .color = __builtin_bswap16(blit->color_key)
+            };
+            bool success = blitter_queue(&op);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_LOAD_FONT: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(LoadFontData)) break;
+            LoadFontData* font = (LoadFontData*)data;
+            uint32_t size = text_font_size(font->bpp, font->height, font->glyph_count);
+            size_t available = cmd_len - sizeof(GpuCommandHeader) - sizeof(LoadFontData);
+            UploadStats stats = { 0 };
+
+            if (size && size <= PSRAM_FONT_SIZE) 
+            {
+                uint32_t addr = PSRAM_FONT_BASE;
+
+                if (upload_payload(header, data + sizeof(LoadFontData), available, size, psram_write_at, &addr, &stats)) 
+                {
+                    stats.success = text_font_set(font->bpp, font->height, font->glyph_count);
+                }
+            }
+            else 
+            {
+                drain_payload(header, data + sizeof(LoadFontData), available);
+            }
+
+            send_upload_response(header, &stats);
+            break;
+        }
+
+        case CMD_WRITE_TEXT: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(WriteTextData)) break;
+            WriteTextData* text = (WriteTextData*)data;
+            bool success = false;
+
+            if (cmd_len >= sizeof(GpuCommandHeader) + sizeof(WriteTextData) + text->length) 
+            {
+                success = text_write(text->column, text->row, text->palette, data + sizeof(WriteTextData), text->length);
+            }
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_CLEAR_TEXT: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(ClearTextData)) break;
+            ClearTextData* clear = (ClearTextData*)data;
+
+            bool success = text_clear_rows(clear->first_row, clear->row_count);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_CREATE_SURFACE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(CreateSurfaceData)) break;
+            CreateSurfaceData* create = (CreateSurfaceData*)data;
+            SurfaceInfo info = { 0 };
+
+            if (surface_create(create->surface, create->width, create->height)) 
+            {
+                const Surface* surface = surface_get(create->surface);
+                info.success = 1;
+                info.addr = surface->addr;
+                info.stride = surface->stride;
+            }
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_response(transfer, &info, sizeof(info));
+            }
+
+            break;
+        }
+
+        case CMD_CAPTURE_SURFACE: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(CaptureSurfaceData)) break;
+            CaptureSurfaceData* capture = (CaptureSurfaceData*)data;
+
+            bool success = surface_capture_next_frame(capture->surface, capture->x, capture->y);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_SET_BACKGROUND: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(SetBackgroundData)) break;
+            SetBackgroundData* background = (SetBackgroundData*)data;
+
+            bool success = surface_set_background(background->surface, background->scroll_x, background->scroll_y);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_SET_PACING: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(SetPacingData)) break;
+            SetPacingData* pacing = (SetPacingData*)data;
+
+            bool success = display_set_pacing(pacing->mode);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_BEGIN_LIST: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(BeginListData)) break;
+            BeginListData* list = (BeginListData*)data;
+
+            bool success = display_list_begin(list->list_num, list->capacity);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_END_LIST: 
+        {
+            bool success = display_list_end();
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_CALL_LIST: 
+        {
+            if (cmd_len < sizeof(GpuCommandHeader) + sizeof(CallListData)) break;
+            CallListData* list = (CallListData*)data;
+
+            bool success = display_list_call(list->list_num, list->x, list->y, cmd_execute);
+            
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, success);
+            }
+
+            break;
+        }
+
+        case CMD_RESET:
+            display_list_cancel();
+            sprite_engine_reset();
+            text_layer_clear();
+
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, true);
+            }
+            break;
+
+        default:
+            if (cmd_needs_response(header)) 
+            {
+                transfer_send_ack(transfer, false);
+            }
+            break;
+    }
+}
+
+void cmd_exec_retire_fences(uint32_t scanned_out_frame) 
+{
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0; i < pending_fence_count; i++) 
+    {
+        if (!cmd_frame_reached(pending_fences[i].frame, scanned_out_frame)) 
+        {
+            pending_fences[kept++] = pending_fences[i];
+            continue;
+        }
+
+        FenceAck ack = {
+            .fence_id = pending_fences[i].fence_id,
+            .frame = pending_fences[i].frame
+        };
+        transfer_send_response(transfer, &ack, sizeof(ack));
+    }
+
+    pending_fence_count = kept;
+}
+
+typedef struct {
+    RleWriteFn write;
+    void* ctx;
+    uint32_t offset;
+} RawStream;
+
+static bool raw_stream_sink(void* ctx, const uint8_t* data, size_t len) 
+{
+    RawStream* raw = (RawStream*)ctx;
+    bool result = raw->write(raw->ctx, raw->offset, data, len);
+    raw->offset += len;
+    return result;
+}
+
+static bool rle_stream_sink(void* ctx, const uint8_t* data, size_t len) 
+{
+    return rle_feed((RleDecoder*)ctx, data, len);
+}
+
+static bool psram_write_at(void* ctx, uint32_t offset, const uint8_t* data, size_t len) 
+{
+    return aps6404_write(&psram, *(uint32_t*)ctx + offset, data, len);
+}
+
+static bool sram_write_at(void* ctx, uint32_t offset, const uint8_t* data, size_t len) 
+{
+    memcpy((uint8_t*)ctx + offset, data, len);
+    return true;
+}
+
+// delivers a command payload of size bytes to write, whether it sits in the
+// command buffer or is still on the bus, raw or compressed
+static bool upload_payload(const GpuCommandHeader* header, const uint8_t* payload, size_t available, 
+                           uint32_t size, RleWriteFn write, void* ctx, UploadStats* stats) 
+{
+    static RleDecoder decoder;
+
+    uint32_t start = time_us_32();
+    bool success = false;
+
+    if (!cmd_is_compressed(header)) 
+    {
+        stats->bus_bytes = size;
+
+        if (cmd_is_streamed(header)) 
+        {
+            const StreamPayload* stream = (const StreamPayload*)payload;
+
+            if (available >= sizeof(StreamPayload) && stream->length == size) 
+            {
+                RawStream raw = {
+                    .write = write,
+                    .ctx = ctx,
+                    .offset = 0
+                };
+                success = transfer_stream(transfer, size, raw_stream_sink, &raw);
+            }
+            else 
+            {
+                drain_payload(header, payload, available);
+            }
+        }
+        else if (available >= size) 
+        {
+            success = write(ctx, 0, payload, size);
+        }
+    }
+    else if (available >= sizeof(CompressedPayload)) 
+    {
+        const CompressedPayload* compressed = (const CompressedPayload*)payload;
+        stats->bus_bytes = compressed->length;
+
+        rle_begin(&decoder, size, write, ctx);
+
+        if (cmd_is_streamed(header)) 
+        {
+            success = transfer_stream(transfer, compressed->length, rle_stream_sink, &decoder);
+        }
+        else if (available >= sizeof(CompressedPayload) + compressed->length) 
+        {
+            success = rle_feed(&decoder, payload + sizeof(CompressedPayload), compressed->length);
+        }
+
+        success = success && rle_finish(&decoder);
+    }
+    else 
+    {
+        drain_payload(header, payload, available);
+    }
+
+    stats->success = success;
+    stats->output_bytes = success ? size : 0;
+    stats->time_us = time_us_32() - start;
+    return success;
+}
+
+// a streamed payload is on the bus whether or not its command is taken, so
+// a rejected one is pulled off and dropped before it can be read as commands.
+// one whose length can't be read leaves the bus resynced and the host told.
+static void drain_payload(const GpuCommandHeader* header, const uint8_t* payload, size_t available) 
+{
+    if (!cmd_is_streamed(header)) 
+        return;
+
+    if (cmd_is_compressed(header) && available >= sizeof(CompressedPayload)) 
+    {
+        transfer_discard(transfer, ((const CompressedPayload*)payload)->length);
+    }
+    else if (!cmd_is_compressed(header) && available >= sizeof(StreamPayload)) 
+    {
+        transfer_discard(transfer, ((const StreamPayload*)payload)->length);
+    }
+    else 
+    {
+        transfer_resync(transfer);
+    }
+}
+
+// the part of an upload command that comes before its payload, 0 for
+// commands that don't take one
+static size_t upload_data_size(uint8_t cmd) 
+{
+    switch (cmd) 
+    {
+        case CMD_LOAD_PATTERN: return sizeof(LoadPatternData);
+        case CMD_LOAD_PALETTE: return sizeof(LoadPaletteData);
+        case CMD_LOAD_TILEMAP: return sizeof(LoadTilemapData);
+        case CMD_LOAD_FONT:    return sizeof(LoadFontData);
+        default:               return 0;
+    }
+}
+
+// for a command turned away before its own case ran, data being everything
+// after the header
+static void drain_rejected(const GpuCommandHeader* header, const uint8_t* data, size_t len) 
+{
+    size_t skip = upload_data_size(header->cmd);
+
+    if (!skip) 
+        return;
+
+    if (cmd_has_target_frame(header)) 
+        skip += sizeof(uint32_t);
+
+    drain_payload(header, len >= skip ? data + skip : data, len >= skip ? len - skip : 0);
+}
+
+// compressed uploads report their ratio and timing, the rest just ack
+static void send_upload_response(const GpuCommandHeader* header, const UploadStats* stats) 
+{
+    if (!cmd_needs_response(header)) 
+        return;
+
+    if (cmd_is_compressed(header)) 
+    {
+        transfer_send_response(transfer, stats, sizeof(*stats));
+    }
+    else 
+    {
+        transfer_send_ack(transfer, stats->success);
+    }
+}
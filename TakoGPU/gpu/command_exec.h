@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "command_queue.h"
+#include "gpu_protocol.h"
+
+// Command execution. Commands popped off the lanes are applied to the
+// engine here and answered over the transfer. The frame loop drains the
+// lanes once a frame and retires fences once their frame is on screen.
+// The host build runs the same code over a stubbed transfer to replay
+// captures.
+
+// bytes of normal lane commands applied per frame, so a backlog of bulk
+// uploads is spread over several frames instead of stalling one. a lane
+// never holds more than CMD_DATA_BUFFER_SIZE, a budget past that never binds
+#define CMD_BULK_BYTES_PER_FRAME (CMD_DATA_BUFFER_SIZE / 2)
+
+// fences retire once the frame they were processed in has been scanned out
+#define MAX_PENDING_FENCES 16
+
+void cmd_exec_init(CommandLanes* lanes, TransferState* transfer);
+
+void cmd_exec_drain(uint32_t frame);
+void cmd_execute(const uint8_t* cmd_data, size_t cmd_len);
+void cmd_exec_retire_fences(uint32_t scanned_out_frame);
@@ -1,5 +1,8 @@
 #include "command_queue.h"
 #include "hardware/sync.h"
+#include "pico/time.h"
+#include "trace.h"
+#include "capture.h"
 #include <string.h>
 
 void cmd_queue_init(CommandQueue* queue) 
@@ -9,6 +12,8 @@ void cmd_queue_init(CommandQueue* queue)
     queue->buffer_write_pos = 0;
     queue->processing = false;
     queue->error_code = 0;
+    queue->max_latency_us = 0;
+    queue->rejected = 0;
 
     queue->lock = spin_lock_init(spin_lock_claim_unused(true));
 }
@@ -34,6 +39,8 @@ bool cmd_queue_push(CommandQueue* queue, const void* cmd_data, uint16_t cmd_len,
     
     // is queue is full
     if (queue_next_idx(queue->write_idx) == queue->read_idx) {
+        queue->rejected++;
+        trace_event(TRACE_QUEUE_FULL, ((const uint8_t*)cmd_data)[0], 0);
         spin_unlock(queue->lock, save);
         return false;
     }
@@ -51,6 +58,8 @@ bool cmd_queue_push(CommandQueue* queue, const void* cmd_data, uint16_t cmd_len,
         else 
         {
             // queue is effectively full
+            queue->rejected++;
+            trace_event(TRACE_QUEUE_FULL, ((const uint8_t*)cmd_data)[0], 0);
             spin_unlock(queue->lock, save);
             return false;
         }
@@ -65,6 +74,14 @@ bool cmd_queue_push(CommandQueue* queue, const void* cmd_data, uint16_t cmd_len,
     cmd->data_length = cmd_len;
     cmd->needs_response = needs_response;
     cmd->response_length = response_len;
+    cmd->has_target = cmd_has_target_frame(&cmd->header) && cmd_len >= sizeof(GpuCommandHeader) + sizeof(uint32_t);
+    cmd->target_frame = 0;
+    cmd->queued_at = time_us_32();
+
+    if (cmd->has_target) 
+    {
+        memcpy(&cmd->target_frame, (const uint8_t*)cmd_data + sizeof(GpuCommandHeader), sizeof(uint32_t));
+    }
     
     queue->buffer_write_pos += cmd_len;
     queue->write_idx = queue_next_idx(queue->write_idx);
@@ -90,6 +107,12 @@ bool cmd_queue_pop(CommandQueue* queue, void* cmd_buffer, uint16_t* cmd_len, boo
     *cmd_len = cmd->data_length;
     *needs_response = cmd->needs_response;
     *response_len = cmd->response_length;
+
+    uint32_t latency = time_us_32() - cmd->queued_at;
+    if (latency > queue->max_latency_us) 
+    {
+        queue->max_latency_us = latency;
+    }
     
     // update read index
     queue->read_idx = queue_next_idx(queue->read_idx);
@@ -119,6 +142,19 @@ bool cmd_queue_has_command(CommandQueue* queue)
     return !cmd_queue_is_empty(queue);
 }
 
+// commands are applied in order, so a head command waiting for a later
+// frame holds back everything queued behind it. untargeted commands are
+// always due, whatever the frame counter has wrapped to
+bool cmd_queue_has_command_for_frame(CommandQueue* queue, uint32_t frame) 
+{
+    uint32_t save = spin_lock_blocking(queue->lock);
+    const QueuedCommand* head = &queue->commands[queue->read_idx];
+    bool ready = queue->read_idx != queue->write_idx &&
+                 (!head->has_target || cmd_frame_reached(head->target_frame, frame));
+    spin_unlock(queue->lock, save);
+    return ready;
+}
+
 uint8_t cmd_queue_get_count(CommandQueue* queue) 
 {
     uint32_t save = spin_lock_blocking(queue->lock);
@@ -135,4 +171,44 @@ uint8_t cmd_queue_get_error(CommandQueue* queue)
 void cmd_queue_clear_error(CommandQueue* queue) 
 {
     queue->error_code = 0;
-}
\ No newline at end of file
+}
+
+void cmd_lanes_init(CommandLanes* lanes) 
+{
+    cmd_queue_init(&lanes->priority);
+    cmd_queue_init(&lanes->normal);
+}
+
+bool cmd_lanes_push(CommandLanes* lanes, const void* cmd_data, uint16_t cmd_len, bool needs_response, uint16_t response_len) 
+{
+    if (!cmd_data || cmd_len < sizeof(GpuCommandHeader)) 
+    {
+        return false;
+    }
+
+    const GpuCommandHeader* header = (const GpuCommandHeader*)cmd_data;
+    CommandQueue* lane = (cmd_is_high_priority(header) || cmd_is_priority_type(header->cmd)) ? &lanes->priority : &lanes->normal;
+    
+    if (!cmd_queue_push(lane, cmd_data, cmd_len, needs_response, response_len)) 
+        return false;
+
+    capture_record(cmd_data, cmd_len);
+    return true;
+}
+
+bool cmd_lanes_pop(CommandLanes* lanes, uint32_t frame, bool allow_normal, void* cmd_buffer, uint16_t* cmd_len, bool* needs_response, uint16_t* response_len, bool* was_priority) 
+{
+    if (cmd_queue_has_command_for_frame(&lanes->priority, frame)) 
+    {
+        *was_priority = true;
+        return cmd_queue_pop(&lanes->priority, cmd_buffer, cmd_len, needs_response, response_len);
+    }
+
+    if (allow_normal && cmd_queue_has_command_for_frame(&lanes->normal, frame)) 
+    {
+        *was_priority = false;
+        return cmd_queue_pop(&lanes->normal, cmd_buffer, cmd_len, needs_response, response_len);
+    }
+
+    return false;
+}
@@ -14,6 +14,9 @@ typedef struct {
     uint16_t data_length; // length of command data
     bool needs_response; 
     uint16_t response_length;
+    bool has_target;       // CMD_FLAG_TARGET_FRAME was set
+    uint32_t target_frame; // only meaningful with has_target
+    uint32_t queued_at;    // time_us_32() at push
 } QueuedCommand;
 
 // Command queue structure
@@ -31,8 +34,19 @@ typedef struct {
     
     volatile bool processing;
     volatile uint8_t error_code;
+
+    uint32_t max_latency_us; // longest push to pop wait seen
+    uint32_t rejected;       // pushes refused because the queue was full
 } CommandQueue;
 
+// Priority commands (CMD_FLAG_HIGH_PRIORITY, status, reset) get their own
+// lane which is always drained before the normal one. Commands stay in
+// order within a lane, so a fence only covers commands sent on its lane.
+typedef struct {
+    CommandQueue priority;
+    CommandQueue normal;
+} CommandLanes;
+
 void cmd_queue_init(CommandQueue* queue);
 
 bool cmd_queue_push(CommandQueue* queue, const void* cmd_data, uint16_t cmd_len, bool needs_response, uint16_t response_len);
@@ -42,7 +56,12 @@ bool cmd_queue_pop(CommandQueue* queue, void* cmd_buffer, uint16_t* cmd_len, boo
 bool cmd_queue_is_full(CommandQueue* queue);
 bool cmd_queue_is_empty(CommandQueue* queue);
 bool cmd_queue_has_command(CommandQueue* queue);
+bool cmd_queue_has_command_for_frame(CommandQueue* queue, uint32_t frame);
 uint8_t cmd_queue_get_count(CommandQueue* queue);
 
 uint8_t cmd_queue_get_error(CommandQueue* queue);
-void cmd_queue_clear_error(CommandQueue* queue);
\ No newline at end of file
+void cmd_queue_clear_error(CommandQueue* queue);
+
+void cmd_lanes_init(CommandLanes* lanes);
+bool cmd_lanes_push(CommandLanes* lanes, const void* cmd_data, uint16_t cmd_len, bool needs_response, uint16_t response_len);
+bool cmd_lanes_pop(CommandLanes* lanes, uint32_t frame, bool allow_normal, void* cmd_buffer, uint16_t* cmd_len, bool* needs_response, uint16_t* response_len, bool* was_priority);
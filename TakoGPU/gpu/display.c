@@ -2,8 +2,12 @@
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include <string.h>
 #include "display_spi.pio.h"
+#include "trace.h"
+#include "perf.h"
 #include "../pins.h"
 #include <stdlib.h>
 #include "pico/stdlib.h"
@@ -16,9 +20,42 @@ static uint16_t* frame_buffers[2];
 static int current_buffer = 0;
 static bool initialized = false;
 
+static volatile bool frame_queued;
+static volatile int scanout_buffer;
+
+static uint8_t pacing = DISPLAY_PACING_60;
+static volatile uint32_t te_pulses;
+static volatile uint32_t last_te_us;
+static uint32_t te_at_last_scanout;
+
+// scanout start times, for frame time and jitter
+static uint32_t last_scanout_us;
+static uint32_t last_frame_time_us;
+static volatile DisplayTiming timing;
+
+static void te_irq(uint gpio, uint32_t events);
+
+// panel bring-up, each step waits out its delay without blocking
+#define DISPLAY_BOOT_IDLE   0 // display_init not called yet
+#define DISPLAY_BOOT_RESET  1 // reset held low
+#define DISPLAY_BOOT_WAKE   2 // out of reset, waiting to leave sleep
+#define DISPLAY_BOOT_SETUP  3 // waiting on sleep out before configuring
+#define DISPLAY_BOOT_DONE   4
+
+static uint8_t boot_step;
+static uint32_t boot_wait_start;
+static uint32_t boot_wait_us;
+
+static void boot_wait(uint8_t next_step, uint32_t wait_us) 
+{
+    boot_step = next_step;
+    boot_wait_start = time_us_32();
+    boot_wait_us = wait_us;
+}
+
 bool display_init(PIO pio, uint sm) 
 {
-    if (initialized)
+    if (initialized || boot_step)
         return false;
     
     display_pio = pio;
@@ -61,19 +98,47 @@ bool display_init(PIO pio, uint sm)
         return false;
     }
     
-    // Hardware reset
+    // start the hardware reset, display_poll_init brings the panel up from here
     gpio_put(PIN_DISP_RST, 0);
-    sleep_ms(100);
-    gpio_put(PIN_DISP_RST, 1);
-    sleep_ms(100);
-    
-    // Initialize display
-    display_write_cmd(DISP_CMD_SWRESET);
-    sleep_ms(150);
-    
-    display_write_cmd(DISP_CMD_SLPOUT); // no sleep
-    sleep_ms(500);
+    boot_wait(DISPLAY_BOOT_RESET, 1000);
+
+    frame_in_progress = false;
+    frame_queued = false;
     
+    return true;
+}
+
+// The ST7789 needs 120 ms after a hardware reset and another 120 ms after
+// sleep out before it's settled. Called from the boot loop until it returns
+// true, so commands keep being taken while the panel waits. A software reset
+// straight after the hardware one is redundant and is skipped.
+bool display_poll_init(void) 
+{
+    if (initialized) 
+        return true;
+
+    if (boot_step == DISPLAY_BOOT_IDLE) 
+        return false;
+
+    if (time_us_32() - boot_wait_start < boot_wait_us) 
+        return false;
+
+    switch (boot_step) 
+    {
+        case DISPLAY_BOOT_RESET:
+            gpio_put(PIN_DISP_RST, 1);
+            boot_wait(DISPLAY_BOOT_WAKE, 120000);
+            return false;
+
+        case DISPLAY_BOOT_WAKE:
+            display_write_cmd(DISP_CMD_SLPOUT); // no sleep
+            boot_wait(DISPLAY_BOOT_SETUP, 120000);
+            return false;
+
+        default:
+            break;
+    }
+
     display_write_cmd(DISP_CMD_COLMOD); // color mode
     display_write_data(0x55); // 16 bit color
     
@@ -85,13 +150,20 @@ bool display_init(PIO pio, uint sm)
     display_write_cmd(DISP_CMD_NORON); // normal display mode on
     
     display_write_cmd(DISP_CMD_DISPON); // screen turn on
-    sleep_ms(50);
+    
+    display_write_cmd(DISP_CMD_TEON); // tearing effect output, vblank only
+    display_write_data(0x00);
     
     gpio_put(PIN_DISP_BL, 1); // backlight on
     
+    boot_step = DISPLAY_BOOT_DONE;
     initialized = true;
-    frame_in_progress = false;
-    
+
+    gpio_init(PIN_DISP_TE);
+    gpio_set_dir(PIN_DISP_TE, GPIO_IN);
+    gpio_set_irq_enabled_with_callback(PIN_DISP_TE, GPIO_IRQ_EDGE_RISE, true, &te_irq);
+
+    perf_mark_boot(PERF_BOOT_DISPLAY_READY);
     return true;
 }
 
@@ -148,33 +220,147 @@ void display_start_pixels(void)
     gpio_put(PIN_DISP_CS, 0);
 }
 
-void display_swap_buffers(void) 
+bool display_set_pacing(uint8_t mode) 
+{
+    if (mode > DISPLAY_PACING_30) 
+        return false;
+
+    pacing = mode;
+    return true;
+}
+
+uint8_t display_get_pacing(void) 
+{
+    return pacing;
+}
+
+DisplayTiming display_take_timing(void) 
+{
+    uint32_t iStatus = save_and_disable_interrupts();
+    DisplayTiming taken = timing;
+    memset((void*)&timing, 0, sizeof(timing));
+    restore_interrupts(iStatus);
+
+    if (taken.frames) 
+        taken.frame_time_us /= taken.frames;
+
+    return taken;
+}
+
+static bool te_lost(void) 
+{
+    return (time_us_32() - last_te_us) > DISPLAY_TE_TIMEOUT_US;
+}
+
+static void record_scanout(void) 
+{
+    uint32_t now = time_us_32();
+    uint32_t frame_time = now - last_scanout_us;
+
+    if (last_scanout_us) 
+    {
+        uint32_t jitter = frame_time > last_frame_time_us ? frame_time - last_frame_time_us : last_frame_time_us - frame_time;
+        if (jitter > timing.jitter_us) 
+            timing.jitter_us = jitter;
+
+        timing.frame_time_us += frame_time;
+        timing.frames++;
+    }
+
+    last_frame_time_us = frame_time;
+    last_scanout_us = now;
+}
+
+// Thread context only. Sends the window and RAMWR and leaves the panel
+// selected waiting for pixels, with the dma channel armed on the frame, so
+// starting the scanout later is just the dma trigger. The panel can't be
+// written to again until the frame completes.
+static void prepare_scanout(void) 
 {
-    if (frame_in_progress) return;
-    
-    frame_in_progress = true;
-    
     display_set_window(0, 0, DISPLAY_WIDTH-1, DISPLAY_HEIGHT-1);
     display_start_pixels();
 
+    // frame buffers hold pixels in display byte order, and the spi program
+    // shifts out one byte per pull, so stream them as plain bytes
     dma_channel_config config = dma_channel_get_default_config(dma_chan);
-    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
     channel_config_set_read_increment(&config, true);
     channel_config_set_write_increment(&config, false);
     channel_config_set_dreq(&config, pio_get_dreq(display_pio, display_sm, true));
     
-    dma_channel_configure(dma_chan, &config, &display_pio->txf[display_sm], frame_buffers[current_buffer], DISPLAY_WIDTH * DISPLAY_HEIGHT, true);
+    dma_channel_configure(dma_chan, &config, &display_pio->txf[display_sm], frame_buffers[scanout_buffer], DISPLAY_WIDTH * DISPLAY_HEIGHT * 2, false);
+}
 
+// runs from the TE interrupt or the main loop, never both at once, after
+// prepare_scanout. nothing here touches the panel's pins.
+static void start_scanout(void) 
+{
+    frame_queued = false;
+    frame_in_progress = true;
+    te_at_last_scanout = te_pulses;
+    record_scanout();
+    perf_mark_boot(PERF_BOOT_FIRST_PIXEL);
+
+    dma_channel_start(dma_chan);
+    trace_event(TRACE_DMA_START, TRACE_DMA_SCANOUT, (DISPLAY_WIDTH * DISPLAY_HEIGHT * 2) / 1024);
+}
+
+static void te_irq(uint gpio, uint32_t events) 
+{
+    if (gpio != PIN_DISP_TE) 
+        return;
+
+    te_pulses++;
+    timing.te_pulses++;
+    last_te_us = time_us_32();
+
+    uint32_t interval = pacing == DISPLAY_PACING_30 ? 2 : 1;
+    if (frame_queued && te_pulses - te_at_last_scanout >= interval) 
+    {
+        start_scanout();
+    }
+}
+
+void display_swap_buffers(void) 
+{
+    if (!initialized || frame_in_progress || frame_queued) return;
+
+    scanout_buffer = current_buffer;
     current_buffer = !current_buffer;
+    prepare_scanout();
+
+    if (pacing == DISPLAY_PACING_FREE || te_lost()) 
+    {
+        start_scanout();
+        return;
+    }
+
+    frame_queued = true;
 }
 
 void display_wait_for_frame_complete(void) 
 {
+    // a queued frame has to be started by a TE pulse before it can finish
+    while (frame_queued) 
+    {
+        if (te_lost()) 
+        {
+            uint32_t iStatus = save_and_disable_interrupts();
+            if (frame_queued) 
+                start_scanout();
+            restore_interrupts(iStatus);
+            break;
+        }
+
+        tight_loop_contents();
+    }
+
     if (!frame_in_progress)
         return;
     
     dma_channel_wait_for_finish_blocking(dma_chan);
     gpio_put(PIN_DISP_CS, 1);
+    trace_event(TRACE_DMA_END, TRACE_DMA_SCANOUT, 0);
     frame_in_progress = false;
 }
 
@@ -2,9 +2,7 @@
 
 #include <stdint.h>
 #include "hardware/pio.h"
-
-#define DISPLAY_WIDTH    320
-#define DISPLAY_HEIGHT   240
+#include "gpu_config.h"
 
 // 0=0deg, 1=90deg, 2=180deg, 3=270deg
 #define DISPLAY_ROTATION 0      
@@ -25,11 +23,39 @@
 #define DISP_CMD_RASET       0x2B
 #define DISP_CMD_RAMWR       0x2C
 #define DISP_CMD_RAMRD       0x2E
+#define DISP_CMD_TEON        0x35
 #define DISP_CMD_MADCTL      0x36
 #define DISP_CMD_COLMOD      0x3A
 #define DISP_CMD_PIXSET      0x3A
 
+// Frame pacing. In the TE modes display_swap_buffers only queues the frame
+// and the panel's tearing effect pulse starts its scanout, so the copy
+// starts right after the panel's vertical blank. Only one frame can be
+// queued, so rendering never gets more than a frame ahead of the panel.
+#define DISPLAY_PACING_FREE  0 // scan out as soon as a frame is ready
+#define DISPLAY_PACING_60    1 // every TE pulse
+#define DISPLAY_PACING_30    2 // every second TE pulse
+
+// without a TE pulse for this long the panel is treated as having no TE
+// line and frames go out unpaced
+#define DISPLAY_TE_TIMEOUT_US 50000
+
+typedef struct {
+    uint32_t frames;        // scanouts started
+    uint32_t frame_time_us; // average time between scanout starts
+    uint32_t jitter_us;     // largest change between consecutive frame times
+    uint32_t te_pulses;
+} DisplayTiming;
+
+// display_init starts the panel's reset and returns straight away,
+// display_poll_init finishes bring-up and returns true once it's done
 bool display_init(PIO pio, uint sm);
+bool display_poll_init(void);
+bool display_set_pacing(uint8_t mode);
+uint8_t display_get_pacing(void);
+DisplayTiming display_take_timing(void);
+// direct panel writes, thread context only and never while a frame is
+// queued or scanning out
 void display_set_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
 void display_write_cmd(uint8_t cmd);
 void display_write_data(uint8_t data);
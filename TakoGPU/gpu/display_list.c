@@ -0,0 +1,201 @@
+#include "display_list.h"
+#include "gpu_protocol.h"
+#include "aps6404.h"
+#include "../externs.h"
+#include <string.h>
+
+// Lists live back to back in the psram display list region, each recorded
+// command stored as a uint16 length followed by the command bytes.
+typedef struct {
+    uint32_t addr;
+    uint16_t capacity;
+    uint16_t length;
+} DisplayList;
+
+static DisplayList lists[MAX_DISPLAY_LISTS];
+static uint32_t list_alloc_pos;
+
+static bool recording;
+static bool record_failed;
+static uint8_t record_list;
+
+static uint8_t list_window[DISPLAY_LIST_WINDOW_SIZE];
+
+void display_list_init(void) 
+{
+    memset(lists, 0, sizeof(lists));
+    list_alloc_pos = PSRAM_DISPLAY_LIST_BASE;
+    recording = false;
+    record_failed = false;
+}
+
+bool display_list_begin(uint8_t list_num, uint16_t capacity) 
+{
+    if (list_num >= MAX_DISPLAY_LISTS || recording) 
+        return false;
+
+    DisplayList* list = &lists[list_num];
+
+    // space is only ever handed out, a list keeps its slot for re-recording
+    if (!list->capacity || capacity > list->capacity) 
+    {
+        if (list_alloc_pos + capacity > PSRAM_DISPLAY_LIST_BASE + PSRAM_DISPLAY_LIST_SIZE) 
+            return false;
+
+        list->addr = list_alloc_pos;
+        list->capacity = capacity;
+        list_alloc_pos += capacity;
+    }
+
+    list->length = 0;
+    record_list = list_num;
+    record_failed = false;
+    recording = true;
+    
+    return true;
+}
+
+bool display_list_record(const uint8_t* cmd_data, size_t cmd_len) 
+{
+    DisplayList* list = &lists[record_list];
+
+    if (cmd_len < sizeof(GpuCommandHeader) || cmd_len > DISPLAY_LIST_MAX_COMMAND ||
+        list->length + sizeof(uint16_t) + cmd_len > list->capacity) 
+    {
+        record_failed = true;
+        return false;
+    }
+
+    const GpuCommandHeader* header = (const GpuCommandHeader*)cmd_data;
+
+    // lists can't nest, and streamed payloads aren't in the command
+    if (header->cmd == CMD_BEGIN_LIST || header->cmd == CMD_CALL_LIST || cmd_is_streamed(header)) 
+    {
+        record_failed = true;
+        return false;
+    }
+
+    uint8_t record[DISPLAY_LIST_WINDOW_SIZE];
+    uint16_t len = (uint16_t)cmd_len;
+    memcpy(record, &len, sizeof(len));
+    memcpy(record + sizeof(len), cmd_data, cmd_len);
+
+    // replayed commands never answer the host
+    ((GpuCommandHeader*)(record + sizeof(len)))->flags &= ~CMD_FLAG_NEEDS_RESPONSE;
+
+    if (!aps6404_write(&psram, list->addr + list->length, record, sizeof(len) + cmd_len)) 
+    {
+        record_failed = true;
+        return false;
+    }
+
+    list->length += sizeof(len) + cmd_len;
+    return true;
+}
+
+bool display_list_end(void) 
+{
+    if (!recording) 
+        return false;
+
+    recording = false;
+
+    // a partly recorded list would replay the wrong thing, drop it
+    if (record_failed) 
+    {
+        lists[record_list].length = 0;
+        return false;
+    }
+
+    return true;
+}
+
+// drops the list being recorded, as if it had failed
+void display_list_cancel(void) 
+{
+    if (!recording) 
+        return;
+
+    recording = false;
+    lists[record_list].length = 0;
+}
+
+bool display_list_recording(void) 
+{
+    return recording;
+}
+
+static void patch_command(uint8_t* cmd_data, size_t cmd_len, int16_t x, int16_t y) 
+{
+    const GpuCommandHeader* header = (const GpuCommandHeader*)cmd_data;
+    size_t offset = sizeof(GpuCommandHeader);
+
+    if (cmd_has_target_frame(header)) 
+        offset += sizeof(uint32_t);
+
+    if (header->cmd == CMD_UPDATE_SPRITE && cmd_len >= offset + sizeof(UpdateSpriteData)) 
+    {
+        UpdateSpriteData* sprite = (UpdateSpriteData*)(cmd_data + offset);
+        sprite->x += x;
+        sprite->y += y;
+    }
+    else if (header->cmd == CMD_MOVE_GROUP && cmd_len >= offset + sizeof(MoveGroupData)) 
+    {
+        MoveGroupData* group = (MoveGroupData*)(cmd_data + offset);
+        group->x += x;
+        group->y += y;
+    }
+    else if ((header->cmd == CMD_FILL_RECT || header->cmd == CMD_COPY_RECT || header->cmd == CMD_BLIT_SURFACE) &&
+             cmd_len >= offset + sizeof(FillRectData)) 
+    {
+        // every blit starts with its destination x/y
+        FillRectData* rect = (FillRectData*)(cmd_data + offset);
+        rect->x += x;
+        rect->y += y;
+    }
+}
+
+bool display_list_call(uint8_t list_num, int16_t x, int16_t y, DisplayListExecFn exec) 
+{
+    if (list_num >= MAX_DISPLAY_LISTS || recording) 
+        return false;
+
+    const DisplayList* list = &lists[list_num];
+    uint32_t offset = 0;
+
+    // read a window at a time and run every command that fits entirely
+    // inside it, the next window starts at the first one that didn't
+    while (offset < list->length) 
+    {
+        size_t chunk = list->length - offset;
+        if (chunk > DISPLAY_LIST_WINDOW_SIZE) 
+            chunk = DISPLAY_LIST_WINDOW_SIZE;
+
+        if (!aps6404_read(&psram, list->addr + offset, list_window, chunk)) 
+            return false;
+
+        size_t pos = 0;
+        while (pos + sizeof(uint16_t) <= chunk) 
+        {
+            uint16_t len;
+            memcpy(&len, list_window + pos, sizeof(len));
+            
+            if (pos + sizeof(len) + len > chunk) 
+                break;
+
+            uint8_t* cmd_data = list_window + pos + sizeof(len);
+            patch_command(cmd_data, len, x, y);
+            exec(cmd_data, len);
+
+            pos += sizeof(len) + len;
+        }
+
+        // corrupt length, nothing fits
+        if (!pos) 
+            return false;
+
+        offset += pos;
+    }
+
+    return true;
+}
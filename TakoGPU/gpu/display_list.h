@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_DISPLAY_LISTS        64
+
+// lists are replayed through an sram window, so no recorded command may be
+// bigger than this
+#define DISPLAY_LIST_WINDOW_SIZE 512
+#define DISPLAY_LIST_MAX_COMMAND (DISPLAY_LIST_WINDOW_SIZE - sizeof(uint16_t))
+
+typedef void (*DisplayListExecFn)(const uint8_t* cmd_data, size_t cmd_len);
+
+void display_list_init(void);
+
+bool display_list_begin(uint8_t list_num, uint16_t capacity);
+bool display_list_record(const uint8_t* cmd_data, size_t cmd_len);
+bool display_list_end(void);
+void display_list_cancel(void);
+bool display_list_recording(void);
+
+bool display_list_call(uint8_t list_num, int16_t x, int16_t y, DisplayListExecFn exec);
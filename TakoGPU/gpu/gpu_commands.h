@@ -0,0 +1,44 @@
+#pragma once
+
+// command codes, the first byte of every command (see gpu_protocol.h)
+typedef enum {
+    CMD_NOP             = 0x00,
+    CMD_INIT            = 0x01,
+    CMD_LOAD_PATTERN    = 0x02,
+    CMD_LOAD_PALETTE    = 0x03,
+    CMD_UPDATE_SPRITE   = 0x04,
+    CMD_ENABLE_SPRITE   = 0x05,
+    CMD_DISABLE_SPRITE  = 0x06,
+    CMD_SET_SCROLL      = 0x07,
+    CMD_STATUS          = 0x08,
+    CMD_GET_COLLISIONS  = 0x09,
+    CMD_SET_COLLISION_MODE = 0x0A,
+    CMD_FENCE           = 0x0B,
+    CMD_LOAD_TILEMAP    = 0x0C,
+    CMD_BEGIN_LIST      = 0x0D,
+    CMD_END_LIST        = 0x0E,
+    CMD_CALL_LIST       = 0x0F,
+    CMD_SET_SPRITE_GROUP = 0x10,
+    CMD_MOVE_GROUP      = 0x11,
+    CMD_LOAD_ANIMATION  = 0x12,
+    CMD_BIND_ANIMATION  = 0x13,
+    CMD_FILL_RECT       = 0x14,
+    CMD_COPY_RECT       = 0x15,
+    CMD_BLIT_SURFACE    = 0x16,
+    CMD_LOAD_FONT       = 0x17,
+    CMD_WRITE_TEXT      = 0x18,
+    CMD_CLEAR_TEXT      = 0x19,
+    CMD_CREATE_SURFACE  = 0x1A,
+    CMD_CAPTURE_SURFACE = 0x1B,
+    CMD_SET_BACKGROUND  = 0x1C,
+    CMD_SET_PACING      = 0x1D,
+    CMD_GET_PERF        = 0x1E, // responds with a PerfReport (perf.h)
+    CMD_GET_TRACE       = 0x1F,
+    CMD_CAPTURE         = 0x20,
+    CMD_READ_CAPTURE    = 0x21,
+    CMD_GET_PSRAM_DIAG  = 0x22, // responds with the boot PsramDiagnostics (psram_test.h)
+    CMD_RESET           = 0xFF
+} GpuCommand;
+
+// codes below CMD_RESET, keep in step with the last one above
+#define CMD_CODE_COUNT (CMD_GET_PSRAM_DIAG + 1)
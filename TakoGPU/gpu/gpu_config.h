@@ -0,0 +1,49 @@
+#pragma once
+
+// Compile time configuration of the panel and the sprite engine. Any value
+// can be overridden with a -D on the TakoGPU target; the panel resolution
+// is picked with the TAKO_PANEL cmake option. Table sizes and render loop
+// bounds are all derived from these, so they stay compile time constants.
+
+// panel resolution
+#ifndef DISPLAY_WIDTH
+#define DISPLAY_WIDTH           320
+#endif
+
+#ifndef DISPLAY_HEIGHT
+#define DISPLAY_HEIGHT          240
+#endif
+
+// sprite engine
+#ifndef MAX_SPRITES
+#define MAX_SPRITES             128
+#endif
+
+#ifndef MAX_SPRITES_PER_LINE
+#define MAX_SPRITES_PER_LINE    32
+#endif
+
+#ifndef SPRITE_PALETTES
+#define SPRITE_PALETTES         64
+#endif
+
+// largest pattern size code, 0-3 for 8x8 up to 64x64. psram pattern slots
+// and the compositor's row buffers are sized for it.
+#ifndef SPRITE_MAX_SIZE
+#define SPRITE_MAX_SIZE         3
+#endif
+
+#define SPRITE_MAX_DIMENSION    (8 << SPRITE_MAX_SIZE)
+#define PATTERN_STRIDE          ((SPRITE_MAX_DIMENSION * SPRITE_MAX_DIMENSION) / 2) // 4bpp
+
+// blends and blits move pixels in pairs, one 32-bit word at a time
+_Static_assert((DISPLAY_WIDTH % 2) == 0, "DISPLAY_WIDTH must be even");
+_Static_assert(DISPLAY_WIDTH <= 1024 && DISPLAY_HEIGHT <= 1024, "display too large");
+
+// sprite indices are stored as uint8_t, plus one for the collision owner
+_Static_assert(MAX_SPRITES <= 254 && (MAX_SPRITES % 8) == 0, "MAX_SPRITES must be a multiple of 8 below 255");
+_Static_assert(MAX_SPRITES_PER_LINE <= 255, "MAX_SPRITES_PER_LINE must fit a uint8_t");
+
+// palette banks are 6 bits across attr and ext
+_Static_assert(SPRITE_PALETTES <= 64, "SPRITE_PALETTES must be 64 or less");
+_Static_assert(SPRITE_MAX_SIZE <= 3, "SPRITE_MAX_SIZE must be 0-3");
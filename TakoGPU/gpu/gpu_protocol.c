@@ -1,11 +1,19 @@
 #include "gpu_protocol.h"
+#include "gpu_status.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "pico/time.h"
 #include "gpu_transfer.pio.h"
+#include "gpu_response.pio.h"
 #include "../pins.h"
+#include <string.h>
 
-bool transfer_init(TransferState* state, PIO pio, uint sm) 
+static void response_init(TransferState* state, PIO pio, uint sm_tx);
+
+bool transfer_init(TransferState* state, PIO pio, uint sm_rx, uint sm_tx) 
 {
+    uint sm = sm_rx;
+
     state->pio = pio;
     state->sm = sm;
     state->transfer_active = false;
@@ -36,38 +44,132 @@ bool transfer_init(TransferState* state, PIO pio, uint sm)
     gpio_put(PIN_WAIT, 1);
     
     pio_sm_init(pio, sm, state->offset, &c);
+
+    // the receive side never drives the data bus, see gpu_protocol.h
+    pio_sm_set_consecutive_pindirs(pio, sm, PIN_D0, 8, false);
     pio_sm_set_enabled(pio, sm, true);
+
+    response_init(state, pio, sm_tx);
+
+    state->dma_chan_rx = dma_claim_unused_channel(true);
     
     return true;
 }
 
-bool transfer_send_data(TransferState* state, const void* data, size_t len) 
+static void response_init(TransferState* state, PIO pio, uint sm_tx) 
+{
+    state->sm_tx = sm_tx;
+    state->response_head = 0;
+    state->response_tail = 0;
+    state->response_in_flight = 0;
+    state->response_seq = 0;
+    state->responses_dropped = 0;
+    memset(&state->pending_ack, 0, sizeof(state->pending_ack));
+
+    uint offset = pio_add_program(pio, &gpu_response_program);
+    pio_sm_config c = gpu_response_program_get_default_config(offset);
+
+    sm_config_set_out_pins(&c, PIN_D0, 8);
+    sm_config_set_in_pins(&c, PIN_CS); // pin 0 = CS, pin 1 = RW
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+
+    pio_sm_init(pio, sm_tx, offset, &c);
+    pio_sm_set_enabled(pio, sm_tx, true);
+
+    state->dma_chan_tx = dma_claim_unused_channel(true);
+}
+
+static inline uint16_t response_space(const TransferState* state) 
+{
+    return RESPONSE_RING_SIZE - 1 - ((state->response_head - state->response_tail) & (RESPONSE_RING_SIZE - 1));
+}
+
+static void response_write(TransferState* state, const void* data, size_t len) 
 {
-    if (state->transfer_active) 
-        return false;
-    
-    state->transfer_active = true;
     const uint8_t* bytes = (const uint8_t*)data;
-    
-    gpio_set_dir_out_masked(0xFF << PIN_D0); // data pins as outputs
-    
-    for(size_t i = 0; i < len; i++) 
+
+    for (size_t i = 0; i < len; i++) 
     {
-        pio_sm_set_enabled(state->pio, state->sm, false);
-        pio_sm_clear_fifos(state->pio, state->sm);
-        pio_sm_restart(state->pio, state->sm);
-        pio_sm_exec(state->pio, state->sm, pio_encode_jmp(state->offset + gpu_transfer_offset_send));
-        pio_sm_set_enabled(state->pio, state->sm, true);
-        
-        pio_sm_put_blocking(state->pio, state->sm, bytes[i]);
-        
-        pio_sm_get_blocking(state->pio, state->sm);
+        state->response_ring[state->response_head] = bytes[i];
+        state->response_head = (state->response_head + 1) & (RESPONSE_RING_SIZE - 1);
     }
+}
+
+static void response_kick(TransferState* state);
+
+// a full ring is retried once after retiring whatever dma has finished,
+// past that the record is dropped and the host is told through the status
+static bool response_push(TransferState* state, uint8_t type, uint16_t seq, const void* data, size_t len) 
+{
+    if (response_space(state) < sizeof(ResponseHeader) + len) 
+        response_kick(state);
+
+    if (response_space(state) < sizeof(ResponseHeader) + len) 
+    {
+        state->responses_dropped++;
+        gpu_set_error(GPU_ERROR_RESPONSE_OVERFLOW);
+        trace_event(TRACE_RESPONSE_DROPPED, type, (uint16_t)len);
+        return false;
+    }
+
+    ResponseHeader header = {
+        .type = type,
+        .seq = seq,
+        .length = (uint16_t)len
+    };
+
+    response_write(state, &header, sizeof(header));
+    response_write(state, data, len);
     
-    state->transfer_active = false;
     return true;
 }
 
+static bool response_flush_ack(TransferState* state) 
+{
+    if (!state->pending_ack.count) 
+        return true;
+
+    uint16_t last_seq = state->pending_ack.first_seq + state->pending_ack.count - 1;
+    if (!response_push(state, RESPONSE_TYPE_ACK, last_seq, &state->pending_ack, sizeof(AckStatus))) 
+        return false;
+
+    state->pending_ack.count = 0;
+    state->pending_ack.failed = 0;
+    return true;
+}
+
+// hands whatever is queued to dma without waiting on it. the tail only moves
+// once a transfer has finished, so the producer never overwrites bytes in flight
+static void response_kick(TransferState* state) 
+{
+    if (dma_channel_is_busy(state->dma_chan_tx)) 
+        return;
+
+    state->response_tail = (state->response_tail + state->response_in_flight) & (RESPONSE_RING_SIZE - 1);
+    state->response_in_flight = (state->response_head - state->response_tail) & (RESPONSE_RING_SIZE - 1);
+
+    if (!state->response_in_flight) 
+        return;
+
+    dma_channel_config config = dma_channel_get_default_config(state->dma_chan_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_ring(&config, false, RESPONSE_RING_BITS);
+    channel_config_set_dreq(&config, pio_get_dreq(state->pio, state->sm_tx, true));
+
+    dma_channel_configure(state->dma_chan_tx, &config, &state->pio->txf[state->sm_tx], 
+                          &state->response_ring[state->response_tail], state->response_in_flight, true);
+    trace_event(TRACE_RESPONSE_SENT, 0, state->response_in_flight);
+}
+
+// the response state machine owns the bus when the host reads, so raw
+// data goes out as a data record like any other response
+bool transfer_send_data(TransferState* state, const void* data, size_t len) 
+{
+    return transfer_send_response(state, data, len);
+}
+
 bool transfer_receive_data(TransferState* state, void* data, size_t len) 
 {
     if (state->transfer_active) return false;
@@ -75,8 +177,6 @@ bool transfer_receive_data(TransferState* state, void* data, size_t len)
     state->transfer_active = true;
     uint8_t* bytes = (uint8_t*)data;
 
-    gpio_set_dir_in_masked(0xFF << PIN_D0); // data pins as inputs
-
     for(size_t i = 0; i < len; i++) 
     {
         pio_sm_set_enabled(state->pio, state->sm, false);
@@ -93,14 +193,162 @@ bool transfer_receive_data(TransferState* state, void* data, size_t len)
     return true;
 }
 
+// queues a response record, the host reads it whenever it is ready
 bool transfer_send_response(TransferState* state, const void* data, size_t len) 
 {
-    gpio_put(PIN_WAIT, 0);
-    bool result = transfer_send_data(state, data, len);
-    gpio_put(PIN_WAIT, 1);
+    // keep records in command order
+    if (!response_flush_ack(state)) 
+        return false;
+
+    uint16_t seq = state->response_seq;
+    if (!response_push(state, RESPONSE_TYPE_DATA, seq, data, len)) 
+        return false;
+
+    state->response_seq++;
+    response_kick(state);
+    return true;
+}
+
+bool transfer_send_ack(TransferState* state, bool success) 
+{
+    if (state->pending_ack.count == UINT8_MAX && !response_flush_ack(state)) 
+        return false;
+
+    if (!state->pending_ack.count) 
+    {
+        state->pending_ack.first_seq = state->response_seq;
+    }
+
+    state->pending_ack.count++;
+    if (!success) 
+    {
+        state->pending_ack.failed++;
+    }
+
+    state->response_seq++;
+    return true;
+}
+
+void transfer_flush_responses(TransferState* state) 
+{
+    response_flush_ack(state);
+    response_kick(state);
+}
+
+static void stream_start_chunk(TransferState* state, uint8_t* chunk, size_t len) 
+{
+    dma_channel_config config = dma_channel_get_default_config(state->dma_chan_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, pio_get_dreq(state->pio, state->sm, false));
+
+    dma_channel_configure(state->dma_chan_rx, &config, chunk, &state->pio->rxf[state->sm], len, true);
+}
+
+// starts the receive state machine over on an empty fifo
+static void receive_restart(TransferState* state) 
+{
+    pio_sm_set_enabled(state->pio, state->sm, false);
+    pio_sm_clear_fifos(state->pio, state->sm);
+    pio_sm_restart(state->pio, state->sm);
+    pio_sm_exec(state->pio, state->sm, pio_encode_jmp(state->offset + gpu_transfer_offset_receive));
+    pio_sm_set_enabled(state->pio, state->sm, true);
+}
+
+// false if the host didn't deliver the chunk in time
+static bool stream_wait_chunk(TransferState* state) 
+{
+    uint32_t start = time_us_32();
+
+    while (dma_channel_is_busy(state->dma_chan_rx)) 
+    {
+        if (time_us_32() - start > STREAM_TIMEOUT_US) 
+            return false;
+
+        tight_loop_contents();
+    }
+
+    return true;
+}
+
+// pulls len bytes of payload off the bus and hands them to sink in chunks,
+// without going through the command queue. the next chunk is received by
+// dma while the sink works on the current one, so throughput is bounded by
+// the bus. each chunk has STREAM_TIMEOUT_US to arrive.
+bool transfer_stream(TransferState* state, size_t len, StreamSinkFn sink, void* ctx) 
+{
+    if (state->transfer_active) 
+        return false;
+    
+    if (!len) 
+        return true;
+
+    state->transfer_active = true;
+
+    // the state machine keeps receiving between commands, so the first bytes
+    // of the payload may already be in the fifo. the first chunk's dma reads
+    // them out ahead of the rest, only the error paths start it over
+    int current = 0;
+    size_t chunk_len = len < STREAM_CHUNK_SIZE ? len : STREAM_CHUNK_SIZE;
+    stream_start_chunk(state, state->stream_chunks[current], chunk_len);
+
+    bool result = true;
+    while (len) 
+    {
+        if (!stream_wait_chunk(state)) 
+        {
+            // the host stopped mid payload, give the bus back to commands
+            dma_channel_abort(state->dma_chan_rx);
+            receive_restart(state);
+            gpu_set_error(GPU_ERROR_TIMEOUT);
+            trace_event(TRACE_STREAM_TIMEOUT, 0, (uint16_t)(len > 0xFFFF ? 0xFFFF : len));
+            result = false;
+            break;
+        }
+
+        size_t received = chunk_len;
+        len -= received;
+
+        // start the next chunk before handing this one over
+        if (len) 
+        {
+            chunk_len = len < STREAM_CHUNK_SIZE ? len : STREAM_CHUNK_SIZE;
+            stream_start_chunk(state, state->stream_chunks[!current], chunk_len);
+        }
+
+        // keep draining the bus after a failure so the host isn't left hanging
+        if (result) 
+        {
+            result = sink(ctx, state->stream_chunks[current], received);
+        }
+
+        current = !current;
+    }
+
+    state->transfer_active = false;
     return result;
 }
 
+static bool discard_sink(void* ctx, const uint8_t* data, size_t len) 
+{
+    return true;
+}
+
+// pulls a payload nobody wants off the bus so it isn't read as commands
+bool transfer_discard(TransferState* state, size_t len) 
+{
+    return transfer_stream(state, len, discard_sink, NULL);
+}
+
+// for a payload whose length can't be known, whatever is still in the
+// receive fifo is thrown away and the host is told the transfer failed
+void transfer_resync(TransferState* state) 
+{
+    receive_restart(state);
+    gpu_set_error(GPU_ERROR_TRANSFER_FAILED);
+}
+
 bool transfer_wait_response(TransferState* state, void* data, size_t len) 
 {
     state->waiting_for_response = true;
@@ -3,23 +3,15 @@
 #include <stdint.h>
 #include "hardware/pio.h"
 #include "hardware/gpio.h"
+#include "trace.h"
+#include "gpu_commands.h"
 
 #define CMD_FLAG_NEEDS_RESPONSE   0x80 // bit 7: requires response
 #define CMD_FLAG_HIGH_PRIORITY    0x40 // bit 6: priority command
 #define CMD_FLAG_RESET_STATE      0x20 // bit 5: reset state before command
-
-typedef enum {
-    CMD_NOP             = 0x00,
-    CMD_INIT            = 0x01,
-    CMD_LOAD_PATTERN    = 0x02,
-    CMD_LOAD_PALETTE    = 0x03,
-    CMD_UPDATE_SPRITE   = 0x04,
-    CMD_ENABLE_SPRITE   = 0x05,
-    CMD_DISABLE_SPRITE  = 0x06,
-    CMD_SET_SCROLL      = 0x07,
-    CMD_STATUS          = 0x08,
-    CMD_RESET           = 0xFF
-} GpuCommand;
+#define CMD_FLAG_TARGET_FRAME     0x10 // bit 4: header is followed by a uint32 frame number to apply on
+#define CMD_FLAG_STREAM           0x08 // bit 3: bulk payload follows on the bus behind a StreamPayload, not in the queue
+#define CMD_FLAG_COMPRESSED       0x04 // bit 2: payload is an RLE stream (see rle.h) behind a CompressedPayload
 
 typedef struct __attribute__((packed)) {
     uint8_t cmd; // command type
@@ -29,12 +21,12 @@ typedef struct __attribute__((packed)) {
 typedef struct {
     uint16_t pattern_num;
     uint8_t size; // SPRITE_SIZE_8x8, SPRITE_SIZE_16x16, etc.
-    // data is in command buffer
+    // data is in command buffer, or streamed after the command with CMD_FLAG_STREAM
 } LoadPatternData;
 
 typedef struct __attribute__((packed)) {
-    uint8_t palette_num; 
-    // 16 colors (32 bytes of RGB565) in buffer
+    uint8_t palette_num; // 0-63
+    // 16 colors (32 bytes of little endian RGB565) in buffer
 } LoadPaletteData;
 
 typedef struct __attribute__((packed)) {
@@ -44,6 +36,7 @@ typedef struct __attribute__((packed)) {
     uint8_t pattern;
     uint8_t attr; 
     uint8_t ctrl;
+    uint8_t ext; // extended attributes (palette bank high bits)
 } UpdateSpriteData;
 
 typedef struct __attribute__((packed)) {
@@ -52,6 +45,229 @@ typedef struct __attribute__((packed)) {
     uint8_t layer;
 } SetScrollData;
 
+typedef struct __attribute__((packed)) {
+    uint32_t offset; // into the psram tilemap region
+    uint16_t length; // bytes of tilemap data, in buffer or streamed
+} LoadTilemapData;
+
+// commands after this are recorded into the list instead of executed,
+// until CMD_END_LIST
+typedef struct __attribute__((packed)) {
+    uint8_t list_num;
+    uint16_t capacity; // psram bytes to reserve, reused if a re-record fits
+} BeginListData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t list_num;
+    int16_t x; // added to every sprite position in the list
+    int16_t y;
+} CallListData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t group;
+    uint8_t count;
+    // count SpriteGroupMember entries in buffer, replacing the old members
+} SetSpriteGroupData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t group;
+    int16_t x;
+    int16_t y;
+    uint8_t flip; // SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP
+} MoveGroupData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t anim;
+    uint8_t count;
+    uint8_t flags; // ANIMATION_LOOP
+    // count AnimationStep entries in buffer
+} LoadAnimationData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t sprite_num;
+    uint8_t anim;       // SPRITE_NO_ANIMATION to unbind
+    uint8_t start_step;
+} BindAnimationData;
+
+// blitter commands draw over the next frame, colors are little endian RGB565
+typedef struct __attribute__((packed)) {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint16_t color;
+} FillRectData;
+
+typedef struct __attribute__((packed)) {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    int16_t src_x;
+    int16_t src_y;
+} CopyRectData;
+
+typedef struct __attribute__((packed)) {
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t src_addr;   // psram address of the first source pixel, display byte order
+    uint16_t src_stride; // bytes per source row
+    uint8_t flags;       // BLIT_FLAG_COLOR_KEY
+    uint16_t color_key;
+} BlitSurfaceData;
+
+// text layer, see text_layer.h for the atlas layout
+typedef struct __attribute__((packed)) {
+    uint8_t bpp;          // 1 or 2
+    uint8_t height;       // 8-16 rows, glyphs are always 8 pixels wide
+    uint16_t glyph_count;
+    // atlas data in buffer, or streamed
+} LoadFontData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t column;
+    uint8_t row;
+    uint8_t palette; // sprite palette the glyph colors come from
+    uint8_t length;
+    // length glyph codes in buffer, 0 clears a cell
+} WriteTextData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t first_row;
+    uint8_t row_count;
+} ClearTextData;
+
+// offscreen surfaces in psram, see surface.h
+typedef struct __attribute__((packed)) {
+    uint8_t surface;
+    uint16_t width;
+    uint16_t height;
+} CreateSurfaceData;
+
+// response to CMD_CREATE_SURFACE, addr and stride can go straight into a
+// CMD_BLIT_SURFACE to use the surface as a blit source
+typedef struct __attribute__((packed)) {
+    uint8_t success;
+    uint32_t addr;
+    uint16_t stride;
+} SurfaceInfo;
+
+typedef struct __attribute__((packed)) {
+    uint8_t surface;
+    int16_t x; // frame region copied into the surface
+    int16_t y;
+} CaptureSurfaceData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t surface; // SURFACE_NONE clears to black again
+    uint16_t scroll_x;
+    uint16_t scroll_y;
+} SetBackgroundData;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mode; // DISPLAY_PACING_FREE, DISPLAY_PACING_60, DISPLAY_PACING_30
+} SetPacingData;
+
+#define TRACE_REQUEST_STDIO 0x01 // print the whole ring over stdio and just ack
+
+typedef struct __attribute__((packed)) {
+    uint32_t from;  // ring position to read from, the previous first + count
+    uint8_t flags;  // TRACE_REQUEST_STDIO
+} GetTraceData;
+
+// response to CMD_GET_TRACE, only count events are sent
+typedef struct __attribute__((packed)) {
+    uint32_t cpu_hz; // to turn event cycles into time
+    uint32_t head;   // ring position of the next event to be recorded
+    uint32_t first;  // ring position of events[0], later than from if those were overwritten
+    uint8_t count;
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+// command capture, see capture.h
+typedef struct __attribute__((packed)) {
+    uint8_t action; // CAPTURE_ACTION_*
+} CaptureData;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;
+    uint16_t length; // up to CAPTURE_READ_CHUNK, responds with a CaptureChunk
+} ReadCaptureData;
+
+// precedes the bus payload of a command sent with CMD_FLAG_STREAM and not
+// compressed. the length is declared up front so a rejected command's
+// payload can still be pulled off the bus instead of being read as commands
+typedef struct __attribute__((packed)) {
+    uint32_t length; // bytes that follow on the bus, must match what the command expects
+} StreamPayload;
+
+// precedes the payload of a command sent with CMD_FLAG_COMPRESSED
+typedef struct __attribute__((packed)) {
+    uint16_t length; // compressed bytes that follow
+} CompressedPayload;
+
+// response to a compressed upload that asks for one
+typedef struct __attribute__((packed)) {
+    uint8_t success;
+    uint32_t bus_bytes;     // compressed bytes received
+    uint32_t output_bytes;  // bytes written after decompression
+    uint32_t time_us;       // receive + decompress + write
+} UploadStats;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mode; // COLLISION_MODE_OFF, COLLISION_MODE_BOX, COLLISION_MODE_PIXEL
+} SetCollisionModeData;
+
+typedef struct __attribute__((packed)) {
+    uint16_t fence_id;
+} FenceData;
+
+// sent once every command queued before the fence is on screen
+typedef struct __attribute__((packed)) {
+    uint16_t fence_id;
+    uint32_t frame; // frame whose scanout retired the fence
+} FenceAck;
+
+// Bus ownership: the receive state machine (PIO0 SM1) only ever samples
+// D0-D7 and its pindirs stay input. The response state machine (SM2) is the
+// only thing that turns them around, and only for a host read cycle, from
+// CS low with RW high until the host releases CS. The host never reads and
+// writes in the same cycle, so the two never drive the bus at once, and
+// nothing else touches the data pin directions.
+//
+// Responses are queued as records and streamed to the host by PIO0 SM2.
+// Consecutive acks coalesce into one ACK record until a data response or
+// the end of the command drain flushes them.
+#define RESPONSE_TYPE_ACK    0x01 // payload is AckStatus
+#define RESPONSE_TYPE_DATA   0x02 // payload is the command's response struct
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint16_t seq;     // sequence number of the last response covered
+    uint16_t length;  // payload bytes following the header
+} ResponseHeader;
+
+typedef struct __attribute__((packed)) {
+    uint16_t first_seq;
+    uint8_t count;    // acks coalesced into this record
+    uint8_t failed;   // how many of them reported failure
+} AckStatus;
+
+// streamed payloads are pulled from the receive fifo in chunks of this size,
+// one chunk landing while the previous one is written to psram
+#define STREAM_CHUNK_SIZE    256
+
+// a host that stops sending for this long mid payload has the stream
+// aborted with GPU_ERROR_TIMEOUT, so scanout never waits on it for good
+#define STREAM_TIMEOUT_US    50000
+
+// ring is read by dma with address wrapping, so it must be a power of two
+// and aligned to its own size
+#define RESPONSE_RING_BITS   10
+#define RESPONSE_RING_SIZE   (1 << RESPONSE_RING_BITS)
+
 // Transfer state management
 typedef struct {
     PIO pio;
@@ -59,6 +275,21 @@ typedef struct {
     uint offset;
     volatile bool transfer_active;
     volatile bool waiting_for_response;
+
+    // response channel
+    uint8_t response_ring[RESPONSE_RING_SIZE] __attribute__((aligned(RESPONSE_RING_SIZE)));
+    uint16_t response_head;     // next byte to write
+    uint16_t response_tail;     // first byte not yet sent
+    uint16_t response_in_flight;
+    uint16_t response_seq;
+    uint32_t responses_dropped; // records lost to a full ring, see GPU_ERROR_RESPONSE_OVERFLOW
+    AckStatus pending_ack;
+    uint sm_tx;
+    int dma_chan_tx;
+
+    // streaming receive
+    int dma_chan_rx;
+    uint8_t stream_chunks[2][STREAM_CHUNK_SIZE];
 } TransferState;
 
 // helper functions for flag handling
@@ -77,9 +308,50 @@ static inline bool cmd_resets_state(const GpuCommandHeader* header)
     return (header->flags & CMD_FLAG_RESET_STATE) != 0;
 }
 
-bool transfer_init(TransferState* state, PIO pio, uint sm);
+static inline bool cmd_is_streamed(const GpuCommandHeader* header) 
+{
+    return (header->flags & CMD_FLAG_STREAM) != 0;
+}
+
+static inline bool cmd_is_compressed(const GpuCommandHeader* header) 
+{
+    return (header->flags & CMD_FLAG_COMPRESSED) != 0;
+}
+
+// types that always take the priority lane
+static inline bool cmd_is_priority_type(uint8_t cmd) 
+{
+    return cmd == CMD_STATUS || cmd == CMD_GET_PERF || cmd == CMD_GET_PSRAM_DIAG || cmd == CMD_RESET;
+}
+
+// queries report on the gpu as it is now, so they never go in a display list
+static inline bool cmd_is_query(uint8_t cmd) 
+{
+    return cmd == CMD_STATUS || cmd == CMD_GET_PERF || cmd == CMD_GET_PSRAM_DIAG || cmd == CMD_GET_TRACE ||
+           cmd == CMD_GET_COLLISIONS || cmd == CMD_READ_CAPTURE;
+}
+
+static inline bool cmd_has_target_frame(const GpuCommandHeader* header) 
+{
+    return (header->flags & CMD_FLAG_TARGET_FRAME) != 0;
+}
+
+// wrap safe, a target frame in the past is due immediately
+static inline bool cmd_frame_reached(uint32_t target_frame, uint32_t frame) 
+{
+    return (int32_t)(frame - target_frame) >= 0;
+}
+
+bool transfer_init(TransferState* state, PIO pio, uint sm_rx, uint sm_tx);
 
 bool transfer_send_data(TransferState* state, const void* data, size_t len);
 bool transfer_receive_data(TransferState* state, void* data, size_t len);
 bool transfer_send_response(TransferState* state, const void* data, size_t len);
+bool transfer_send_ack(TransferState* state, bool success);
+typedef bool (*StreamSinkFn)(void* ctx, const uint8_t* data, size_t len);
+
+bool transfer_stream(TransferState* state, size_t len, StreamSinkFn sink, void* ctx);
+bool transfer_discard(TransferState* state, size_t len);
+void transfer_resync(TransferState* state);
+void transfer_flush_responses(TransferState* state);
 bool transfer_wait_response(TransferState* state, void* data, size_t len);
\ No newline at end of file
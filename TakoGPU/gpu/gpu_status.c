@@ -8,7 +8,11 @@ static volatile GpuStatus current_status = {
     .error_code = GPU_ERROR_NONE,
     .sprite_count = 0,
     .frame_rate = 60,
-    .reserved = {0, 0, 0}
+    .pacing = 0,
+    .reserved = {0, 0},
+    .frame_count = 0,
+    .frame_time_us = 0,
+    .frame_jitter_us = 0
 };
 
 // todo - pretty sure this interrupt handling isn't going to work
@@ -64,5 +68,31 @@ void gpu_set_error(GpuErrorCode error)
     current_status.status = GPU_STATUS_ERROR;
     current_status.error_code = error;
     
+    restore_interrupts(iStatus);
+}
+
+void gpu_set_frame_count(uint32_t frame_count) 
+{
+    uint32_t iStatus = save_and_disable_interrupts();
+    current_status.frame_count = frame_count;
+    
+    restore_interrupts(iStatus);
+}
+
+void gpu_set_frame_rate(uint8_t frame_rate) 
+{
+    uint32_t iStatus = save_and_disable_interrupts();
+    current_status.frame_rate = frame_rate;
+    
+    restore_interrupts(iStatus);
+}
+
+void gpu_set_frame_timing(uint8_t pacing, uint16_t frame_time_us, uint16_t frame_jitter_us) 
+{
+    uint32_t iStatus = save_and_disable_interrupts();
+    current_status.pacing = pacing;
+    current_status.frame_time_us = frame_time_us;
+    current_status.frame_jitter_us = frame_jitter_us;
+    
     restore_interrupts(iStatus);
 }
\ No newline at end of file
@@ -20,7 +20,10 @@ typedef enum {
     GPU_ERROR_MEMORY_FULL = 4,
     GPU_ERROR_TRANSFER_FAILED = 5,
     GPU_ERROR_TIMEOUT = 6,
-    GPU_ERROR_NOT_INITIALIZED = 7
+    GPU_ERROR_NOT_INITIALIZED = 7,
+    GPU_ERROR_SELF_TEST_FAILED = 8,
+    GPU_ERROR_PSRAM_TEST_FAILED = 9,
+    GPU_ERROR_RESPONSE_OVERFLOW = 10 // the response ring was full and a response was dropped
 } GpuErrorCode;
 
 // busy flags
@@ -38,9 +41,20 @@ typedef struct __attribute__((packed)) {
     uint8_t error_code;    // GpuErrorCode if status is GPU_STATUS_ERROR
     uint8_t sprite_count;  // number of active sprites
     uint8_t frame_rate;
-    uint8_t reserved[3];
+    uint8_t pacing;        // DISPLAY_PACING_*
+    uint8_t reserved[2];
+    uint32_t frame_count;  // frames rendered since boot
+    uint16_t frame_time_us;   // average time between scanouts
+    uint16_t frame_jitter_us; // largest change between consecutive frame times
 } GpuStatus;
 
 GpuStatus gpu_get_status(void);
 
 void gpu_clear_error(void);
+void gpu_set_error(GpuErrorCode error);
+void gpu_set_busy_flag(uint8_t flag);
+void gpu_clear_busy_flag(uint8_t flag);
+
+void gpu_set_frame_count(uint32_t frame_count);
+void gpu_set_frame_rate(uint8_t frame_rate);
+void gpu_set_frame_timing(uint8_t pacing, uint16_t frame_time_us, uint16_t frame_jitter_us);
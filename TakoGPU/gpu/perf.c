@@ -0,0 +1,134 @@
+#include "perf.h"
+#include "hardware/clocks.h"
+#include "pico/time.h"
+#include <string.h>
+
+static uint32_t frame_cycles[PERF_STAGE_COUNT];
+static uint32_t samples[PERF_STAGE_COUNT][PERF_WINDOW];
+static uint16_t sample_pos;
+static uint16_t sample_count;
+
+static uint32_t command_counts[PERF_COMMAND_SLOTS];
+static volatile uint32_t boot_us[PERF_BOOT_COUNT];
+static PerfPeriod last_period;
+
+void perf_init(void) 
+{
+    m33_hw->demcr |= M33_DEMCR_TRCENA_BITS;
+    m33_hw->dwt_cyccnt = 0;
+    m33_hw->dwt_ctrl |= M33_DWT_CTRL_CYCCNTENA_BITS;
+
+    memset(frame_cycles, 0, sizeof(frame_cycles));
+    memset(command_counts, 0, sizeof(command_counts));
+    sample_pos = 0;
+    sample_count = 0;
+}
+
+void perf_stage_add(uint8_t stage, uint32_t cycles) 
+{
+    frame_cycles[stage] += cycles;
+}
+
+void perf_count_command(uint8_t cmd) 
+{
+    if (cmd < CMD_CODE_COUNT) 
+        command_counts[cmd]++;
+    else if (cmd == CMD_RESET) 
+        command_counts[PERF_COMMAND_RESET]++;
+    else
+        command_counts[PERF_COMMAND_OTHER]++;
+}
+
+void perf_end_frame(void) 
+{
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++) 
+    {
+        samples[stage][sample_pos] = frame_cycles[stage];
+    }
+
+    memset(frame_cycles, 0, sizeof(frame_cycles));
+
+    if (++sample_pos == PERF_WINDOW) 
+        sample_pos = 0;
+
+    if (sample_count < PERF_WINDOW) 
+        sample_count++;
+}
+
+// first pixel is marked from the TE interrupt, everything else from the main loop
+void perf_mark_boot(uint8_t milestone) 
+{
+    if (!boot_us[milestone]) 
+        boot_us[milestone] = time_us_32();
+}
+
+uint32_t perf_boot_time(uint8_t milestone) 
+{
+    return boot_us[milestone];
+}
+
+void perf_set_period(const PerfPeriod* period) 
+{
+    last_period = *period;
+}
+
+// drops whatever boot work was counted before the first frame
+void perf_discard_frame(void) 
+{
+    memset(frame_cycles, 0, sizeof(frame_cycles));
+}
+
+// insertion sort, the window is small and this only runs on request
+static void sort_samples(uint32_t* values, uint16_t count) 
+{
+    for (uint16_t i = 1; i < count; i++) 
+    {
+        uint32_t value = values[i];
+        uint16_t j = i;
+
+        while (j && values[j - 1] > value) 
+        {
+            values[j] = values[j - 1];
+            j--;
+        }
+
+        values[j] = value;
+    }
+}
+
+void perf_get_report(PerfReport* report) 
+{
+    static uint32_t sorted[PERF_WINDOW];
+
+    memset(report, 0, sizeof(*report));
+    report->cpu_hz = clock_get_hz(clk_sys);
+    report->frames = sample_count;
+    memcpy(report->command_counts, command_counts, sizeof(command_counts));
+    report->period = last_period;
+
+    for (int milestone = 0; milestone < PERF_BOOT_COUNT; milestone++) 
+    {
+        report->boot_us[milestone] = boot_us[milestone];
+    }
+
+    if (!sample_count) 
+        return;
+
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++) 
+    {
+        memcpy(sorted, samples[stage], sample_count * sizeof(uint32_t));
+        sort_samples(sorted, sample_count);
+
+        uint64_t total = 0;
+        for (uint16_t n = 0; n < sample_count; n++) 
+        {
+            total += sorted[n];
+        }
+
+        PerfStageStats* stats = &report->stages[stage];
+        stats->min = sorted[0];
+        stats->max = sorted[sample_count - 1];
+        stats->avg = (uint32_t)(total / sample_count);
+        stats->p99 = sorted[((sample_count - 1) * 99) / 100];
+    }
+}
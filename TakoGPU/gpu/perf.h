@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/structs/m33.h"
+#include "gpu_commands.h"
+
+// Per stage frame profiler. Stages are timed with the core's DWT cycle
+// counter and summed over a frame; the last PERF_WINDOW frames are kept
+// so CMD_GET_PERF can report min/avg/max/p99. PSRAM time is also counted
+// inside whichever stage did the access.
+#define PERF_STAGE_COMMANDS     0 // command drain
+#define PERF_STAGE_BINNING      1 // sprite_engine_start_frame
+#define PERF_STAGE_COMPOSE      2 // sprites, background, blits, text
+#define PERF_STAGE_PSRAM        3 // aps6404 reads and writes
+#define PERF_STAGE_DISPLAY_WAIT 4 // waiting on the previous scanout
+#define PERF_STAGE_COUNT        5
+
+#define PERF_WINDOW             128
+
+// boot milestones, in microseconds since reset. perf_mark_boot only keeps
+// the first time each one is reached
+#define PERF_BOOT_BUS_READY     0 // parallel bus is accepting commands
+#define PERF_BOOT_PSRAM_READY   1
+#define PERF_BOOT_FIRST_COMMAND 2 // first command taken off a lane
+#define PERF_BOOT_DISPLAY_READY 3 // panel out of reset and sleep
+#define PERF_BOOT_FIRST_PIXEL   4 // first scanout started
+#define PERF_BOOT_COUNT         5
+
+// every command code below CMD_RESET gets its own counter, then one for
+// CMD_RESET and one shared by codes nothing answers to
+#define PERF_COMMAND_RESET      CMD_CODE_COUNT
+#define PERF_COMMAND_OTHER      (CMD_CODE_COUNT + 1)
+#define PERF_COMMAND_SLOTS      (CMD_CODE_COUNT + 2)
+
+typedef struct __attribute__((packed)) {
+    uint32_t min; // cycles per frame
+    uint32_t avg;
+    uint32_t max;
+    uint32_t p99;
+} PerfStageStats;
+
+// what the main loop measures over each stats period (every 60 frames),
+// reported here instead of printed so the uart never stalls a frame
+typedef struct __attribute__((packed)) {
+    uint32_t queue_latency_us[2]; // longest push to pop wait since boot, priority and normal lane
+    uint32_t blit_pixels;         // blitter fill rate is pixels / blit_us
+    uint32_t blit_us;
+    uint32_t background_lines;    // surface background fetches
+    uint32_t background_reads;
+    uint32_t background_us;
+} PerfPeriod;
+
+typedef struct __attribute__((packed)) {
+    uint32_t cpu_hz;   // to turn cycles into time
+    uint16_t frames;   // frames in the window
+    PerfStageStats stages[PERF_STAGE_COUNT];
+    uint32_t queue_rejected[2]; // cmd_queue_push failures, priority and normal lane
+    uint32_t command_counts[PERF_COMMAND_SLOTS];
+    uint32_t boot_us[PERF_BOOT_COUNT]; // 0 until reached
+    PerfPeriod period; // the last complete stats period
+} PerfReport;
+
+void perf_init(void);
+
+static inline uint32_t perf_cycles(void) 
+{
+    return m33_hw->dwt_cyccnt;
+}
+
+void perf_stage_add(uint8_t stage, uint32_t cycles);
+void perf_count_command(uint8_t cmd);
+void perf_end_frame(void);
+void perf_discard_frame(void);
+void perf_mark_boot(uint8_t milestone);
+uint32_t perf_boot_time(uint8_t milestone);
+void perf_set_period(const PerfPeriod* period);
+
+void perf_get_report(PerfReport* report);
@@ -0,0 +1,299 @@
+#include "psram_test.h"
+#include "psram_tune.h"
+#include "hardware/clocks.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+static PsramDiagnostics diag;
+
+static uint32_t expected_block[PSRAM_TEST_BLOCK / 4];
+static uint32_t read_block[PSRAM_TEST_BLOCK / 4];
+static uint8_t bandwidth_buffer[PSRAM_BANDWIDTH_CHUNK];
+
+static uint8_t current_device;
+
+static void record_failure(uint8_t stage, uint32_t addr, uint8_t expected, uint8_t received) 
+{
+    if (diag.failed_stage != PSRAM_STAGE_NONE)
+        return;
+
+    diag.failed_stage = stage;
+    diag.failed_device = current_device;
+    diag.failed_address = addr;
+    diag.expected = expected;
+    diag.received = received;
+}
+
+static void write_byte(APS6404State* psram, uint32_t addr, uint8_t value) 
+{
+    aps6404_write(psram, addr, &value, 1);
+}
+
+static uint8_t read_byte(APS6404State* psram, uint32_t addr) 
+{
+    uint8_t value = 0;
+    aps6404_read(psram, addr, &value, 1);
+    return value;
+}
+
+// every power of two offset holds the pattern, then each one is disturbed
+// in turn to see whether the write shows up anywhere else, returns the bad lines
+static uint32_t test_address_lines(APS6404State* psram, int address_bits) 
+{
+    const uint8_t pattern = 0xAA;
+    const uint8_t antipattern = 0x55;
+    uint32_t bad_bits = 0;
+
+    for (int bit = 0; bit < address_bits; bit++) 
+    {
+        write_byte(psram, 1u << bit, pattern);
+    }
+
+    // a line stuck high folds its offset onto 0
+    write_byte(psram, 0, antipattern);
+
+    for (int bit = 0; bit < address_bits; bit++) 
+    {
+        uint8_t value = read_byte(psram, 1u << bit);
+        if (value != pattern) 
+        {
+            bad_bits |= 1u << bit;
+            record_failure(PSRAM_STAGE_ADDRESS, 1u << bit, pattern, value);
+        }
+    }
+
+    write_byte(psram, 0, pattern);
+
+    // a line stuck low or shorted to another lands the write on a different offset
+    for (int test_bit = 0; test_bit < address_bits; test_bit++) 
+    {
+        write_byte(psram, 1u << test_bit, antipattern);
+
+        uint8_t value = read_byte(psram, 0);
+        if (value != pattern) 
+        {
+            bad_bits |= 1u << test_bit;
+            record_failure(PSRAM_STAGE_ADDRESS, 0, pattern, value);
+        }
+
+        for (int bit = 0; bit < address_bits; bit++) 
+        {
+            if (bit == test_bit)
+                continue;
+
+            value = read_byte(psram, 1u << bit);
+            if (value != pattern) 
+            {
+                bad_bits |= (1u << test_bit) | (1u << bit);
+                record_failure(PSRAM_STAGE_ADDRESS, 1u << bit, pattern, value);
+            }
+        }
+
+        write_byte(psram, 1u << test_bit, pattern);
+    }
+
+    return bad_bits;
+}
+
+// each word holds its own address, so aliased blocks read back wrong
+static void fill_block(uint32_t addr, uint32_t invert) 
+{
+    for (uint32_t n = 0; n < PSRAM_TEST_BLOCK / 4; n++) 
+    {
+        expected_block[n] = (addr + n * 4) ^ invert;
+    }
+}
+
+static void check_block(uint32_t addr) 
+{
+    const uint8_t* expected = (const uint8_t*)expected_block;
+    const uint8_t* received = (const uint8_t*)read_block;
+
+    for (uint32_t n = 0; n < PSRAM_TEST_BLOCK; n++) 
+    {
+        if (expected[n] != received[n]) 
+        {
+            diag.errors++;
+            record_failure(PSRAM_STAGE_PATTERN, addr + n, expected[n], received[n]);
+        }
+    }
+}
+
+// the whole range is written before any of it is read back, so a block
+// overwritten through a bad address shows up too
+static void test_pattern(APS6404State* psram, uint32_t size) 
+{
+    for (int pass = 0; pass < 2; pass++) 
+    {
+        uint32_t invert = pass ? 0xFFFFFFFFu : 0;
+
+        for (uint32_t addr = 0; addr < size; addr += PSRAM_TEST_BLOCK) 
+        {
+            fill_block(addr, invert);
+            aps6404_write(psram, addr, (const uint8_t*)expected_block, PSRAM_TEST_BLOCK);
+        }
+
+        for (uint32_t addr = 0; addr < size; addr += PSRAM_TEST_BLOCK) 
+        {
+            fill_block(addr, invert);
+            aps6404_read(psram, addr, (uint8_t*)read_block, PSRAM_TEST_BLOCK);
+
+            if (memcmp(expected_block, read_block, PSRAM_TEST_BLOCK)) 
+            {
+                check_block(addr);
+            }
+        }
+
+        diag.bytes_tested += size;
+    }
+}
+
+// bytes per millisecond is kB/s
+static uint32_t kbps(uint32_t bytes, uint32_t time_us) 
+{
+    return time_us ? (uint32_t)(((uint64_t)bytes * 1000) / time_us) : 0;
+}
+
+static void measure_bandwidth(APS6404State* psram) 
+{
+    uint32_t start = time_us_32();
+    for (uint32_t addr = 0; addr < PSRAM_BANDWIDTH_BYTES; addr += PSRAM_BANDWIDTH_CHUNK) 
+    {
+        aps6404_write(psram, addr, bandwidth_buffer, PSRAM_BANDWIDTH_CHUNK);
+    }
+    diag.write_kbps = kbps(PSRAM_BANDWIDTH_BYTES, time_us_32() - start);
+
+    start = time_us_32();
+    for (uint32_t addr = 0; addr < PSRAM_BANDWIDTH_BYTES; addr += PSRAM_BANDWIDTH_CHUNK) 
+    {
+        aps6404_read(psram, addr, bandwidth_buffer, PSRAM_BANDWIDTH_CHUNK);
+    }
+    diag.read_kbps = kbps(PSRAM_BANDWIDTH_BYTES, time_us_32() - start);
+}
+
+// volatile so every load happens, the sum only keeps the compiler honest
+static uint32_t sum_words(const uint8_t* mapped, uint32_t bytes) 
+{
+    const volatile uint32_t* words = (const volatile uint32_t*)mapped;
+    uint32_t sum = 0;
+
+    for (uint32_t n = 0; n < bytes / 4; n++) 
+    {
+        sum += words[n];
+    }
+
+    return sum;
+}
+
+static void measure_mapped(APS6404State* psram) 
+{
+    const uint8_t* mapped = aps6404_mapped(psram, 0);
+    if (!mapped)
+        return;
+
+    // it was last written with aps6404_write, so none of it is cached yet
+    uint32_t start = time_us_32();
+    sum_words(mapped, PSRAM_BANDWIDTH_BYTES);
+    diag.mapped_read_kbps = kbps(PSRAM_BANDWIDTH_BYTES, time_us_32() - start);
+
+    sum_words(mapped, PSRAM_MAPPED_WINDOW);
+
+    start = time_us_32();
+    sum_words(mapped, PSRAM_MAPPED_WINDOW);
+    diag.mapped_hit_kbps = kbps(PSRAM_MAPPED_WINDOW, time_us_32() - start);
+}
+
+bool psram_test_chip(APS6404State* chip, uint8_t device, uint8_t mode) 
+{
+    if (device == 0)
+        memset(&diag, 0, sizeof(diag));
+
+    if (mode == PSRAM_TEST_OFF)
+        return true;
+
+    current_device = device;
+    uint32_t bad_bits = test_address_lines(chip, __builtin_ctz(aps6404_capacity(chip)));
+
+    if (device)
+        diag.second_bad_address_bits = bad_bits;
+    else
+        diag.bad_address_bits = bad_bits;
+
+    return bad_bits == 0;
+}
+
+// keeps what psram_test_chip found
+bool psram_test_run(APS6404State* psram, uint8_t mode) 
+{
+    diag.mode = mode;
+    diag.quad_mode = psram->quad_mode;
+    diag.clkdiv_x256 = (uint32_t)(psram->clkdiv * 256.0f);
+    diag.sample_point = psram->sample_point;
+    diag.tuned = psram_tune_result(0)->tuned;
+    diag.tune_pass_map = psram_tune_result(0)->pass_map;
+    diag.devices = psram->second ? 2 : 1;
+    diag.layout = psram->layout;
+    diag.backend = TAKO_PSRAM_BACKEND;
+
+    if (psram->second) 
+    {
+        diag.second_clkdiv_x256 = (uint32_t)(psram->second->clkdiv * 256.0f);
+        diag.second_sample_point = psram->second->sample_point;
+        diag.second_tuned = psram_tune_result(1)->tuned;
+        diag.second_tune_pass_map = psram_tune_result(1)->pass_map;
+    }
+    diag.sys_hz = clock_get_hz(clk_sys);
+
+    if (mode == PSRAM_TEST_OFF) 
+    {
+        diag.passed = true;
+        return true;
+    }
+
+    uint32_t start = time_us_32();
+
+    uint32_t capacity = aps6404_capacity(psram);
+
+    current_device = 0;
+    test_pattern(psram, mode == PSRAM_TEST_FULL ? capacity : PSRAM_TEST_QUICK_BYTES);
+    measure_bandwidth(psram);
+    measure_mapped(psram);
+
+    diag.duration_us = time_us_32() - start;
+    diag.passed = diag.failed_stage == PSRAM_STAGE_NONE;
+
+    printf("PSRAM test %s in %lu ms: %lu KB checked on %u chip(s) over %s, write %.2f MB/s, read %.2f MB/s at clkdiv %.2f\n",
+           diag.passed ? "passed" : "FAILED", (unsigned long)(diag.duration_us / 1000),
+           (unsigned long)(diag.bytes_tested / 1024), diag.devices,
+           diag.backend == APS6404_BACKEND_QMI ? "qmi" : "pio", diag.write_kbps / 1000.0f,
+           diag.read_kbps / 1000.0f, psram->clkdiv);
+
+    if (aps6404_mapped(psram, 0)) 
+    {
+        printf("  mapped loads: %.2f MB/s streaming, %.2f MB/s from the cache\n",
+               diag.mapped_read_kbps / 1000.0f, diag.mapped_hit_kbps / 1000.0f);
+    }
+
+    if (!diag.passed) 
+    {
+        printf("  first failure at 0x%06lx: expected 0x%02x, received 0x%02x, %lu bad bytes, address bits 0x%06lx",
+               (unsigned long)diag.failed_address, diag.expected, diag.received,
+               (unsigned long)diag.errors, (unsigned long)diag.bad_address_bits);
+
+        if (diag.devices > 1)
+            printf(", second chip 0x%06lx", (unsigned long)diag.second_bad_address_bits);
+
+        if (diag.failed_stage == PSRAM_STAGE_ADDRESS)
+            printf(", first on chip %u", diag.failed_device);
+
+        printf("\n");
+    }
+
+    return diag.passed;
+}
+
+const PsramDiagnostics* psram_test_results(void) 
+{
+    return &diag;
+}
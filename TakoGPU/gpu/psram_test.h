@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aps6404.h"
+
+// PSRAM self test, run once at boot before anything is stored in psram.
+//
+// The address lines are checked on each chip on its own, before the chips
+// are attached, by walking a one through every address bit and looking for
+// writes that land somewhere else (stuck or shorted lines). Through an
+// attached layout some of a chip's lines are never driven, the split layout
+// only routes a few regions to the second chip. The pattern test then fills its range block by block over dma with each
+// word's own address, reads it all back, and repeats with the inverse so
+// every data bit is seen both ways. Bandwidth is timed over bursts at the
+// clock divider and sample point psram was tuned to, and where the backend
+// maps psram, plain loads through the xip cache are timed too: streaming
+// past the cache, then over a window that fits in it. Builds with either
+// backend report the same figures, so the two can be compared. The results
+// stay around for CMD_GET_PSRAM_DIAG, so bus timing problems show up as
+// numbers.
+#define PSRAM_TEST_OFF          0
+#define PSRAM_TEST_QUICK        1 // address lines, pattern over the first 64KB, bandwidth
+#define PSRAM_TEST_FULL         2 // address lines, pattern over the whole chip, bandwidth
+
+#ifndef TAKO_PSRAM_TEST
+#define TAKO_PSRAM_TEST         PSRAM_TEST_QUICK
+#endif
+
+#define PSRAM_TEST_QUICK_BYTES  0x10000
+#define PSRAM_TEST_BLOCK        1024   // one psram page, bursts never cross it
+#define PSRAM_BANDWIDTH_BYTES   0x10000
+#define PSRAM_BANDWIDTH_CHUNK   4096   // several pages per call, so interleaved chips overlap
+#define PSRAM_MAPPED_WINDOW     4096   // read twice, the second pass all cache hits
+
+#define PSRAM_STAGE_NONE        0
+#define PSRAM_STAGE_ADDRESS     1
+#define PSRAM_STAGE_PATTERN     2
+
+typedef struct __attribute__((packed)) {
+    uint8_t mode;              // PSRAM_TEST_* that ran
+    uint8_t passed;            // also set when the test was off
+    uint8_t failed_stage;      // PSRAM_STAGE_* of the first failure
+    uint8_t quad_mode;
+    uint32_t bad_address_bits; // address lines found stuck or shorted on the first chip
+    uint32_t failed_address;   // first mismatching byte, within the chip for PSRAM_STAGE_ADDRESS
+    uint8_t expected;
+    uint8_t received;
+    uint8_t sample_point;      // APS6404_SAMPLE_* the figures were taken at
+    uint8_t tuned;             // psram_tune found a setting with margin
+    uint32_t bytes_tested;     // by the pattern test, both passes
+    uint32_t errors;           // mismatching bytes in the pattern test
+    uint32_t write_kbps;       // kB/s
+    uint32_t read_kbps;
+    uint32_t clkdiv_x256;      // pio clock divider the figures were taken at
+    uint32_t sys_hz;
+    uint32_t duration_us;
+    uint32_t tune_pass_map;    // PsramTuneResult.pass_map
+    uint8_t devices;           // 1 or 2 chips
+    uint8_t layout;            // APS6404_LAYOUT_*
+    uint8_t second_sample_point;
+    uint8_t second_tuned;
+    uint32_t second_clkdiv_x256;
+    uint32_t second_tune_pass_map;
+    uint8_t backend;           // APS6404_BACKEND_*
+    uint32_t mapped_read_kbps; // plain loads over PSRAM_BANDWIDTH_BYTES, 0 if not mapped
+    uint32_t mapped_hit_kbps;  // plain loads over a window already in the cache
+    uint32_t second_bad_address_bits;
+    uint8_t failed_device;     // chip the first failure was on, for PSRAM_STAGE_ADDRESS
+} PsramDiagnostics;
+
+// checks one chip's address lines over its own capacity, before it's
+// attached. called for chip 0 first, which starts a new set of results
+bool psram_test_chip(APS6404State* chip, uint8_t device, uint8_t mode);
+
+// runs over the attached layout's whole address space, destroys whatever is in psram
+bool psram_test_run(APS6404State* psram, uint8_t mode);
+const PsramDiagnostics* psram_test_results(void);
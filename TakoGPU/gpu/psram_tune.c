@@ -0,0 +1,150 @@
+#include "psram_tune.h"
+#include "hardware/clocks.h"
+#include <stdio.h>
+#include <string.h>
+
+static PsramTuneResult results[PSRAM_TUNE_DEVICES];
+
+// sample points in order of increasing delay, see aps6404.h. below a
+// divider of 2 the pio backend's synchronizers outlast half an sck period,
+// which swaps the middle two. the qmi backend's rx delays are always in order.
+static const uint8_t delay_order[APS6404_SAMPLE_POINTS] = {
+    APS6404_SAMPLE_RISE_SYNC, APS6404_SAMPLE_RISE, APS6404_SAMPLE_FALL_SYNC, APS6404_SAMPLE_FALL
+};
+
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_PIO
+static const uint8_t fast_delay_order[APS6404_SAMPLE_POINTS] = {
+    APS6404_SAMPLE_RISE_SYNC, APS6404_SAMPLE_FALL_SYNC, APS6404_SAMPLE_RISE, APS6404_SAMPLE_FALL
+};
+#endif
+
+static const uint8_t* sample_points_by_delay(uint8_t clkdiv) 
+{
+#if TAKO_PSRAM_BACKEND == APS6404_BACKEND_PIO
+    if (clkdiv < 2)
+        return fast_delay_order;
+#endif
+
+    return delay_order;
+}
+
+static bool point_passed(uint32_t map, int divider, int point) 
+{
+    return (map >> (divider * APS6404_SAMPLE_POINTS + point)) & 1;
+}
+
+PsramTuneResult psram_tune_sweep(PsramProbeFn probe, void* ctx, uint32_t sys_hz) 
+{
+    PsramTuneResult sweep = { 0 };
+
+    for (int divider = 0; divider < PSRAM_TUNE_DIVIDERS; divider++) 
+    {
+        uint8_t clkdiv = divider + 1;
+
+        // sck is half the pio clock
+        if (sys_hz / (2 * clkdiv) > APS6404_MAX_SCK_HZ)
+            continue;
+
+        for (int point = 0; point < APS6404_SAMPLE_POINTS; point++) 
+        {
+            if (probe(ctx, clkdiv, point)) 
+            {
+                sweep.pass_map |= 1u << (divider * APS6404_SAMPLE_POINTS + point);
+            }
+        }
+
+        // a point is only taken with a passing point either side of it in
+        // delay order, so the first and last never are
+        const uint8_t* order = sample_points_by_delay(clkdiv);
+
+        for (int n = 1; n < APS6404_SAMPLE_POINTS - 1; n++) 
+        {
+            if (point_passed(sweep.pass_map, divider, order[n - 1]) &&
+                point_passed(sweep.pass_map, divider, order[n]) &&
+                point_passed(sweep.pass_map, divider, order[n + 1])) 
+            {
+                sweep.tuned = true;
+                sweep.clkdiv = clkdiv;
+                sweep.sample_point = order[n];
+                return sweep;
+            }
+        }
+    }
+
+    return sweep;
+}
+
+// alternating nibbles flip every data line, the rest varies with the address
+static void fill_pattern(uint8_t* pattern) 
+{
+    for (int n = 0; n < APS6404_PAGE_SIZE; n++) 
+    {
+        pattern[n] = (n & 2) ? (uint8_t)(n >> 2) : ((n & 1) ? 0xA5 : 0x5A);
+    }
+}
+
+typedef struct {
+    APS6404State* psram;
+    float written_at;
+    uint8_t pattern[APS6404_PAGE_SIZE];
+    uint8_t readback[APS6404_PAGE_SIZE];
+} HardwareProbe;
+
+static bool hardware_probe(void* ctx, float clkdiv, uint8_t sample_point) 
+{
+    HardwareProbe* probe = (HardwareProbe*)ctx;
+
+    aps6404_set_timing(probe->psram, clkdiv, sample_point);
+
+    // writes don't depend on the sample point, only rewrite for a new divider
+    if (probe->written_at != clkdiv) 
+    {
+        aps6404_write(probe->psram, PSRAM_TUNE_ADDR, probe->pattern, APS6404_PAGE_SIZE);
+        probe->written_at = clkdiv;
+    }
+
+    for (int n = 0; n < PSRAM_TUNE_REPEATS; n++) 
+    {
+        memset(probe->readback, 0, sizeof(probe->readback));
+        aps6404_read(probe->psram, PSRAM_TUNE_ADDR, probe->readback, APS6404_PAGE_SIZE);
+
+        if (memcmp(probe->pattern, probe->readback, APS6404_PAGE_SIZE))
+            return false;
+    }
+
+    return true;
+}
+
+bool psram_tune_run(APS6404State* psram, uint8_t device) 
+{
+    static HardwareProbe probe;
+    PsramTuneResult* result = &results[device];
+    float safe_clkdiv = psram->clkdiv;
+    uint8_t safe_sample_point = psram->sample_point;
+
+    probe.psram = psram;
+    probe.written_at = 0.0f;
+    fill_pattern(probe.pattern);
+
+    *result = psram_tune_sweep(hardware_probe, &probe, clock_get_hz(clk_sys));
+
+    if (!result->tuned) 
+    {
+        result->clkdiv = safe_clkdiv;
+        result->sample_point = safe_sample_point;
+    }
+
+    aps6404_set_timing(psram, result->clkdiv, result->sample_point);
+
+    printf("PSRAM %u timing %s: clkdiv %.2f (sck %lu MHz), sample point %u, pass map 0x%08lx\n",
+           device, result->tuned ? "tuned" : "NOT tuned, kept the safe setting", result->clkdiv,
+           (unsigned long)(clock_get_hz(clk_sys) / (2.0f * result->clkdiv) / 1000000), result->sample_point,
+           (unsigned long)result->pass_map);
+
+    return result->tuned;
+}
+
+const PsramTuneResult* psram_tune_result(uint8_t device) 
+{
+    return &results[device];
+}
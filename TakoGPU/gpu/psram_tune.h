@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "aps6404.h"
+
+// PSRAM timing autotune, run at boot before the psram test.
+//
+// Whole clock dividers are tried fastest first, a fractional one would give
+// sck an uneven period. At each one a known pattern is written and read
+// back at every sample point, and the divider is taken if some sample point
+// passes along with the points either side of it in delay order, so the
+// setting isn't sitting on the edge of the data valid window. The sweep
+// itself only sees a probe callback, so it can be run against a simulated
+// chip with timing faults.
+#define PSRAM_TUNE_DIVIDERS     6   // 1 to 6
+#define PSRAM_TUNE_REPEATS      4   // reads per sample point, all have to match
+#define PSRAM_TUNE_ADDR         0   // pattern location, nothing lives in psram yet
+#define PSRAM_TUNE_DEVICES      2
+
+typedef struct {
+    bool tuned;            // false if nothing passed and the safe setting was kept
+    float clkdiv;
+    uint8_t sample_point;  // APS6404_SAMPLE_*
+    uint32_t pass_map;     // bit (clkdiv - 1) * APS6404_SAMPLE_POINTS + sample point set if it passed
+} PsramTuneResult;
+
+// writes the pattern if the divider changed, reads it back at the sample point
+typedef bool (*PsramProbeFn)(void* ctx, float clkdiv, uint8_t sample_point);
+
+PsramTuneResult psram_tune_sweep(PsramProbeFn probe, void* ctx, uint32_t sys_hz);
+
+// tunes one real chip, before it's attached, and leaves it running at the result
+bool psram_tune_run(APS6404State* psram, uint8_t device);
+const PsramTuneResult* psram_tune_result(uint8_t device);
@@ -0,0 +1,60 @@
+#include "render.h"
+#include "blitter.h"
+#include "display.h"
+#include "sprite_engine.h"
+#include "surface.h"
+#include "text_layer.h"
+
+// text goes on last so the hud stays above fills and surfaces
+static void finish_band(uint16_t* frame, uint16_t first_line, uint16_t end_line) 
+{
+    surface_capture_band(frame, first_line, end_line);
+
+    for (uint16_t line = first_line; line < end_line; line++) 
+    {
+        text_layer_render_line(line, frame + (line * DISPLAY_WIDTH));
+    }
+}
+
+// with a copy queued, blits run past the last band, so the surface
+// captures and text that go over them wait for the whole frame
+void render_frame(uint16_t* frame) 
+{
+    bool banded = !blitter_has_copies();
+
+    for (uint16_t band = 0; band < DISPLAY_HEIGHT; band += RENDER_BAND_LINES) 
+    {
+        uint16_t band_end = band + RENDER_BAND_LINES;
+        if (band_end > DISPLAY_HEIGHT)
+            band_end = DISPLAY_HEIGHT;
+
+        if (surface_background_active()) 
+        {
+            surface_fetch_band(frame, band, band_end);
+
+            for (uint16_t line = band; line < band_end; line++) 
+            {
+                sprite_engine_compose_line(line, frame + (line * DISPLAY_WIDTH), DISPLAY_WIDTH);
+            }
+        }
+        else 
+        {
+            for (uint16_t line = band; line < band_end; line++) 
+            {
+                sprite_engine_render_line(line, frame + (line * DISPLAY_WIDTH), DISPLAY_WIDTH);
+            }
+        }
+
+        blitter_run_band(frame, band, band_end);
+
+        if (banded) 
+            finish_band(frame, band, band_end);
+    }
+
+    blitter_finish_frame(frame);
+
+    if (!banded) 
+        finish_band(frame, 0, DISPLAY_HEIGHT);
+
+    surface_finish_frame();
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// lines composed before the blitter draws over them
+#define RENDER_BAND_LINES 16
+
+// composes a whole frame band by band: sprites over the background, then
+// blits, surface captures and the text layer on top
+void render_frame(uint16_t* frame);
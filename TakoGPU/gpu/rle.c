@@ -0,0 +1,98 @@
+#include "rle.h"
+
+#define RLE_STATE_CONTROL   0
+#define RLE_STATE_LITERAL   1
+#define RLE_STATE_REPEAT    2
+
+void rle_begin(RleDecoder* decoder, uint32_t expected, RleWriteFn write, void* ctx) 
+{
+    decoder->write = write;
+    decoder->ctx = ctx;
+    decoder->fill = 0;
+    decoder->written = 0;
+    decoder->expected = expected;
+    decoder->state = RLE_STATE_CONTROL;
+    decoder->count = 0;
+    decoder->failed = false;
+}
+
+static bool rle_flush(RleDecoder* decoder) 
+{
+    if (!decoder->fill) 
+        return true;
+
+    if (!decoder->write(decoder->ctx, decoder->written, decoder->window, decoder->fill)) 
+    {
+        decoder->failed = true;
+        return false;
+    }
+
+    decoder->written += decoder->fill;
+    decoder->fill = 0;
+    return true;
+}
+
+static inline bool rle_emit(RleDecoder* decoder, uint8_t value) 
+{
+    // never write past the destination, a bad stream just fails
+    if (decoder->written + decoder->fill >= decoder->expected) 
+    {
+        decoder->failed = true;
+        return false;
+    }
+
+    decoder->window[decoder->fill++] = value;
+
+    if (decoder->fill == RLE_WINDOW_SIZE) 
+        return rle_flush(decoder);
+
+    return true;
+}
+
+bool rle_feed(RleDecoder* decoder, const uint8_t* data, size_t len) 
+{
+    for (size_t i = 0; i < len && !decoder->failed; i++) 
+    {
+        uint8_t byte = data[i];
+
+        switch (decoder->state) 
+        {
+            case RLE_STATE_CONTROL:
+                if (byte & 0x80) 
+                {
+                    decoder->count = (byte & 0x7F) + RLE_REPEAT_MIN;
+                    decoder->state = RLE_STATE_REPEAT;
+                }
+                else 
+                {
+                    decoder->count = byte + 1;
+                    decoder->state = RLE_STATE_LITERAL;
+                }
+                break;
+
+            case RLE_STATE_LITERAL:
+                rle_emit(decoder, byte);
+                if (!--decoder->count) 
+                    decoder->state = RLE_STATE_CONTROL;
+                break;
+
+            case RLE_STATE_REPEAT:
+                while (decoder->count-- && rle_emit(decoder, byte));
+                decoder->state = RLE_STATE_CONTROL;
+                break;
+        }
+    }
+
+    return !decoder->failed;
+}
+
+bool rle_finish(RleDecoder* decoder) 
+{
+    if (decoder->failed || decoder->state != RLE_STATE_CONTROL) 
+        return false;
+
+    if (!rle_flush(decoder)) 
+        return false;
+
+    return decoder->written == decoder->expected;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Byte RLE stream used by compressed uploads (CMD_FLAG_COMPRESSED).
+// 4bpp data packs two pixels per byte, so runs of one color become runs of
+// one byte.
+//
+// control 0x00-0x7F: (control + 1) literal bytes follow
+// control 0x80-0xFF: the next byte repeats (control & 0x7F) + 3 times
+#define RLE_LITERAL_MAX     128
+#define RLE_REPEAT_MIN      3
+#define RLE_REPEAT_MAX      130
+
+// decoded bytes collect here before each write to their destination
+#define RLE_WINDOW_SIZE     256
+
+typedef bool (*RleWriteFn)(void* ctx, uint32_t offset, const uint8_t* data, size_t len);
+
+typedef struct {
+    RleWriteFn write;
+    void* ctx;
+
+    uint8_t window[RLE_WINDOW_SIZE];
+    uint16_t fill;
+    uint32_t written;   // bytes already handed to write
+    uint32_t expected;  // decoded size the stream must produce
+
+    uint8_t state;
+    uint8_t count;
+    bool failed;
+} RleDecoder;
+
+void rle_begin(RleDecoder* decoder, uint32_t expected, RleWriteFn write, void* ctx);
+
+// input may be split anywhere, state carries over between calls
+bool rle_feed(RleDecoder* decoder, const uint8_t* data, size_t len);
+
+// true if the stream decoded to exactly the expected size
+bool rle_finish(RleDecoder* decoder);
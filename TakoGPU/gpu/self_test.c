@@ -0,0 +1,417 @@
+#include "self_test.h"
+#include "sprite_engine.h"
+#include "display.h"
+#include "blend.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_PATTERNS   8  // pattern n is 8 << (n & 3) pixels square
+#define TEST_PALETTES   16
+
+typedef struct {
+    int16_t x; // negative positions are placed through a sprite group
+    int16_t y;
+    uint8_t pattern;
+    uint8_t attr;
+    uint8_t ctrl;
+    uint8_t ext;
+} SceneSprite;
+
+typedef struct {
+    const char* name;
+    const SceneSprite* sprites;
+    uint8_t count;
+} TestScene;
+
+#define EN  SPRITE_CTRL_ENABLE
+#define TR  (SPRITE_CTRL_ENABLE | SPRITE_CTRL_TRANS)
+#define PAL(n) ((n) << 4)
+
+static const SceneSprite flip_sprites[] = {
+    {  16,  16, 1, SPRITE_SIZE_16x16, EN, 0 },
+    {  48,  16, 1, SPRITE_SIZE_16x16 | SPRITE_ATTR_HFLIP, EN, 0 },
+    {  80,  16, 1, SPRITE_SIZE_16x16 | SPRITE_ATTR_VFLIP, EN, 0 },
+    { 112,  16, 1, SPRITE_SIZE_16x16 | SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP, EN, 0 },
+    {  16,  64, 3, SPRITE_SIZE_64x64 | SPRITE_ATTR_HFLIP, TR, 0 },
+    { 100,  64, 6, SPRITE_SIZE_32x32 | SPRITE_ATTR_VFLIP, TR, 0 },
+    { 150,  64, 4, SPRITE_SIZE_8x8 | SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP, EN, 0 },
+};
+
+static const SceneSprite palette_sprites[] = {
+    {   0,   0, 2, SPRITE_SIZE_32x32 | PAL(0), EN, 0 },
+    {  32,   0, 2, SPRITE_SIZE_32x32 | PAL(1), EN, 0 },
+    {  64,   0, 2, SPRITE_SIZE_32x32 | PAL(2), EN, 0 },
+    {  96,   0, 2, SPRITE_SIZE_32x32 | PAL(3), EN, 0 },
+    { 128,   0, 2, SPRITE_SIZE_32x32 | PAL(7), EN, 0 },
+    {   0,  40, 2, SPRITE_SIZE_32x32 | PAL(0), EN, 1 }, // bank 8
+    {  32,  40, 2, SPRITE_SIZE_32x32 | PAL(5), EN, 1 }, // bank 13
+    {  64,  40, 2, SPRITE_SIZE_32x32 | PAL(7), EN, 1 }, // bank 15
+    {  96,  40, 2, SPRITE_SIZE_32x32 | PAL(0), EN, 2 }, // bank 16, never loaded
+};
+
+static const SceneSprite priority_sprites[] = {
+    {  40,  40, 3, SPRITE_SIZE_64x64 | PAL(1), TR, 0 },
+    {  60,  60, 3, SPRITE_SIZE_64x64 | PAL(2), TR, 0 },
+    {  80,  80, 3, SPRITE_SIZE_64x64 | PAL(3) | SPRITE_ATTR_PRIORITY, TR, 0 },
+    {  50,  70, 2, SPRITE_SIZE_32x32 | PAL(4), EN, 0 },
+    {  90,  50, 2, SPRITE_SIZE_32x32 | PAL(5) | SPRITE_ATTR_PRIORITY, EN, 0 },
+    {  70,  65, 1, SPRITE_SIZE_16x16 | PAL(6), TR, 0 },
+    {  70,  65, 1, SPRITE_SIZE_16x16 | PAL(7), EN, 0 }, // same spot, lower index wins
+};
+
+// 40 sprites share lines 100-107, only the first MAX_SPRITES_PER_LINE show
+static const SceneSprite overflow_sprites[] = {
+    {   0, 100, 0, PAL(1), EN, 0 }, {   6, 100, 0, PAL(2), EN, 0 }, {  12, 100, 0, PAL(3), EN, 0 }, {  18, 100, 0, PAL(4), EN, 0 },
+    {  24, 100, 0, PAL(5), EN, 0 }, {  30, 100, 0, PAL(6), EN, 0 }, {  36, 100, 0, PAL(7), EN, 0 }, {  42, 100, 0, PAL(1), EN, 0 },
+    {  48, 102, 0, PAL(2), TR, 0 }, {  54, 102, 0, PAL(3), TR, 0 }, {  60, 102, 0, PAL(4), TR, 0 }, {  66, 102, 0, PAL(5), TR, 0 },
+    {  72, 100, 0, PAL(6), EN, 0 }, {  78, 100, 0, PAL(7), EN, 0 }, {  84, 100, 0, PAL(1), EN, 0 }, {  90, 100, 0, PAL(2), EN, 0 },
+    {  96, 101, 0, PAL(3), EN, 0 }, { 102, 101, 0, PAL(4), EN, 0 }, { 108, 101, 0, PAL(5), EN, 0 }, { 114, 101, 0, PAL(6), EN, 0 },
+    { 120, 100, 0, PAL(7), EN, 0 }, { 126, 100, 0, PAL(1), EN, 0 }, { 132, 100, 0, PAL(2), EN, 0 }, { 138, 100, 0, PAL(3), EN, 0 },
+    { 144,  99, 0, PAL(4), EN, 0 }, { 150,  99, 0, PAL(5), EN, 0 }, { 156,  99, 0, PAL(6), EN, 0 }, { 162,  99, 0, PAL(7), EN, 0 },
+    { 168, 100, 0, PAL(1), EN, 0 }, { 174, 100, 0, PAL(2), EN, 0 }, { 180, 100, 0, PAL(3), EN, 0 }, { 186, 100, 0, PAL(4), EN, 0 },
+    { 192, 100, 0, PAL(5), EN, 0 }, { 198, 100, 0, PAL(6), EN, 0 }, { 204, 103, 0, PAL(7), EN, 0 }, { 210, 103, 0, PAL(1), EN, 0 },
+    { 216, 100, 0, PAL(2), EN, 0 }, { 222, 100, 0, PAL(3), EN, 0 }, { 228, 100, 0, PAL(4), EN, 0 }, { 234, 100, 0, PAL(5), EN, 0 },
+};
+
+static const SceneSprite clip_sprites[] = {
+    {  -5,  20, 1, SPRITE_SIZE_16x16 | PAL(1), EN, 0 },
+    {  30,  -7, 1, SPRITE_SIZE_16x16 | PAL(2) | SPRITE_ATTR_HFLIP, EN, 0 },
+    { -40, -40, 3, SPRITE_SIZE_64x64 | PAL(3), TR, 0 },
+    { DISPLAY_WIDTH - 3, 60, 1, SPRITE_SIZE_16x16 | PAL(4), EN, 0 },
+    { 100, DISPLAY_HEIGHT - 2, 1, SPRITE_SIZE_16x16 | PAL(5) | SPRITE_ATTR_VFLIP, EN, 0 },
+    { DISPLAY_WIDTH - 40, DISPLAY_HEIGHT - 40, 3, SPRITE_SIZE_64x64 | PAL(6) | SPRITE_ATTR_HFLIP, TR, 0 },
+    { -63, 150, 3, SPRITE_SIZE_64x64 | PAL(7), EN, 0 },
+    { DISPLAY_WIDTH - 1, 150, 7, SPRITE_SIZE_64x64 | PAL(1), EN, 0 },
+    { -8, 200, 0, SPRITE_SIZE_8x8 | PAL(2), EN, 0 }, // entirely off screen
+};
+
+#define BLEND(mode) (TR | ((mode) << SPRITE_CTRL_BLEND_SHIFT))
+
+static const SceneSprite blend_sprites[] = {
+    {  21,  31, 3, SPRITE_SIZE_64x64 | PAL(1), BLEND(BLEND_AVERAGE), 0 },
+    {  60,  40, 3, SPRITE_SIZE_64x64 | PAL(2), BLEND(BLEND_ADD), 0 },
+    { 100,  50, 3, SPRITE_SIZE_64x64 | PAL(3), BLEND(BLEND_SUBTRACT), 0 },
+    {  -3, 100, 2, SPRITE_SIZE_32x32 | PAL(4) | SPRITE_ATTR_HFLIP, BLEND(BLEND_ADD), 0 },
+    { DISPLAY_WIDTH - 17, 100, 2, SPRITE_SIZE_32x32 | PAL(5), BLEND(BLEND_AVERAGE), 0 },
+    {  40,  30, 7, SPRITE_SIZE_64x64 | PAL(6), TR, 0 },
+    { 120,  70, 7, SPRITE_SIZE_64x64 | PAL(7), EN, 0 },
+};
+
+static const TestScene scenes[SPRITE_TEST_SCENES] = {
+    { "flips",    flip_sprites,     count_of(flip_sprites) },
+    { "palettes", palette_sprites,  count_of(palette_sprites) },
+    { "priority", priority_sprites, count_of(priority_sprites) },
+    { "overflow", overflow_sprites, count_of(overflow_sprites) },
+    { "clipping", clip_sprites,     count_of(clip_sprites) },
+    { "blend",    blend_sprites,    count_of(blend_sprites) },
+};
+
+// crc32 of each scene's whole frame, for the panels we build for. the host
+// build checks and regenerates these, see host/CMakeLists.txt
+#if DISPLAY_WIDTH == 320 && DISPLAY_HEIGHT == 240 && MAX_SPRITES_PER_LINE == 32
+static const uint32_t golden_crcs[count_of(scenes)] = {
+    0xC02F206D, 0x21F1D1F0, 0x878FC4DC, 0x6ED0F03A, 0x7A2ADF1A, 0x8A55839A
+};
+#elif DISPLAY_WIDTH == 240 && DISPLAY_HEIGHT == 240 && MAX_SPRITES_PER_LINE == 32
+static const uint32_t golden_crcs[count_of(scenes)] = {
+    0xB4E8F420, 0x64A38A42, 0xE6D17D33, 0xF3D89E8A, 0x2591D395, 0xBF99B107
+};
+#else
+// every scene is still checked against the reference renderer
+#warning "no golden crcs for this display configuration, generate them with the host build (host/CMakeLists.txt)"
+#define NO_GOLDEN_CRCS
+#endif
+
+static uint16_t reference_line[DISPLAY_WIDTH];
+static uint8_t pattern_data[PATTERN_STRIDE];
+
+// asymmetric in both directions so a wrong flip shows, and with enough
+// zero texels to exercise transparency
+static uint8_t test_texel(uint8_t pattern, int16_t x, int16_t y) 
+{
+    return (x * 3 + y * 5 + pattern * 7 + ((x >> 2) & y)) & 0x0F;
+}
+
+// little endian rgb565, as the host sends it
+static uint16_t test_color(uint8_t palette, uint8_t color) 
+{
+    if (palette >= TEST_PALETTES) 
+        return 0;
+
+    return (((palette * 37 + color * 11) & 0x1F) << 11) | 
+           (((palette * 3 + color * 21) & 0x3F) << 5) | 
+           ((palette * 13 + color * 7) & 0x1F);
+}
+
+static void load_test_assets(void) 
+{
+    for (uint8_t pattern = 0; pattern < TEST_PATTERNS; pattern++) 
+    {
+        uint8_t size_code = pattern & SPRITE_ATTR_SIZE_MASK;
+        int16_t size = 8 << size_code;
+
+        for (int16_t y = 0; y < size; y++) 
+        {
+            for (int16_t x = 0; x < size; x += 2) 
+            {
+                pattern_data[(y * size + x) / 2] = (test_texel(pattern, x, y) << 4) | test_texel(pattern, x + 1, y);
+            }
+        }
+
+        pattern_load(pattern, pattern_data, size_code);
+    }
+}
+
+static bool load_scene(const TestScene* scene) 
+{
+    sprite_engine_reset();
+
+    for (uint8_t palette = 0; palette < TEST_PALETTES; palette++) 
+    {
+        uint16_t colors[COLORS_PER_PALETTE];
+        for (uint8_t color = 0; color < COLORS_PER_PALETTE; color++) 
+        {
+            colors[color] = test_color(palette, color);
+        }
+
+        palette_load(palette, colors);
+    }
+
+    uint8_t group = 0;
+
+    for (uint8_t i = 0; i < scene->count; i++) 
+    {
+        const SceneSprite* s = &scene->sprites[i];
+        bool grouped = s->x < 0 || s->y < 0;
+
+        Sprite sprite = {
+            .x = grouped ? 0 : s->x,
+            .y = grouped ? 0 : s->y,
+            .pattern = s->pattern,
+            .attr = s->attr,
+            .ctrl = s->ctrl,
+            .ext = s->ext
+        };
+
+        if (!sprite_update(i, &sprite)) 
+            return false;
+
+        // sprite positions are unsigned, a group origin can go off screen
+        if (grouped) 
+        {
+            SpriteGroupMember member = { .sprite_num = i, .x = 0, .y = 0 };
+
+            if (group >= MAX_SPRITE_GROUPS || 
+                !sprite_group_set(group, &member, 1) || 
+                !sprite_group_move(group, s->x, s->y, 0))
+                return false;
+
+            group++;
+        }
+    }
+
+    return true;
+}
+
+// the slow and obvious version of what the sprite engine does for one line
+static void render_reference_line(const TestScene* scene, uint16_t line, uint16_t* out) 
+{
+    uint8_t binned[MAX_SPRITES_PER_LINE];
+    uint8_t count = 0;
+
+    memset(out, 0, DISPLAY_WIDTH * sizeof(uint16_t));
+
+    for (uint8_t i = 0; i < scene->count && count < MAX_SPRITES_PER_LINE; i++) 
+    {
+        const SceneSprite* s = &scene->sprites[i];
+        int16_t size = 8 << (s->attr & SPRITE_ATTR_SIZE_MASK);
+
+        if ((s->ctrl & SPRITE_CTRL_ENABLE) && line >= s->y && line < s->y + size) 
+            binned[count++] = i;
+    }
+
+    for (int pass = 0; pass < 2; pass++) 
+    {
+        for (int n = count - 1; n >= 0; n--) 
+        {
+            const SceneSprite* s = &scene->sprites[binned[n]];
+            if (((s->attr & SPRITE_ATTR_PRIORITY) != 0) != pass) 
+                continue;
+
+            int16_t size = 8 << (s->attr & SPRITE_ATTR_SIZE_MASK);
+            int16_t row = line - s->y;
+            if (s->attr & SPRITE_ATTR_VFLIP) 
+                row = size - 1 - row;
+
+            uint8_t palette = sprite_palette_bank(s->attr, s->ext);
+            uint8_t mode = (s->ctrl & SPRITE_CTRL_BLEND_MASK) >> SPRITE_CTRL_BLEND_SHIFT;
+
+            for (int16_t px = 0; px < size; px++) 
+            {
+                int16_t x = s->x + px;
+                if (x < 0 || x >= DISPLAY_WIDTH) 
+                    continue;
+
+                int16_t column = (s->attr & SPRITE_ATTR_HFLIP) ? size - 1 - px : px;
+                uint8_t color = test_texel(s->pattern, column, row);
+                if (!color && (s->ctrl & SPRITE_CTRL_TRANS)) 
+                    continue;
+
+                uint16_t dst = __builtin_bswap16(out[x]);
+                out[x] = __builtin_bswap16(blend_pixel(dst, test_color(palette, color), mode));
+            }
+        }
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t len) 
+{
+    crc = ~crc;
+
+    while (len--) 
+    {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) 
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static bool run_scene(uint8_t n, uint16_t* frame, SpriteSceneResult* result) 
+{
+    const TestScene* scene = &scenes[n];
+
+    memset(result, 0, sizeof(*result));
+    result->name = scene->name;
+
+    if (!load_scene(scene)) 
+    {
+        printf("  %-9s FAIL: scene rejected by the engine\n", scene->name);
+        return false;
+    }
+
+    sprite_engine_start_frame();
+
+    uint32_t start = time_us_32();
+    for (uint16_t line = 0; line < DISPLAY_HEIGHT; line++) 
+    {
+        sprite_engine_render_line(line, frame + (line * DISPLAY_WIDTH), DISPLAY_WIDTH);
+    }
+    uint32_t engine_us = time_us_32() - start;
+
+    uint32_t reference_us = 0;
+    uint32_t mismatches = 0;
+    int16_t first_x = -1;
+    int16_t first_y = -1;
+
+    for (uint16_t line = 0; line < DISPLAY_HEIGHT; line++) 
+    {
+        start = time_us_32();
+        render_reference_line(scene, line, reference_line);
+        reference_us += time_us_32() - start;
+
+        const uint16_t* rendered = frame + (line * DISPLAY_WIDTH);
+        for (int16_t x = 0; x < DISPLAY_WIDTH; x++) 
+        {
+            if (rendered[x] == reference_line[x]) 
+                continue;
+
+            if (!mismatches++) 
+            {
+                first_x = x;
+                first_y = line;
+            }
+        }
+    }
+
+    uint32_t crc = crc32_update(0, (const uint8_t*)frame, DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint16_t));
+#ifdef NO_GOLDEN_CRCS
+    // only the reference comparison is left for other configurations
+    bool crc_ok = true;
+    const char* crc_note = " (no golden for this configuration)";
+#else
+    bool crc_ok = crc == golden_crcs[n];
+    const char* crc_note = crc_ok ? "" : " (golden mismatch)";
+#endif
+
+    printf("  %-9s %s: crc %08lx%s, engine %lu us, reference %lu us\n", scene->name, 
+           (!mismatches && crc_ok) ? "ok" : "FAIL", (unsigned long)crc, crc_note,
+           (unsigned long)engine_us, (unsigned long)reference_us);
+
+    if (mismatches) 
+    {
+        printf("    %lu pixels differ from the reference, first at %d,%d\n", (unsigned long)mismatches, first_x, first_y);
+    }
+
+    result->crc = crc;
+    result->engine_us = engine_us;
+    result->reference_us = reference_us;
+    result->mismatches = mismatches;
+#ifndef NO_GOLDEN_CRCS
+    result->has_golden = true;
+#endif
+    result->passed = !mismatches && crc_ok;
+
+    return result->passed;
+}
+
+bool run_sprite_test(void) 
+{
+    return run_sprite_test_results(NULL);
+}
+
+bool run_sprite_test_results(SpriteSceneResult results[SPRITE_TEST_SCENES]) 
+{
+    uint16_t* frame = display_get_next_buffer();
+    SpriteSceneResult scratch;
+    bool passed = true;
+
+    load_test_assets();
+
+    for (uint8_t n = 0; n < count_of(scenes); n++) 
+    {
+        passed = run_scene(n, frame, results ? &results[n] : &scratch) && passed;
+    }
+
+    // leave the engine as a host would expect to find it after boot
+    sprite_engine_reset();
+    memset(frame, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint16_t));
+
+    printf("Sprite test %s\n", passed ? "passed" : "FAILED");
+    return passed;
+}
+
+void run_display_test(void) 
+{
+    static const uint16_t bars[] = { 0xFFFF, 0xFFE0, 0x07FF, 0x07E0, 0xF81F, 0xF800, 0x001F, 0x0000 };
+    uint16_t* frame = display_get_next_buffer();
+
+    // color bars over the top half, channel ramps below
+    for (uint16_t y = 0; y < DISPLAY_HEIGHT; y++) 
+    {
+        for (uint16_t x = 0; x < DISPLAY_WIDTH; x++) 
+        {
+            uint16_t color;
+
+            if (y < DISPLAY_HEIGHT / 2) 
+            {
+                color = bars[(x * count_of(bars)) / DISPLAY_WIDTH];
+            }
+            else 
+            {
+                uint16_t ramp = (x * 32) / DISPLAY_WIDTH;
+                uint16_t band = ((y - DISPLAY_HEIGHT / 2) * 3) / (DISPLAY_HEIGHT - DISPLAY_HEIGHT / 2);
+                color = band == 0 ? (ramp << 11) : band == 1 ? ((ramp * 2) << 5) : ramp;
+            }
+
+            frame[(y * DISPLAY_WIDTH) + x] = __builtin_bswap16(color);
+        }
+    }
+
+    display_swap_buffers();
+    display_wait_for_frame_complete();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Boot time checks, run when built with TAKO_SELF_TEST.
+//
+// run_display_test puts color bars and gradients on the panel to check the
+// scanout path by eye.
+//
+// run_sprite_test renders scripted scenes (flips, palettes, priority,
+// per line overflow, clipping at the display edges, blending) with the
+// sprite engine. Every line must be pixel identical to a straightforward
+// per pixel reference renderer, and each frame's CRC must match the golden
+// value recorded for the scene. Both renderers are timed, the reference
+// being the baseline the engine's time is reported against.
+void run_display_test(void);
+bool run_sprite_test(void);
+
+#define SPRITE_TEST_SCENES 6
+
+typedef struct {
+    const char* name;
+    uint32_t crc;          // of the whole frame
+    uint32_t engine_us;
+    uint32_t reference_us;
+    uint32_t mismatches;   // pixels that differ from the reference renderer
+    bool has_golden;       // false for configurations without recorded goldens
+    bool passed;
+} SpriteSceneResult;
+
+// run_sprite_test handing back each scene's numbers, results may be NULL.
+// The host build (host/) regenerates the goldens and tracks the timings
+// against its baselines from these.
+bool run_sprite_test_results(SpriteSceneResult results[SPRITE_TEST_SCENES]);
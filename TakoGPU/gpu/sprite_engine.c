@@ -1,4 +1,5 @@
 #include "sprite_engine.h"
+#include "blend.h"
 #include "hardware/dma.h"
 #include <string.h>
 #include "../pins.h"
@@ -15,14 +16,84 @@ static uint engine_sm_compose;
 static int dma_chan_pattern;
 static int dma_chan_compose;
 
-#define DISPLAY_HEIGHT 320
-#define DISPLAY_WIDTH 480
-
 static Sprite sprite_table[MAX_SPRITES];
+
+// final per-frame sprite state, resolved from sprite_table and the groups
+// at the start of each frame. positions can be off screen, so they're signed.
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint16_t pattern;
+    uint8_t attr;
+    uint8_t ctrl;
+    uint8_t ext;
+    bool live;
+} FrameSprite;
+
+static FrameSprite frame_sprites[MAX_SPRITES];
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint8_t flip;
+} SpriteGroup;
+
+typedef struct {
+    uint8_t group;      // SPRITE_NO_GROUP if not grouped
+    uint8_t generation; // membership goes stale on reset like the sprite
+    int16_t x;          // offset from the group origin
+    int16_t y;
+} SpriteGroupLink;
+
+static SpriteGroup groups[MAX_SPRITE_GROUPS];
+static SpriteGroupLink group_links[MAX_SPRITES];
+
+typedef struct {
+    AnimationStep steps[MAX_ANIMATION_STEPS];
+    uint8_t count;
+    uint8_t flags;
+} Animation;
+
+typedef struct {
+    uint8_t anim;       // SPRITE_NO_ANIMATION if not animated
+    uint8_t generation;
+    uint8_t step;
+    uint8_t frames_left;
+    bool fresh;         // bound since the last advance, its first step hasn't shown yet
+} SpriteAnimation;
+
+static Animation animations[MAX_ANIMATIONS];
+static SpriteAnimation sprite_animations[MAX_SPRITES];
 static uint8_t sprites_per_line[DISPLAY_HEIGHT];
 static uint8_t line_sprite_indices[DISPLAY_HEIGHT][MAX_SPRITES_PER_LINE];
+// colors are kept in display byte order (big endian RGB565) so the
+// compositor can copy them straight into the line buffer
 static uint16_t palettes[SPRITE_PALETTES][COLORS_PER_PALETTE];
 
+// sprite and palette entries are only live while their generation matches
+// engine_generation, so a reset is a single increment instead of a memset
+static uint8_t engine_generation = 1;
+static uint8_t sprite_generation[MAX_SPRITES];
+static uint8_t palette_generation[SPRITE_PALETTES];
+
+static const uint16_t blank_palette[COLORS_PER_PALETTE];
+
+// one row of the widest pattern at 4bpp, when psram can't be read in place
+static uint8_t pattern_row[SPRITE_MAX_DIMENSION / 2];
+
+// colors of a blended sprite's row, waiting to be mixed into the line
+static uint16_t blend_row[SPRITE_MAX_DIMENSION];
+static uint8_t blend_opaque[SPRITE_MAX_DIMENSION];
+
+// collisions collect in pending while a frame is binned and composited, and
+// are latched into report at the start of the next frame
+static uint8_t collision_mode = COLLISION_MODE_OFF;
+static CollisionReport collision_pending;
+static CollisionReport collision_report;
+
+// sprite index + 1 of the topmost opaque texel on the current line
+static uint8_t line_owner[DISPLAY_WIDTH];
+
 bool sprite_engine_init(PIO pio, uint sm_lookup, uint sm_pattern, uint sm_compose) 
 {
     engine_pio = pio;
@@ -31,8 +102,26 @@ bool sprite_engine_init(PIO pio, uint sm_lookup, uint sm_pattern, uint sm_compos
     engine_sm_compose = sm_compose;
     
     memset(sprite_table, 0, sizeof(sprite_table));
+    memset(frame_sprites, 0, sizeof(frame_sprites));
+    memset(groups, 0, sizeof(groups));
+    memset(group_links, 0, sizeof(group_links));
+
+    memset(animations, 0, sizeof(animations));
+    memset(sprite_animations, 0, sizeof(sprite_animations));
+
+    for (int i = 0; i < MAX_SPRITES; i++) 
+    {
+        group_links[i].group = SPRITE_NO_GROUP;
+        sprite_animations[i].anim = SPRITE_NO_ANIMATION;
+    }
+
+    memset(sprite_generation, 0, sizeof(sprite_generation));
+    memset(palette_generation, 0, sizeof(palette_generation));
+    engine_generation = 1;
     memset(sprites_per_line, 0, sizeof(sprites_per_line));
     memset(palettes, 0, sizeof(palettes));
+    memset(&collision_pending, 0, sizeof(collision_pending));
+    memset(&collision_report, 0, sizeof(collision_report));
     
     uint offset_lookup = pio_add_program(pio, &sprite_lookup_program);
     uint offset_pattern = pio_add_program(pio, &sprite_pattern_program);
@@ -64,41 +153,271 @@ bool sprite_update(uint8_t index, const Sprite* sprite)
 {
     if ((index >= MAX_SPRITES) ||
         (sprite->x >= DISPLAY_WIDTH || sprite->y >= DISPLAY_HEIGHT) ||
-        ((sprite->attr & SPRITE_ATTR_SIZE_MASK) > SPRITE_SIZE_64x64))
+        ((sprite->attr & SPRITE_ATTR_SIZE_MASK) > SPRITE_MAX_SIZE))
         return false;
         
     sprite_table[index] = *sprite;
+    sprite_generation[index] = engine_generation;
 
     return true;
 }
 
-bool pattern_load(uint16_t pattern_num, const uint8_t* data, uint8_t size) 
+void sprite_engine_reset(void) 
 {
-    if (pattern_num >= MAX_PATTERNS) return false;
-    
-    uint32_t pattern_size;
+    engine_generation++;
+
+    // once the counter wraps, old entries could match again
+    if (!engine_generation) 
+    {
+        memset(sprite_generation, 0, sizeof(sprite_generation));
+        memset(palette_generation, 0, sizeof(palette_generation));
+
+        for (int i = 0; i < MAX_SPRITES; i++) 
+        {
+            group_links[i].generation = 0;
+            sprite_animations[i].generation = 0;
+        }
+
+        engine_generation = 1;
+    }
+
+    memset(&collision_pending, 0, sizeof(collision_pending));
+}
+
+static inline bool sprite_is_live(int index) 
+{
+    return sprite_generation[index] == engine_generation && 
+           (sprite_table[index].ctrl & SPRITE_CTRL_ENABLE);
+}
+
+static inline int16_t sprite_dimension(uint8_t attr) 
+{
+    return 8 << (attr & SPRITE_ATTR_SIZE_MASK);
+}
+
+bool sprite_group_set(uint8_t group, const SpriteGroupMember* members, uint8_t count) 
+{
+    if (group >= MAX_SPRITE_GROUPS) 
+        return false;
+
+    for (uint8_t n = 0; n < count; n++) 
+    {
+        if (members[n].sprite_num >= MAX_SPRITES) 
+            return false;
+    }
+
+    for (int i = 0; i < MAX_SPRITES; i++) 
+    {
+        if (group_links[i].group == group) 
+            group_links[i].group = SPRITE_NO_GROUP;
+    }
+
+    for (uint8_t n = 0; n < count; n++) 
+    {
+        SpriteGroupLink* link = &group_links[members[n].sprite_num];
+        link->group = group;
+        link->generation = engine_generation;
+        link->x = members[n].x;
+        link->y = members[n].y;
+    }
+
+    return true;
+}
+
+bool sprite_group_move(uint8_t group, int16_t x, int16_t y, uint8_t flip) 
+{
+    if (group >= MAX_SPRITE_GROUPS) 
+        return false;
+
+    groups[group].x = x;
+    groups[group].y = y;
+    groups[group].flip = flip & (SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP);
+
+    return true;
+}
+
+bool animation_load(uint8_t anim, const AnimationStep* steps, uint8_t count, uint8_t flags) 
+{
+    if (anim >= MAX_ANIMATIONS || !count || count > MAX_ANIMATION_STEPS) 
+        return false;
+
+    for (uint8_t n = 0; n < count; n++) 
+    {
+        if (steps[n].pattern >= MAX_PATTERNS) 
+            return false;
+    }
+
+    memcpy(animations[anim].steps, steps, count * sizeof(AnimationStep));
+    animations[anim].count = count;
+    animations[anim].flags = flags;
+
+    return true;
+}
+
+static inline uint8_t animation_step_duration(const AnimationStep* step) 
+{
+    return step->duration ? step->duration : 1;
+}
+
+bool sprite_bind_animation(uint8_t index, uint8_t anim, uint8_t start_step) 
+{
+    if (index >= MAX_SPRITES) 
+        return false;
+
+    SpriteAnimation* binding = &sprite_animations[index];
+
+    if (anim == SPRITE_NO_ANIMATION) 
+    {
+        binding->anim = SPRITE_NO_ANIMATION;
+        return true;
+    }
+
+    if (anim >= MAX_ANIMATIONS || start_step >= animations[anim].count) 
+        return false;
+
+    binding->anim = anim;
+    binding->generation = engine_generation;
+    binding->step = start_step;
+    binding->frames_left = animation_step_duration(&animations[anim].steps[start_step]);
+    binding->fresh = true;
+
+    return true;
+}
+
+static void advance_animations(void) 
+{
+    for (int i = 0; i < MAX_SPRITES; i++) 
+    {
+        SpriteAnimation* binding = &sprite_animations[i];
+        if (binding->anim == SPRITE_NO_ANIMATION || binding->generation != engine_generation) 
+            continue;
+
+        // the start step gets its whole duration, counting from the frame it's first drawn
+        if (binding->fresh) 
+        {
+            binding->fresh = false;
+            continue;
+        }
+
+        if (--binding->frames_left) 
+            continue;
+
+        const Animation* anim = &animations[binding->anim];
+        
+        if (binding->step + 1 < anim->count) 
+        {
+            binding->step++;
+        }
+        else if (anim->flags & ANIMATION_LOOP) 
+        {
+            binding->step = 0;
+        }
+        else
+        {
+            // hold the last step, reloading a shorter animation clamps it
+            binding->step = anim->count - 1;
+        }
+
+        binding->frames_left = animation_step_duration(&anim->steps[binding->step]);
+    }
+}
+
+static void resolve_sprites(void) 
+{
+    for (int i = 0; i < MAX_SPRITES; i++) 
+    {
+        FrameSprite* resolved = &frame_sprites[i];
+        const Sprite* sprite = &sprite_table[i];
+
+        resolved->live = sprite_is_live(i);
+        if (!resolved->live) 
+            continue;
+
+        resolved->x = sprite->x;
+        resolved->y = sprite->y;
+        resolved->pattern = sprite->pattern;
+        resolved->attr = sprite->attr;
+        resolved->ctrl = sprite->ctrl;
+        resolved->ext = sprite->ext;
+
+        const SpriteAnimation* binding = &sprite_animations[i];
+        if (binding->anim != SPRITE_NO_ANIMATION && binding->generation == engine_generation) 
+        {
+            const Animation* anim = &animations[binding->anim];
+            const AnimationStep* step = &anim->steps[binding->step < anim->count ? binding->step : anim->count - 1];
+
+            resolved->pattern = step->pattern;
+            resolved->attr ^= step->flip & (SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP);
+        }
+
+        const SpriteGroupLink* link = &group_links[i];
+        if (link->group == SPRITE_NO_GROUP || link->generation != engine_generation) 
+            continue;
+
+        const SpriteGroup* group = &groups[link->group];
+        int16_t size = sprite_dimension(sprite->attr);
+        int16_t x = link->x;
+        int16_t y = link->y;
+
+        // a flipped group mirrors each piece about the group origin and
+        // flips the piece itself
+        if (group->flip & SPRITE_ATTR_HFLIP) 
+        {
+            x = -x - size;
+            resolved->attr ^= SPRITE_ATTR_HFLIP;
+        }
+
+        if (group->flip & SPRITE_ATTR_VFLIP) 
+        {
+            y = -y - size;
+            resolved->attr ^= SPRITE_ATTR_VFLIP;
+        }
+
+        resolved->x = group->x + x;
+        resolved->y = group->y + y;
+    }
+}
+
+// first line a sprite is binned on
+static inline int16_t sprite_top_line(const FrameSprite* sprite) 
+{
+    return sprite->y < 0 ? 0 : sprite->y;
+}
+
+uint32_t pattern_data_size(uint8_t size) 
+{
+    if (size > SPRITE_MAX_SIZE) 
+        return 0;
 
     switch(size) 
     {
         case SPRITE_SIZE_8x8:       // 8x8x4bpp = 256 bits = 32 bytes
-            pattern_size = 32;   
-            break;
+            return 32;
         case SPRITE_SIZE_16x16:     // 16x16x4bpp = 1024 bits = 128 bytes
-            pattern_size = 128;  
-            break;
+            return 128;
         case SPRITE_SIZE_32x32:     // 32x32x4bpp = 4096 bits = 512 bytes
-            pattern_size = 512;  
-            break;
+            return 512;
         case SPRITE_SIZE_64x64:     // 64x64x4bpp = 16384 bits = 2048 bytes
-            pattern_size = 2048; 
-            break;
+            return 2048;
         default: 
-            return false;
+            return 0;
     }
+}
+
+uint32_t pattern_address(uint16_t pattern_num) 
+{
+    return PSRAM_SPRITE_BASE + (pattern_num * PATTERN_STRIDE);
+}
+
+bool pattern_load(uint16_t pattern_num, const uint8_t* data, uint8_t size) 
+{
+    if (pattern_num >= MAX_PATTERNS) return false;
     
-    uint32_t addr = PSRAM_SPRITE_BASE + (pattern_num * 2048);
+    uint32_t pattern_size = pattern_data_size(size);
+    if (!pattern_size) 
+        return false;
     
-    return aps6404_write(&psram, addr, data, pattern_size);
+    return aps6404_write(&psram, pattern_address(pattern_num), data, pattern_size);
 }
 
 bool palette_load(uint8_t palette_num, const uint16_t* colors) 
@@ -106,43 +425,119 @@ bool palette_load(uint8_t palette_num, const uint16_t* colors)
     if (palette_num >= SPRITE_PALETTES) 
         return false;
     
-    memcpy(palettes[palette_num], colors, COLORS_PER_PALETTE * sizeof(uint16_t));
+    for (int i = 0; i < COLORS_PER_PALETTE; i++) 
+    {
+        palettes[palette_num][i] = __builtin_bswap16(colors[i]);
+    }
+
+    palette_generation[palette_num] = engine_generation;
 
     return true;
 }
 
-void sprite_engine_start_frame(void) 
+// colors in display byte order, all black until the palette is loaded
+const uint16_t* palette_colors(uint8_t palette_num) 
+{
+    if (palette_num >= SPRITE_PALETTES || palette_generation[palette_num] != engine_generation) 
+        return blank_palette;
+
+    return palettes[palette_num];
+}
+
+static void collision_record(uint8_t a, uint8_t b) 
+{
+    collision_pending.sprite_mask[a >> 3] |= 1 << (a & 7);
+    collision_pending.sprite_mask[b >> 3] |= 1 << (b & 7);
+
+    if (a > b) 
+    {
+        uint8_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    for (int i = 0; i < collision_pending.pair_count; i++) 
+    {
+        if (collision_pending.pairs[i][0] == a && collision_pending.pairs[i][1] == b) 
+            return;
+    }
+
+    if (collision_pending.pair_count >= MAX_COLLISION_PAIRS) 
+    {
+        collision_pending.overflow = 1;
+        return;
+    }
+
+    collision_pending.pairs[collision_pending.pair_count][0] = a;
+    collision_pending.pairs[collision_pending.pair_count][1] = b;
+    collision_pending.pair_count++;
+}
+
+// two sprites overlap vertically only if the top line of one falls inside the
+// other, so each sprite is tested against the bin of its own top line. that
+// bounds the work at MAX_SPRITES * MAX_SPRITES_PER_LINE tests per frame.
+static void collision_find_boxes(void) 
 {
-    memset(sprites_per_line, 0, sizeof(sprites_per_line));
-    
     for (int i = 0; i < MAX_SPRITES; i++) 
     {
-        if (!(sprite_table[i].ctrl & SPRITE_CTRL_ENABLE)) 
+        const FrameSprite* a = &frame_sprites[i];
+        if (!a->live) 
             continue;
-        
-        uint16_t sprite_height;
-        switch(sprite_table[i].attr & SPRITE_ATTR_SIZE_MASK) 
+
+        int16_t a_top = sprite_top_line(a);
+        if (a_top >= DISPLAY_HEIGHT) 
+            continue;
+
+        int16_t a_size = sprite_dimension(a->attr);
+
+        for (int n = 0; n < sprites_per_line[a_top]; n++) 
         {
-            case SPRITE_SIZE_8x8:
-                sprite_height = 8;  
-                break;
-            case SPRITE_SIZE_16x16: 
-                sprite_height = 16; 
-                break;
-            case SPRITE_SIZE_32x32: 
-                sprite_height = 32; 
-                break;
-            case SPRITE_SIZE_64x64:
-                sprite_height = 64; 
-                break;
-            default: 
+            uint8_t j = line_sprite_indices[a_top][n];
+            const FrameSprite* b = &frame_sprites[j];
+
+            // pairs starting on the same line are only counted once
+            if (j == i || (sprite_top_line(b) == a_top && j > i)) 
                 continue;
+
+            int16_t b_size = sprite_dimension(b->attr);
+            if (a->x < b->x + b_size && b->x < a->x + a_size) 
+            {
+                collision_record(i, j);
+            }
         }
+    }
+}
+
+void sprite_engine_set_collision_mode(uint8_t mode) 
+{
+    collision_mode = mode;
+}
+
+void sprite_engine_get_collisions(CollisionReport* report) 
+{
+    *report = collision_report;
+}
+
+void sprite_engine_start_frame(void) 
+{
+    collision_report = collision_pending;
+    memset(&collision_pending, 0, sizeof(collision_pending));
+
+    memset(sprites_per_line, 0, sizeof(sprites_per_line));
+
+    advance_animations();
+    resolve_sprites();
+    
+    for (int i = 0; i < MAX_SPRITES; i++) 
+    {
+        const FrameSprite* sprite = &frame_sprites[i];
+        if (!sprite->live) 
+            continue;
         
-        uint16_t start_line = sprite_table[i].y;
-        uint16_t end_line = start_line + sprite_height;
+        int16_t start_line = sprite_top_line(sprite);
+        int16_t end_line = sprite->y + sprite_dimension(sprite->attr);
         
-        for (uint16_t line = start_line; line < end_line && line < DISPLAY_HEIGHT; line++) 
+        for (int16_t line = start_line; line < end_line && line < DISPLAY_HEIGHT; line++) 
         {
             if (sprites_per_line[line] < MAX_SPRITES_PER_LINE) 
             {
@@ -150,6 +545,11 @@ void sprite_engine_start_frame(void)
             }
         }
     }
+
+    if (collision_mode == COLLISION_MODE_BOX) 
+    {
+        collision_find_boxes();
+    }
 }
 
 void sprite_engine_prepare_line(uint16_t line) 
@@ -162,11 +562,187 @@ void sprite_engine_prepare_line(uint16_t line)
     }
 }
 
+// mixes count pixels of src into the line two at a time, one 32-bit word
+// per pair. the line buffer is word aligned, so pairs start on even x.
+static void blend_span(uint16_t* line_buffer, int16_t x, int16_t count, const uint16_t* src, const uint8_t* opaque, uint8_t mode) 
+{
+    int16_t n = 0;
+
+    if ((x & 1) && count) 
+    {
+        if (opaque[0]) 
+            line_buffer[x] = __builtin_bswap16(blend_pixel(__builtin_bswap16(line_buffer[x]), __builtin_bswap16(src[0]), mode));
+        n = 1;
+    }
+
+    for (; n + 1 < count; n += 2) 
+    {
+        uint32_t mask = (opaque[n] ? 0x0000FFFFu : 0) | (opaque[n + 1] ? 0xFFFF0000u : 0);
+        if (!mask) 
+            continue;
+
+        uint32_t* word = (uint32_t*)&line_buffer[x + n];
+        uint32_t dst = *word;
+        uint32_t pair = src[n] | ((uint32_t)src[n + 1] << 16);
+        uint32_t mixed = blend_swap_pixels(blend_pair(blend_swap_pixels(dst), blend_swap_pixels(pair), mode));
+
+        *word = (mixed & mask) | (dst & ~mask);
+    }
+
+    if (n < count && opaque[n]) 
+    {
+        line_buffer[x + n] = __builtin_bswap16(blend_pixel(__builtin_bswap16(line_buffer[x + n]), __builtin_bswap16(src[n]), mode));
+    }
+}
+
+// size is a constant in each specialization below, so the row addressing
+// and flips fold away and the narrow sizes unroll
+static inline __attribute__((always_inline)) void compose_sprite_row_sized(uint8_t index, uint16_t line, uint16_t* line_buffer, 
+                                                                          uint16_t width, const int16_t size) 
+{
+    const FrameSprite* sprite = &frame_sprites[index];
+
+    if (sprite->x >= width || sprite->x + size <= 0) 
+        return;
+
+    int16_t row = line - sprite->y;
+    if (sprite->attr & SPRITE_ATTR_VFLIP) 
+        row = size - 1 - row;
+
+    uint16_t row_bytes = size / 2;
+    uint32_t addr = pattern_address(sprite->pattern) + (row * row_bytes);
+    const uint8_t* row_data = aps6404_mapped(&psram, addr);
+    if (!row_data) 
+    {
+        aps6404_read(&psram, addr, pattern_row, row_bytes);
+        row_data = pattern_row;
+    }
+
+    const uint16_t* palette = palette_colors(sprite_palette_bank(sprite->attr, sprite->ext));
+    bool transparent = (sprite->ctrl & SPRITE_CTRL_TRANS) != 0;
+    bool hflip = (sprite->attr & SPRITE_ATTR_HFLIP) != 0;
+
+    // clip against both edges of the line
+    int16_t first = sprite->x < 0 ? -sprite->x : 0;
+    int16_t last = size;
+    if (sprite->x + size > width) 
+        last = width - sprite->x;
+
+    bool collide = collision_mode == COLLISION_MODE_PIXEL;
+    uint8_t blend = (sprite->ctrl & SPRITE_CTRL_BLEND_MASK) >> SPRITE_CTRL_BLEND_SHIFT;
+
+    if (blend) 
+    {
+        memset(blend_opaque, 0, size);
+    }
+
+    for (int16_t px = first; px < last; px++) 
+    {
+        int16_t src = hflip ? (size - 1 - px) : px;
+        
+        // left pixel is in the high nibble
+        uint8_t color = (row_data[src >> 1] >> ((src & 1) ? 0 : 4)) & 0x0F;
+        if (!color && transparent) 
+            continue;
+        
+        int16_t x = sprite->x + px;
+        if (blend) 
+        {
+            blend_row[px] = palette[color];
+            blend_opaque[px] = 1;
+        }
+        else 
+        {
+            line_buffer[x] = palette[color];
+        }
+
+        // only the topmost texel is remembered per pixel, so three sprites
+        // stacked on one pixel report the two adjacent pairs
+        if (collide) 
+        {
+            if (line_owner[x] && line_owner[x] != index + 1) 
+            {
+                collision_record(index, line_owner[x] - 1);
+            }
+
+            line_owner[x] = index + 1;
+        }
+    }
+
+    if (blend && first < last) 
+    {
+        blend_span(line_buffer, sprite->x + first, last - first, blend_row + first, blend_opaque + first, blend);
+    }
+}
+
+static void compose_sprite_row(uint8_t index, uint16_t line, uint16_t* line_buffer, uint16_t width) 
+{
+    switch (frame_sprites[index].attr & SPRITE_ATTR_SIZE_MASK) 
+    {
+        case SPRITE_SIZE_8x8:
+            compose_sprite_row_sized(index, line, line_buffer, width, 8);
+            break;
+#if SPRITE_MAX_SIZE >= SPRITE_SIZE_16x16
+        case SPRITE_SIZE_16x16:
+            compose_sprite_row_sized(index, line, line_buffer, width, 16);
+            break;
+#endif
+#if SPRITE_MAX_SIZE >= SPRITE_SIZE_32x32
+        case SPRITE_SIZE_32x32:
+            compose_sprite_row_sized(index, line, line_buffer, width, 32);
+            break;
+#endif
+#if SPRITE_MAX_SIZE >= SPRITE_SIZE_64x64
+        case SPRITE_SIZE_64x64:
+            compose_sprite_row_sized(index, line, line_buffer, width, 64);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+void sprite_engine_render_line(uint16_t line, uint16_t* line_buffer, uint16_t width) 
+{
+    memset(line_buffer, 0, width * sizeof(uint16_t));
+    sprite_engine_compose_line(line, line_buffer, width);
+}
+
+// draws the line's sprites over whatever the buffer already holds
+void sprite_engine_compose_line(uint16_t line, uint16_t* line_buffer, uint16_t width) 
+{
+    if (line >= DISPLAY_HEIGHT) 
+        return;
+
+    if (collision_mode == COLLISION_MODE_PIXEL) 
+    {
+        memset(line_owner, 0, sizeof(line_owner));
+    }
+
+    // lower sprite index wins and priority sprites sit above the rest, so
+    // draw back to front: normal sprites first, then priority ones
+    for (int pass = 0; pass < 2; pass++) 
+    {
+        uint8_t priority = pass ? SPRITE_ATTR_PRIORITY : 0;
+
+        for (int n = sprites_per_line[line] - 1; n >= 0; n--) 
+        {
+            uint8_t index = line_sprite_indices[line][n];
+            if ((frame_sprites[index].attr & SPRITE_ATTR_PRIORITY) != priority) 
+                continue;
+
+            compose_sprite_row(index, line, line_buffer, width);
+        }
+    }
+}
+
 const Sprite *get_sprite_from_table(uint8_t index)
 {
+    static const Sprite blank_sprite;
+
     if (index < MAX_SPRITES) 
     {
-        return &sprite_table[index];
+        return sprite_generation[index] == engine_generation ? &sprite_table[index] : &blank_sprite;
     }
     
     return NULL;
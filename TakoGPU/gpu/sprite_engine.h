@@ -3,12 +3,11 @@
 #include <stdint.h>
 #include "hardware/pio.h"
 #include "aps6404.h"
+#include "gpu_config.h"
 
-#define MAX_PATTERNS 1024
+// every pattern gets a slot sized for SPRITE_MAX_SIZE
+#define MAX_PATTERNS (PSRAM_SPRITE_SIZE / PATTERN_STRIDE)
 
-#define MAX_SPRITES 128
-#define MAX_SPRITES_PER_LINE 32
-#define SPRITE_PALETTES 16
 #define COLORS_PER_PALETTE 16
 
 #define SPRITE_SIZE_8x8     0
@@ -24,6 +23,11 @@
 
 #define SPRITE_CTRL_ENABLE      0x01
 #define SPRITE_CTRL_TRANS       0x02
+#define SPRITE_CTRL_BLEND_MASK  0x0C // BLEND_NONE, BLEND_AVERAGE, BLEND_ADD, BLEND_SUBTRACT
+#define SPRITE_CTRL_BLEND_SHIFT 2
+
+// extended attributes
+#define SPRITE_EXT_PALETTE_HI   0x07 // palette bank bits 3-5 (attr holds bits 0-2)
 
 typedef struct __attribute__((packed)) {
     uint16_t x;
@@ -31,18 +35,76 @@ typedef struct __attribute__((packed)) {
     uint16_t pattern;
     uint8_t attr;
     uint8_t ctrl;
+    uint8_t ext;
 } Sprite;
 
+// collision detection
+#define COLLISION_MODE_OFF      0
+#define COLLISION_MODE_BOX      1 // bounding box overlap, found while binning
+#define COLLISION_MODE_PIXEL    2 // overlap of non-transparent texels, found while compositing
+
+#define MAX_COLLISION_PAIRS     32
+
+typedef struct __attribute__((packed)) {
+    uint8_t sprite_mask[MAX_SPRITES / 8]; // bit n set if sprite n collided with anything
+    uint8_t pair_count;
+    uint8_t overflow;                     // more pairs than MAX_COLLISION_PAIRS
+    uint8_t pairs[MAX_COLLISION_PAIRS][2];
+} CollisionReport;
+
+static inline uint8_t sprite_palette_bank(uint8_t attr, uint8_t ext)
+{
+    return ((ext & SPRITE_EXT_PALETTE_HI) << 3) | ((attr & SPRITE_ATTR_PALETTE) >> 4);
+}
+
+// sprite groups (metasprites). a member's own x/y is ignored, it is drawn at
+// the group origin plus its offset, mirrored when the group is flipped.
+#define MAX_SPRITE_GROUPS       16
+#define SPRITE_NO_GROUP         0xFF
+
+typedef struct __attribute__((packed)) {
+    uint8_t sprite_num;
+    int16_t x; // offset from the group origin
+    int16_t y;
+} SpriteGroupMember;
+
+// animation sequencer. a bound sprite steps through the animation on its
+// own, the host only sends a command when the animation changes.
+#define MAX_ANIMATIONS          32
+#define MAX_ANIMATION_STEPS     16
+#define SPRITE_NO_ANIMATION     0xFF
+
+#define ANIMATION_LOOP          0x01 // otherwise holds the last step
+
+typedef struct __attribute__((packed)) {
+    uint16_t pattern;
+    uint8_t duration; // frames
+    uint8_t flip;     // SPRITE_ATTR_HFLIP | SPRITE_ATTR_VFLIP, applied on top of the sprite's
+} AnimationStep;
+
 bool sprite_engine_init(PIO pio, uint sm_lookup, uint sm_pattern, uint sm_compose);
+void sprite_engine_reset(void);
 
 bool sprite_update(uint8_t index, const Sprite* sprite);
 bool sprite_enable(uint8_t index);
+bool sprite_group_set(uint8_t group, const SpriteGroupMember* members, uint8_t count);
+bool sprite_group_move(uint8_t group, int16_t x, int16_t y, uint8_t flip);
+bool animation_load(uint8_t anim, const AnimationStep* steps, uint8_t count, uint8_t flags);
+bool sprite_bind_animation(uint8_t index, uint8_t anim, uint8_t start_step);
 bool sprite_disable(uint8_t index);
 
+uint32_t pattern_data_size(uint8_t size);
+uint32_t pattern_address(uint16_t pattern_num);
 bool pattern_load(uint16_t pattern_num, const uint8_t* data, uint8_t size);
 bool palette_load(uint8_t palette_num, const uint16_t* colors);
+const uint16_t* palette_colors(uint8_t palette_num);
 
 void sprite_engine_start_frame(void);
 void sprite_engine_prepare_line(uint16_t line);
+void sprite_engine_render_line(uint16_t line, uint16_t* line_buffer, uint16_t width);
+void sprite_engine_compose_line(uint16_t line, uint16_t* line_buffer, uint16_t width);
+
+void sprite_engine_set_collision_mode(uint8_t mode);
+void sprite_engine_get_collisions(CollisionReport* report);
 
 const Sprite *get_sprite_from_table(uint8_t index);
\ No newline at end of file
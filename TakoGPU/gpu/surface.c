@@ -0,0 +1,189 @@
+#include "surface.h"
+#include "display.h"
+#include "aps6404.h"
+#include "pico/time.h"
+#include "../externs.h"
+#include <string.h>
+
+static Surface surfaces[MAX_SURFACES];
+static uint32_t surface_alloc_pos;
+
+static uint8_t background = SURFACE_NONE;
+static uint16_t background_x;
+static uint16_t background_y;
+
+static uint8_t capture = SURFACE_NONE;
+static int16_t capture_x;
+static int16_t capture_y;
+
+static SurfaceStats stats;
+
+void surface_init(void) 
+{
+    memset(surfaces, 0, sizeof(surfaces));
+    surface_alloc_pos = PSRAM_FRAME_BUFFER_BASE;
+    background = SURFACE_NONE;
+    capture = SURFACE_NONE;
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool surface_create(uint8_t id, uint16_t width, uint16_t height) 
+{
+    if (id >= MAX_SURFACES || !width || width > SURFACE_MAX_WIDTH || !height || id == background || id == capture) 
+        return false;
+
+    Surface* surface = &surfaces[id];
+    uint32_t size = (uint32_t)width * height * sizeof(uint16_t);
+
+    // like display lists, space is only handed out and a surface keeps its slot
+    if (size > surface->capacity) 
+    {
+        if (surface_alloc_pos + size > PSRAM_FRAME_BUFFER_BASE + PSRAM_FRAME_BUFFER_SIZE) 
+            return false;
+
+        surface->addr = surface_alloc_pos;
+        surface->capacity = size;
+        surface_alloc_pos += size;
+    }
+
+    surface->width = width;
+    surface->height = height;
+    surface->stride = width * sizeof(uint16_t);
+
+    return true;
+}
+
+const Surface* surface_get(uint8_t id) 
+{
+    if (id >= MAX_SURFACES || !surfaces[id].capacity) 
+        return NULL;
+
+    return &surfaces[id];
+}
+
+bool surface_capture_next_frame(uint8_t id, int16_t x, int16_t y) 
+{
+    if (!surface_get(id) || id == background || 
+        x < 0 || y < 0 || x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT)
+        return false;
+
+    capture = id;
+    capture_x = x;
+    capture_y = y;
+
+    return true;
+}
+
+void surface_capture_band(const uint16_t* frame, uint16_t first_line, uint16_t end_line) 
+{
+    if (capture == SURFACE_NONE) 
+        return;
+
+    const Surface* surface = &surfaces[capture];
+
+    uint16_t width = surface->width;
+    if (capture_x + width > DISPLAY_WIDTH) 
+        width = DISPLAY_WIDTH - capture_x;
+
+    int32_t first = first_line > capture_y ? first_line : capture_y;
+    int32_t end = capture_y + surface->height;
+    if (end > end_line) 
+        end = end_line;
+
+    for (int32_t line = first; line < end; line++) 
+    {
+        uint32_t addr = surface->addr + ((line - capture_y) * surface->stride);
+        aps6404_write(&psram, addr, (const uint8_t*)(frame + (line * DISPLAY_WIDTH) + capture_x), width * sizeof(uint16_t));
+    }
+}
+
+bool surface_set_background(uint8_t id, uint16_t scroll_x, uint16_t scroll_y) 
+{
+    if (id == SURFACE_NONE) 
+    {
+        background = SURFACE_NONE;
+        return true;
+    }
+
+    if (!surface_get(id) || id == capture) 
+        return false;
+
+    background = id;
+    background_x = scroll_x % surfaces[id].width;
+    background_y = scroll_y % surfaces[id].height;
+
+    return true;
+}
+
+bool surface_background_active(void) 
+{
+    return background != SURFACE_NONE;
+}
+
+// fills one line from the background row, repeating the surface if it's
+// narrower than the screen
+static void fetch_line(const Surface* surface, uint16_t* dst, uint16_t row) 
+{
+    uint32_t row_addr = surface->addr + (row * surface->stride);
+    uint16_t x = background_x;
+    uint16_t filled = 0;
+
+    while (filled < DISPLAY_WIDTH) 
+    {
+        uint16_t count = surface->width - x;
+        if (count > DISPLAY_WIDTH - filled) 
+            count = DISPLAY_WIDTH - filled;
+
+        aps6404_read(&psram, row_addr + (x * sizeof(uint16_t)), (uint8_t*)(dst + filled), count * sizeof(uint16_t));
+        stats.reads++;
+
+        filled += count;
+        x = 0;
+    }
+}
+
+void surface_fetch_band(uint16_t* frame, uint16_t first_line, uint16_t end_line) 
+{
+    if (background == SURFACE_NONE) 
+        return;
+
+    uint32_t start = time_us_32();
+    const Surface* surface = &surfaces[background];
+    uint16_t lines = end_line - first_line;
+    uint16_t first_row = (first_line + background_y) % surface->height;
+
+    // a screen wide, unscrolled surface is laid out like the frame, so the
+    // band comes over as one sequential read unless it wraps vertically
+    if (surface->width == DISPLAY_WIDTH && !background_x && first_row + lines <= surface->height) 
+    {
+        aps6404_read(&psram, surface->addr + (first_row * surface->stride), 
+                     (uint8_t*)(frame + (first_line * DISPLAY_WIDTH)), lines * surface->stride);
+        stats.reads++;
+    }
+    else 
+    {
+        uint16_t row = first_row;
+        for (uint16_t line = first_line; line < end_line; line++) 
+        {
+            fetch_line(surface, frame + (line * DISPLAY_WIDTH), row);
+
+            if (++row == surface->height) 
+                row = 0;
+        }
+    }
+
+    stats.lines += lines;
+    stats.time_us += time_us_32() - start;
+}
+
+void surface_finish_frame(void) 
+{
+    capture = SURFACE_NONE;
+}
+
+SurfaceStats surface_take_stats(void) 
+{
+    SurfaceStats taken = stats;
+    memset(&stats, 0, sizeof(stats));
+    return taken;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Offscreen RGB565 surfaces in the psram frame buffer region, in display
+// byte order like the frame buffer. A frame can be captured into one, and
+// one can stand in for the black clear as the background of every frame.
+#define MAX_SURFACES            8
+#define SURFACE_NONE            0xFF
+
+// widest a surface can be while its stride still fits the uint16 field
+#define SURFACE_MAX_WIDTH       (UINT16_MAX / sizeof(uint16_t))
+
+typedef struct {
+    uint32_t addr;     // 0 until created
+    uint32_t capacity; // bytes reserved, kept when the surface is recreated smaller
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;   // bytes per row
+} Surface;
+
+typedef struct {
+    uint32_t lines;   // background lines fetched
+    uint32_t reads;   // psram reads they took
+    uint32_t time_us;
+} SurfaceStats;
+
+void surface_init(void);
+
+bool surface_create(uint8_t id, uint16_t width, uint16_t height);
+const Surface* surface_get(uint8_t id);
+
+// the frame region at x, y the size of the surface is copied into it
+// while the next frame is drawn, before text and rect copies
+bool surface_capture_next_frame(uint8_t id, int16_t x, int16_t y);
+void surface_capture_band(const uint16_t* frame, uint16_t first_line, uint16_t end_line);
+
+// the background wraps in both directions, SURFACE_NONE turns it off
+bool surface_set_background(uint8_t id, uint16_t scroll_x, uint16_t scroll_y);
+bool surface_background_active(void);
+void surface_fetch_band(uint16_t* frame, uint16_t first_line, uint16_t end_line);
+
+void surface_finish_frame(void);
+
+SurfaceStats surface_take_stats(void);
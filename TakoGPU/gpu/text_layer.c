@@ -0,0 +1,152 @@
+#include "text_layer.h"
+#include "sprite_engine.h"
+#include "aps6404.h"
+#include "../externs.h"
+#include <string.h>
+
+typedef struct {
+    uint8_t glyph;
+    uint8_t palette;
+} TextCell;
+
+typedef struct {
+    uint16_t tag; // glyph code + 1, 0 when empty
+    uint8_t data[TEXT_MAX_GLYPH_HEIGHT * 2];
+} GlyphSlot;
+
+static TextCell cells[TEXT_ROWS][TEXT_COLUMNS];
+static uint8_t cells_used[TEXT_ROWS]; // non empty cells per row, so blank rows cost nothing
+
+static GlyphSlot glyph_cache[TEXT_GLYPH_CACHE_SLOTS];
+
+static uint8_t font_bpp;
+static uint8_t font_height; // 0 until a font is loaded
+static uint16_t font_glyphs;
+static uint16_t font_glyph_bytes;
+
+uint32_t text_font_size(uint8_t bpp, uint8_t height, uint16_t glyph_count) 
+{
+    if ((bpp != 1 && bpp != 2) || 
+        height < TEXT_MIN_GLYPH_HEIGHT || height > TEXT_MAX_GLYPH_HEIGHT || 
+        !glyph_count || glyph_count > 256)
+        return 0;
+
+    return (uint32_t)glyph_count * height * bpp;
+}
+
+// called once the atlas is in psram
+bool text_font_set(uint8_t bpp, uint8_t height, uint16_t glyph_count) 
+{
+    if (!text_font_size(bpp, height, glyph_count)) 
+        return false;
+
+    font_bpp = bpp;
+    font_height = height;
+    font_glyphs = glyph_count;
+    font_glyph_bytes = height * bpp;
+
+    memset(glyph_cache, 0, sizeof(glyph_cache));
+
+    return true;
+}
+
+bool text_write(uint8_t column, uint8_t row, uint8_t palette, const uint8_t* glyphs, uint8_t length) 
+{
+    if (row >= TEXT_ROWS || column >= TEXT_COLUMNS || palette >= SPRITE_PALETTES) 
+        return false;
+
+    // no wrapping, the rest of the string is dropped at the edge
+    if (length > TEXT_COLUMNS - column) 
+        length = TEXT_COLUMNS - column;
+
+    for (uint8_t n = 0; n < length; n++) 
+    {
+        TextCell* cell = &cells[row][column + n];
+
+        if (cell->glyph != TEXT_GLYPH_EMPTY) 
+            cells_used[row]--;
+
+        if (glyphs[n] != TEXT_GLYPH_EMPTY) 
+            cells_used[row]++;
+
+        cell->glyph = glyphs[n];
+        cell->palette = palette;
+    }
+
+    return true;
+}
+
+bool text_clear_rows(uint8_t first_row, uint8_t row_count) 
+{
+    if (first_row >= TEXT_ROWS || row_count > TEXT_ROWS - first_row) 
+        return false;
+
+    memset(cells[first_row], 0, row_count * sizeof(cells[0]));
+    memset(&cells_used[first_row], 0, row_count);
+
+    return true;
+}
+
+void text_layer_clear(void) 
+{
+    memset(cells, 0, sizeof(cells));
+    memset(cells_used, 0, sizeof(cells_used));
+}
+
+static const uint8_t* glyph_data(uint8_t glyph) 
+{
+    GlyphSlot* slot = &glyph_cache[glyph % TEXT_GLYPH_CACHE_SLOTS];
+
+    if (slot->tag != glyph + 1) 
+    {
+        aps6404_read(&psram, PSRAM_FONT_BASE + (glyph * font_glyph_bytes), slot->data, font_glyph_bytes);
+        slot->tag = glyph + 1;
+    }
+
+    return slot->data;
+}
+
+void text_layer_render_line(uint16_t line, uint16_t* line_buffer) 
+{
+    if (!font_height) 
+        return;
+
+    uint16_t row = line / font_height;
+    if (row >= TEXT_ROWS || !cells_used[row]) 
+        return;
+
+    uint8_t glyph_y = line % font_height;
+
+    for (uint8_t column = 0; column < TEXT_COLUMNS; column++) 
+    {
+        const TextCell* cell = &cells[row][column];
+        if (cell->glyph == TEXT_GLYPH_EMPTY || cell->glyph >= font_glyphs) 
+            continue;
+
+        const uint8_t* bits = glyph_data(cell->glyph) + (glyph_y * font_bpp);
+        const uint16_t* palette = palette_colors(cell->palette);
+        uint16_t* dst = line_buffer + (column * TEXT_CELL_WIDTH);
+
+        if (font_bpp == 1) 
+        {
+            // only set bits are visited, blank rows of a glyph cost one test
+            uint8_t set = bits[0];
+            while (set) 
+            {
+                int px = __builtin_clz(set) - 24;
+                dst[px] = palette[1];
+                set &= ~(0x80 >> px);
+            }
+        }
+        else 
+        {
+            uint16_t pixels = (bits[0] << 8) | bits[1];
+            for (int px = 0; pixels; px++, pixels <<= 2) 
+            {
+                uint8_t color = (pixels >> 14) & 0x03;
+                if (color) 
+                    dst[px] = palette[color];
+            }
+        }
+    }
+}
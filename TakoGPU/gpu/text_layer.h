@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "display.h"
+
+// Character cell text layer drawn over sprites and blits. Glyphs are 8
+// pixels wide and come from a font atlas uploaded once into psram; cells
+// hold a glyph code and the sprite palette its colors come from.
+#define TEXT_CELL_WIDTH          8
+#define TEXT_MIN_GLYPH_HEIGHT    8
+#define TEXT_MAX_GLYPH_HEIGHT    16
+#define TEXT_COLUMNS             (DISPLAY_WIDTH / TEXT_CELL_WIDTH)
+#define TEXT_ROWS                (DISPLAY_HEIGHT / TEXT_MIN_GLYPH_HEIGHT)
+
+// glyphs are read from psram a whole glyph at a time into a direct mapped
+// cache, indexed by the low bits of the glyph code
+#define TEXT_GLYPH_CACHE_SLOTS   128
+
+#define TEXT_GLYPH_EMPTY         0 // cells holding glyph 0 are skipped
+
+// Atlas layout: glyph n starts at n * height * bpp. Each glyph row is bpp
+// bytes with the leftmost pixel in the high bits. Color 0 is transparent,
+// 1bpp glyphs use palette color 1, 2bpp glyphs colors 1-3.
+uint32_t text_font_size(uint8_t bpp, uint8_t height, uint16_t glyph_count);
+bool text_font_set(uint8_t bpp, uint8_t height, uint16_t glyph_count);
+
+bool text_write(uint8_t column, uint8_t row, uint8_t palette, const uint8_t* glyphs, uint8_t length);
+bool text_clear_rows(uint8_t first_row, uint8_t row_count);
+void text_layer_clear(void);
+
+void text_layer_render_line(uint16_t line, uint16_t* line_buffer);
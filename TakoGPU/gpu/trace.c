@@ -0,0 +1,47 @@
+#include "trace.h"
+#include "hardware/clocks.h"
+#include <stdio.h>
+#include <string.h>
+
+TraceEvent trace_ring[TRACE_RING_SIZE];
+volatile uint32_t trace_head;
+
+// copies events from position from onward. if they've been overwritten the
+// read starts at the oldest event still in the ring, returned in first.
+uint8_t trace_read(uint32_t from, TraceEvent* events, uint8_t max_events, uint32_t* first) 
+{
+    uint32_t head = trace_head;
+    uint32_t oldest = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    if ((int32_t)(from - oldest) < 0) 
+        from = oldest;
+
+    if ((int32_t)(head - from) < 0) 
+        from = head;
+
+    uint32_t count = head - from;
+    if (count > max_events) 
+        count = max_events;
+
+    for (uint32_t n = 0; n < count; n++) 
+    {
+        events[n] = trace_ring[(from + n) & (TRACE_RING_SIZE - 1)];
+    }
+
+    *first = from;
+    return (uint8_t)count;
+}
+
+void trace_dump(void) 
+{
+    uint32_t head = trace_head;
+    uint32_t from = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    printf("trace: %lu events, %lu hz\n", (unsigned long)(head - from), (unsigned long)clock_get_hz(clk_sys));
+
+    for (uint32_t n = from; n != head; n++) 
+    {
+        const TraceEvent* event = &trace_ring[n & (TRACE_RING_SIZE - 1)];
+        printf("%lu %u %u %u\n", (unsigned long)event->cycles, event->type, event->arg8, event->arg16);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "perf.h"
+#include "hardware/sync.h"
+
+// Fixed size ring of timestamped events for post mortem latency analysis.
+// Recording is a cycle counter read and a few stores, so it stays on in
+// production. The ring is read back with CMD_GET_TRACE, or printed over
+// stdio one event per line; tools/trace_to_chrome.py turns either into a
+// chrome://tracing file.
+#define TRACE_RING_BITS         9
+#define TRACE_RING_SIZE         (1 << TRACE_RING_BITS)
+
+// events per CMD_GET_TRACE response
+#define TRACE_CHUNK_EVENTS      32
+
+#define TRACE_FRAME_START       0x01 // arg16: low bits of the frame number
+#define TRACE_CMD_BEGIN         0x02 // arg8: opcode
+#define TRACE_CMD_END           0x03 // arg8: opcode
+#define TRACE_DMA_START         0x04 // arg8: TRACE_DMA_*, arg16: kilobytes
+#define TRACE_DMA_END           0x05 // arg8: TRACE_DMA_*
+#define TRACE_QUEUE_FULL        0x06 // arg8: opcode that was refused
+#define TRACE_RESPONSE_SENT     0x07 // arg16: bytes handed to the response dma
+#define TRACE_RESPONSE_DROPPED  0x08 // arg8: RESPONSE_TYPE_*, arg16: payload bytes lost to a full ring
+#define TRACE_STREAM_TIMEOUT    0x09 // arg16: payload bytes that never arrived
+
+#define TRACE_DMA_SCANOUT       0
+#define TRACE_DMA_RESPONSE      1
+
+typedef struct __attribute__((packed)) {
+    uint32_t cycles; // perf_cycles() when recorded, wraps
+    uint8_t type;
+    uint8_t arg8;
+    uint16_t arg16;
+} TraceEvent;
+
+// ring position is a running event count, so readers can tell how much
+// was overwritten since they last looked
+extern TraceEvent trace_ring[TRACE_RING_SIZE];
+extern volatile uint32_t trace_head;
+
+// recorded from the main loop and from interrupts, so the slot is claimed
+// and filled with interrupts off
+static inline void trace_event(uint8_t type, uint8_t arg8, uint16_t arg16) 
+{
+    uint32_t irq = save_and_disable_interrupts();
+    TraceEvent* event = &trace_ring[trace_head++ & (TRACE_RING_SIZE - 1)];
+    event->cycles = perf_cycles();
+    event->type = type;
+    event->arg8 = arg8;
+    event->arg16 = arg16;
+    restore_interrupts(irq);
+}
+
+uint8_t trace_read(uint32_t from, TraceEvent* events, uint8_t max_events, uint32_t* first);
+void trace_dump(void);
@@ -0,0 +1,198 @@
+#include "blitter.h"
+#include "display.h"
+#include "render.h"
+#include "sprite_engine.h"
+#include "text_layer.h"
+#include "aps6404.h"
+#include "../externs.h"
+#include <stdio.h>
+#include <string.h>
+
+// Checks blits land in queue order with the text layer above them all,
+// whether or not a copy is queued.
+//
+//   blitter_test           the ordering checks
+//   blitter_test --bench   fill, copy and surface blit rates through render_frame
+//
+// Host rates only compare the blit paths with each other, the fills go
+// through the sdk stub's dma.
+#define COLOR_A         0x1111 // all read the same in either byte order
+#define COLOR_B         0x2222
+#define COLOR_TEXT      0xABAB
+
+#define TEXT_COLUMN     13
+#define TEXT_X          (TEXT_COLUMN * TEXT_CELL_WIDTH)
+
+#define BENCH_FRAMES    200
+
+static uint16_t* frame;
+
+static void load_font(void) 
+{
+    // glyph 1 is solid, 8 rows at 1bpp
+    uint8_t atlas[2 * TEXT_MIN_GLYPH_HEIGHT];
+    memset(atlas, 0, TEXT_MIN_GLYPH_HEIGHT);
+    memset(atlas + TEXT_MIN_GLYPH_HEIGHT, 0xFF, TEXT_MIN_GLYPH_HEIGHT);
+    aps6404_write(&psram, PSRAM_FONT_BASE, atlas, sizeof(atlas));
+    text_font_set(1, TEXT_MIN_GLYPH_HEIGHT, 2);
+
+    uint16_t colors[COLORS_PER_PALETTE] = { 0 };
+    colors[1] = COLOR_TEXT;
+    palette_load(0, colors);
+}
+
+static void queue_fill(int16_t x, int16_t y, uint16_t width, uint16_t height, uint16_t color) 
+{
+    BlitOp op = { .op = BLIT_OP_FILL, .x = x, .y = y, .width = width, .height = height, .color = color };
+    blitter_queue(&op);
+}
+
+static void queue_copy(int16_t x, int16_t y, uint16_t width, uint16_t height, int16_t src_x, int16_t src_y) 
+{
+    BlitOp op = { .op = BLIT_OP_COPY, .x = x, .y = y, .width = width, .height = height, .src_x = src_x, .src_y = src_y };
+    blitter_queue(&op);
+}
+
+static void render(void) 
+{
+    sprite_engine_start_frame();
+    render_frame(frame);
+}
+
+static bool expect(const char* name, int16_t x, int16_t y, uint16_t color) 
+{
+    uint16_t actual = frame[y * DISPLAY_WIDTH + x];
+
+    if (actual != color) 
+    {
+        printf("  %s: (%d, %d) is %04X, expected %04X\n", name, x, y, actual, color);
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_without_copies(void) 
+{
+    uint8_t glyph = 1;
+    bool passed = true;
+
+    text_write(TEXT_COLUMN, 0, 0, &glyph, 1);
+    queue_fill(0, 0, DISPLAY_WIDTH, 64, COLOR_A);
+    queue_fill(TEXT_X - 8, 0, 32, 32, COLOR_B);
+    render();
+
+    passed = expect("no copies", 4, 4, COLOR_A) && passed;
+    passed = expect("no copies", TEXT_X + 12, 12, COLOR_B) && passed;
+    passed = expect("no copies", TEXT_X, 0, COLOR_TEXT) && passed;
+
+    text_layer_clear();
+    if (passed) 
+        printf("  no copies ok\n");
+
+    return passed;
+}
+
+// a fill queued after a copy goes over what the copy drew, and the text
+// goes over both
+static bool check_copy_order(void) 
+{
+    uint8_t glyph = 1;
+    bool passed = true;
+
+    text_write(TEXT_COLUMN, 0, 0, &glyph, 1);
+    queue_fill(0, 0, 64, 64, COLOR_A);
+    queue_copy(TEXT_X - 8, 0, 64, 64, 0, 0);
+    queue_fill(TEXT_X - 8, 0, 32, 32, COLOR_B);
+    render();
+
+    passed = expect("copy order", 10, 10, COLOR_A) && passed;
+    passed = expect("copy order", TEXT_X + 40, 40, COLOR_A) && passed;
+    passed = expect("copy order", TEXT_X + 12, 12, COLOR_B) && passed;
+    passed = expect("copy order", TEXT_X, 0, COLOR_TEXT) && passed;
+
+    text_layer_clear();
+    if (passed) 
+        printf("  copy order ok\n");
+
+    return passed;
+}
+
+static double bench(const char* name, void (*queue)(void)) 
+{
+    blitter_take_stats();
+
+    for (int n = 0; n < BENCH_FRAMES; n++) 
+    {
+        queue();
+        render();
+    }
+
+    BlitterStats stats = blitter_take_stats();
+    double rate = stats.time_us ? (double)stats.pixels / stats.time_us : 0.0;
+
+    printf("  %-16s %8.2f Mpix/s\n", name, rate);
+    return rate;
+}
+
+static void queue_full_fill(void) 
+{
+    queue_fill(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, COLOR_A);
+}
+
+static void queue_column_fills(void) 
+{
+    for (int16_t x = 0; x + 16 <= DISPLAY_WIDTH && x < 16 * MAX_BLIT_OPS; x += 16) 
+    {
+        queue_fill(x, 0, 15, DISPLAY_HEIGHT, COLOR_B);
+    }
+}
+
+static void queue_copies(void) 
+{
+    queue_copy(64, 64, 128, 128, 0, 0);
+    queue_copy(1, 0, DISPLAY_WIDTH - 1, DISPLAY_HEIGHT, 0, 0);
+}
+
+static void queue_surface(void) 
+{
+    BlitOp op = {
+        .op = BLIT_OP_SURFACE,
+        .x = 0,
+        .y = 0,
+        .width = DISPLAY_WIDTH,
+        .height = DISPLAY_HEIGHT,
+        .src_addr = PSRAM_FRAME_BUFFER_BASE,
+        .src_stride = DISPLAY_WIDTH * sizeof(uint16_t)
+    };
+    blitter_queue(&op);
+}
+
+static int run_bench(void) 
+{
+    bench("full frame fill", queue_full_fill);
+    bench("column fills", queue_column_fills);
+    bench("copies", queue_copies);
+    bench("surface blit", queue_surface);
+
+    return 0;
+}
+
+int main(int argc, char** argv) 
+{
+    sprite_engine_init(pio2, 0, 1, 2);
+    blitter_init();
+    load_font();
+    frame = display_get_next_buffer();
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) 
+        return run_bench();
+
+    bool passed = true;
+    passed = check_without_copies() && passed;
+    passed = check_copy_order() && passed;
+
+    printf("blitter test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
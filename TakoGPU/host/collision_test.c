@@ -0,0 +1,198 @@
+#include "transfer_stub.h"
+#include "blitter.h"
+#include "command_exec.h"
+#include "display.h"
+#include "render.h"
+#include "sprite_engine.h"
+#include "surface.h"
+#include "text_layer.h"
+#include <stdio.h>
+#include <string.h>
+
+// Puts a scene with known overlaps on screen through cmd_execute and checks
+// what CMD_GET_COLLISIONS answers in each mode. Box mode reports every pair
+// of overlapping bounds. Pixel mode only reports pairs whose opaque texels
+// meet, and only the topmost texel under each pixel, so of three sprites
+// stacked on the same pixels it reports the two adjacent pairs.
+#define PATTERN_SOLID   0
+#define PATTERN_LEFT    1 // left half opaque, right half transparent
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    UpdateSpriteData sprite;
+} UpdateSprite;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPaletteData palette;
+    uint16_t colors[COLORS_PER_PALETTE];
+} LoadPalette;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPatternData pattern;
+    uint8_t data[32];
+} LoadPattern;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    SetCollisionModeData mode;
+} SetCollisionMode;
+
+typedef struct {
+    uint8_t sprite_num;
+    uint16_t x;
+    uint16_t y;
+    uint8_t pattern;
+} ScenePlacement;
+
+// 0 and 1 overlap, 2 is alone and 3 only touches 0's right edge. 4 and 5
+// overlap on their transparent halves. 7, 8 and 9 are stacked diagonally
+// with 8 covering all of 7 and 9's overlap
+static const ScenePlacement scene[] = {
+    { 0,  10,  10, PATTERN_SOLID },
+    { 1,   6,  14, PATTERN_SOLID },
+    { 2, 100, 100, PATTERN_SOLID },
+    { 3,  18,  10, PATTERN_SOLID },
+    { 4,  50,  50, PATTERN_LEFT },
+    { 5,  54,  50, PATTERN_LEFT },
+    { 7, 200, 100, PATTERN_SOLID },
+    { 8, 202, 102, PATTERN_SOLID },
+    { 9, 204, 104, PATTERN_SOLID },
+};
+
+static const uint8_t box_pairs[][2] = { { 0, 1 }, { 4, 5 }, { 7, 8 }, { 7, 9 }, { 8, 9 } };
+static const uint8_t pixel_pairs[][2] = { { 0, 1 }, { 7, 8 }, { 8, 9 } };
+
+static uint16_t* frame;
+
+static void load_scene(void) 
+{
+    LoadPalette palette = { .header = { CMD_LOAD_PALETTE, 0 }, .palette = { 0 } };
+    palette.colors[1] = 0xFFFF;
+    cmd_execute((const uint8_t*)&palette, sizeof(palette));
+
+    LoadPattern solid = { .header = { CMD_LOAD_PATTERN, 0 }, .pattern = { PATTERN_SOLID, SPRITE_SIZE_8x8 } };
+    memset(solid.data, 0x11, sizeof(solid.data));
+    cmd_execute((const uint8_t*)&solid, sizeof(solid));
+
+    // left pixel is in the high nibble, 4 bytes a row
+    LoadPattern left = { .header = { CMD_LOAD_PATTERN, 0 }, .pattern = { PATTERN_LEFT, SPRITE_SIZE_8x8 } };
+    for (int n = 0; n < (int)sizeof(left.data); n++) 
+    {
+        left.data[n] = (n & 3) < 2 ? 0x11 : 0x00;
+    }
+    cmd_execute((const uint8_t*)&left, sizeof(left));
+
+    for (size_t n = 0; n < sizeof(scene) / sizeof(scene[0]); n++) 
+    {
+        UpdateSprite update = {
+            .header = { CMD_UPDATE_SPRITE, 0 },
+            .sprite = {
+                .sprite_num = scene[n].sprite_num,
+                .x = scene[n].x,
+                .y = scene[n].y,
+                .pattern = scene[n].pattern,
+                .attr = SPRITE_SIZE_8x8,
+                .ctrl = SPRITE_CTRL_ENABLE | SPRITE_CTRL_TRANS
+            }
+        };
+        cmd_execute((const uint8_t*)&update, sizeof(update));
+    }
+}
+
+// a frame's collisions are reported once the next frame has started
+static bool get_collisions(uint8_t mode, CollisionReport* report) 
+{
+    SetCollisionMode set = { .header = { CMD_SET_COLLISION_MODE, 0 }, .mode = { mode } };
+    cmd_execute((const uint8_t*)&set, sizeof(set));
+
+    sprite_engine_start_frame();
+    render_frame(frame);
+    sprite_engine_start_frame();
+
+    GpuCommandHeader get = { CMD_GET_COLLISIONS, CMD_FLAG_NEEDS_RESPONSE };
+    uint32_t responses = host_responses;
+    cmd_execute((const uint8_t*)&get, sizeof(get));
+
+    if (host_responses != responses + 1 || host_response_len != sizeof(*report))
+        return false;
+
+    memcpy(report, host_response, sizeof(*report));
+    return true;
+}
+
+static bool has_pair(const CollisionReport* report, uint8_t a, uint8_t b) 
+{
+    for (int n = 0; n < report->pair_count; n++) 
+    {
+        if (report->pairs[n][0] == a && report->pairs[n][1] == b)
+            return true;
+    }
+
+    return false;
+}
+
+static bool check_mode(const char* name, uint8_t mode, const uint8_t (*pairs)[2], int pair_count) 
+{
+    CollisionReport report;
+    uint8_t mask[MAX_SPRITES / 8] = { 0 };
+
+    if (!get_collisions(mode, &report)) 
+    {
+        printf("  %s: no collision report came back\n", name);
+        return false;
+    }
+
+    for (int n = 0; n < pair_count; n++) 
+    {
+        if (!has_pair(&report, pairs[n][0], pairs[n][1])) 
+        {
+            printf("  %s: sprites %u and %u weren't reported\n", name, pairs[n][0], pairs[n][1]);
+            return false;
+        }
+
+        mask[pairs[n][0] >> 3] |= 1 << (pairs[n][0] & 7);
+        mask[pairs[n][1] >> 3] |= 1 << (pairs[n][1] & 7);
+    }
+
+    if (report.pair_count != pair_count || report.overflow) 
+    {
+        printf("  %s: %u pairs reported, expected %d\n", name, report.pair_count, pair_count);
+        return false;
+    }
+
+    if (memcmp(report.sprite_mask, mask, sizeof(mask))) 
+    {
+        printf("  %s: the sprite mask doesn't match the pairs\n", name);
+        return false;
+    }
+
+    printf("  %s ok\n", name);
+    return true;
+}
+
+int main(void) 
+{
+    static CommandLanes lanes;
+    static TransferState transfer;
+
+    surface_init();
+    sprite_engine_init(pio2, 0, 1, 2);
+    blitter_init();
+    text_layer_clear();
+    cmd_lanes_init(&lanes);
+    cmd_exec_init(&lanes, &transfer);
+
+    frame = display_get_next_buffer();
+    load_scene();
+
+    bool passed = true;
+    passed = check_mode("off", COLLISION_MODE_OFF, NULL, 0) && passed;
+    passed = check_mode("box", COLLISION_MODE_BOX, box_pairs, sizeof(box_pairs) / sizeof(box_pairs[0])) && passed;
+    passed = check_mode("pixel", COLLISION_MODE_PIXEL, pixel_pairs, sizeof(pixel_pairs) / sizeof(pixel_pairs[0])) && passed;
+
+    printf("collision test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
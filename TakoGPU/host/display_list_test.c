@@ -0,0 +1,230 @@
+#include "display_list.h"
+#include "gpu_protocol.h"
+#include "sprite_engine.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+// Records display lists and calls them at an offset, checking the commands
+// handed on carry the patched positions: sprite updates, with or without a
+// target frame, group moves and blits move, everything else is untouched,
+// and every call patches from the recording rather than the last call.
+//
+//   display_list_test           the patching checks
+//   display_list_test --bench   list call rates, reading back and patching
+#define LIST_MAIN       0
+#define LIST_LONG       1
+#define LONG_SPRITES    100 // spans several replay windows
+#define BENCH_CALLS     2000
+#define MAX_CALLED      128
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    UpdateSpriteData sprite;
+} UpdateSprite;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    uint32_t target_frame;
+    UpdateSpriteData sprite;
+} TargetedUpdateSprite;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    MoveGroupData group;
+} MoveGroup;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    FillRectData rect;
+} FillRect;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    SetScrollData scroll;
+} SetScroll;
+
+// what the last call handed on
+static uint8_t called[MAX_CALLED][64];
+static int called_count;
+
+static void log_command(const uint8_t* cmd_data, size_t cmd_len) 
+{
+    if (called_count < MAX_CALLED && cmd_len <= sizeof(called[0])) 
+    {
+        memcpy(called[called_count], cmd_data, cmd_len);
+    }
+
+    called_count++;
+}
+
+static void drop_command(const uint8_t* cmd_data, size_t cmd_len) 
+{
+}
+
+static UpdateSprite update_sprite(uint8_t sprite_num, int16_t x, int16_t y) 
+{
+    UpdateSprite update = {
+        .header = { CMD_UPDATE_SPRITE, 0 },
+        .sprite = {
+            .sprite_num = sprite_num,
+            .x = (uint16_t)x,
+            .y = (uint16_t)y,
+            .attr = SPRITE_SIZE_8x8,
+            .ctrl = SPRITE_CTRL_ENABLE
+        }
+    };
+
+    return update;
+}
+
+static void record_main(void) 
+{
+    UpdateSprite sprite = update_sprite(0, 10, 20);
+    TargetedUpdateSprite targeted = {
+        .header = { CMD_UPDATE_SPRITE, CMD_FLAG_TARGET_FRAME },
+        .target_frame = 1234,
+        .sprite = { .sprite_num = 1, .x = 30, .y = 40 }
+    };
+    MoveGroup group = { .header = { CMD_MOVE_GROUP, 0 }, .group = { .group = 2, .x = 50, .y = 60 } };
+    FillRect fill = { .header = { CMD_FILL_RECT, 0 }, .rect = { .x = 5, .y = 6, .width = 7, .height = 8 } };
+    SetScroll scroll = { .header = { CMD_SET_SCROLL, 0 }, .scroll = { .x = 70, .y = 80 } };
+
+    display_list_begin(LIST_MAIN, 256);
+    display_list_record((const uint8_t*)&sprite, sizeof(sprite));
+    display_list_record((const uint8_t*)&targeted, sizeof(targeted));
+    display_list_record((const uint8_t*)&group, sizeof(group));
+    display_list_record((const uint8_t*)&fill, sizeof(fill));
+    display_list_record((const uint8_t*)&scroll, sizeof(scroll));
+    display_list_end();
+}
+
+static bool expect(const char* name, const char* what, int actual, int expected) 
+{
+    if (actual != expected) 
+    {
+        printf("  %s: %s is %d, expected %d\n", name, what, actual, expected);
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_call(const char* name, int16_t dx, int16_t dy) 
+{
+    UpdateSprite sprite;
+    TargetedUpdateSprite targeted;
+    MoveGroup group;
+    FillRect fill;
+    SetScroll scroll;
+    bool passed = true;
+
+    called_count = 0;
+    if (!display_list_call(LIST_MAIN, dx, dy, log_command) || called_count != 5) 
+    {
+        printf("  %s: the call handed on %d commands, expected 5\n", name, called_count);
+        return false;
+    }
+
+    memcpy(&sprite, called[0], sizeof(sprite));
+    memcpy(&targeted, called[1], sizeof(targeted));
+    memcpy(&group, called[2], sizeof(group));
+    memcpy(&fill, called[3], sizeof(fill));
+    memcpy(&scroll, called[4], sizeof(scroll));
+
+    passed = expect(name, "sprite x", (int16_t)sprite.sprite.x, 10 + dx) && passed;
+    passed = expect(name, "sprite y", (int16_t)sprite.sprite.y, 20 + dy) && passed;
+    passed = expect(name, "targeted sprite x", (int16_t)targeted.sprite.x, 30 + dx) && passed;
+    passed = expect(name, "targeted sprite y", (int16_t)targeted.sprite.y, 40 + dy) && passed;
+    passed = expect(name, "target frame", (int)targeted.target_frame, 1234) && passed;
+    passed = expect(name, "group x", group.group.x, 50 + dx) && passed;
+    passed = expect(name, "group y", group.group.y, 60 + dy) && passed;
+    passed = expect(name, "fill x", fill.rect.x, 5 + dx) && passed;
+    passed = expect(name, "fill y", fill.rect.y, 6 + dy) && passed;
+    passed = expect(name, "fill width", fill.rect.width, 7) && passed;
+    passed = expect(name, "scroll x", scroll.scroll.x, 70) && passed;
+    passed = expect(name, "scroll y", scroll.scroll.y, 80) && passed;
+
+    if (passed)
+        printf("  %s ok\n", name);
+
+    return passed;
+}
+
+static void record_long(void) 
+{
+    display_list_begin(LIST_LONG, LONG_SPRITES * (sizeof(uint16_t) + sizeof(UpdateSprite)));
+
+    for (int n = 0; n < LONG_SPRITES; n++) 
+    {
+        UpdateSprite sprite = update_sprite(n, n, 2 * n);
+        display_list_record((const uint8_t*)&sprite, sizeof(sprite));
+    }
+
+    display_list_end();
+}
+
+static bool check_long(void) 
+{
+    called_count = 0;
+    if (!display_list_call(LIST_LONG, 100, -50, log_command) || called_count != LONG_SPRITES) 
+    {
+        printf("  windows: the call handed on %d commands, expected %d\n", called_count, LONG_SPRITES);
+        return false;
+    }
+
+    for (int n = 0; n < LONG_SPRITES; n++) 
+    {
+        UpdateSprite sprite;
+        memcpy(&sprite, called[n], sizeof(sprite));
+
+        if (sprite.sprite.sprite_num != n || (int16_t)sprite.sprite.x != n + 100 || (int16_t)sprite.sprite.y != 2 * n - 50) 
+        {
+            printf("  windows: command %d moved sprite %u to %d,%d, expected sprite %d at %d,%d\n", n,
+                   sprite.sprite.sprite_num, (int16_t)sprite.sprite.x, (int16_t)sprite.sprite.y, n, n + 100, 2 * n - 50);
+            return false;
+        }
+    }
+
+    printf("  windows ok\n");
+    return true;
+}
+
+static void bench(const char* name, uint8_t list_num, int commands) 
+{
+    uint64_t start = time_us_64();
+
+    for (int n = 0; n < BENCH_CALLS; n++) 
+    {
+        display_list_call(list_num, (int16_t)n, (int16_t)n, drop_command);
+    }
+
+    uint64_t elapsed = time_us_64() - start;
+    double rate = elapsed ? (double)BENCH_CALLS * commands / elapsed : 0.0;
+
+    printf("  %-16s %8.2f us/call %8.2f Mcmd/s\n", name, (double)elapsed / BENCH_CALLS, rate);
+}
+
+int main(int argc, char** argv) 
+{
+    display_list_init();
+    record_main();
+    record_long();
+
+    if (argc > 1 && !strcmp(argv[1], "--bench")) 
+    {
+        bench("mixed list", LIST_MAIN, 5);
+        bench("sprite list", LIST_LONG, LONG_SPRITES);
+        return 0;
+    }
+
+    bool passed = true;
+    passed = check_call("no offset", 0, 0) && passed;
+    passed = check_call("offset", 16, -8) && passed;
+    passed = check_call("second call", -3, 7) && passed;
+    passed = check_long() && passed;
+
+    printf("display list test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "display.h"
+#include "../pins.h"
+#include <stdio.h>
+
+// Runs display.c's frame pacing against a simulated panel and clock. The
+// panel raises TE every TE_PERIOD_US, give or take its own jitter, and the
+// frame loop renders for a set time, waits out the last frame and swaps as
+// the firmware's main loop does. Each scenario checks the frame time and
+// jitter display_take_timing reports. Frames that average under a TE period
+// each get their own pulse, the queued frame takes up the difference. Slower
+// ones go out on the next pulse after they're done, so they judder between
+// one and two periods. Scanout dma finishes as soon as it starts on the
+// host, so a frame's time is all pacing and rendering.
+#define TE_PERIOD_US    16667
+#define WARMUP_FRAMES   10 // long enough for a missing TE to time out
+#define FRAMES          120
+
+typedef struct {
+    const char* name;
+    uint8_t pacing;
+    bool te;                // the panel raises TE at all
+    uint32_t te_jitter_us;  // TE lands up to this far either side of its period
+    uint32_t render_us;
+    uint32_t render_alt_us; // every other frame renders this long instead, 0 for render_us
+    uint32_t frame_time_us; // expected average
+    uint32_t jitter_us;     // expected largest change between frames
+} Scenario;
+
+static const Scenario scenarios[] = {
+    { "60 hz",             DISPLAY_PACING_60,   true,  0,  5000,     0, TE_PERIOD_US,     0 },
+    { "30 hz",             DISPLAY_PACING_30,   true,  0,  5000,     0, 2 * TE_PERIOD_US, 0 },
+    { "60 hz, uneven",     DISPLAY_PACING_60,   true,  0, 12000, 20000, TE_PERIOD_US,     0 },
+    { "60 hz, slow frames", DISPLAY_PACING_60,  true,  0, 20000,     0, 20000,            TE_PERIOD_US },
+    { "60 hz, te jitter",  DISPLAY_PACING_60,   true, 50,  5000,     0, TE_PERIOD_US,     200 },
+    { "free",              DISPLAY_PACING_FREE, true,  0,  5000,     0, 5000,             0 },
+    { "60 hz, no te",      DISPLAY_PACING_60,   false, 0,  5000,     0, 5000,             0 },
+};
+
+static const Scenario* scenario;
+static uint64_t now_us;
+static uint64_t next_te_us;
+static uint32_t random_state = 0x2545F491;
+
+static uint32_t next_random(void) 
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void schedule_te(void) 
+{
+    next_te_us += TE_PERIOD_US;
+
+    if (scenario->te_jitter_us) 
+    {
+        next_te_us += next_random() % (2 * scenario->te_jitter_us + 1);
+        next_te_us -= scenario->te_jitter_us;
+    }
+}
+
+// moves the clock on, raising TE on the way as the panel would
+static void run_for(uint64_t us) 
+{
+    uint64_t end = now_us + us;
+
+    while (scenario->te && next_te_us <= end) 
+    {
+        host_clock_advance(next_te_us - now_us);
+        now_us = next_te_us;
+        schedule_te();
+        host_gpio_irq(PIN_DISP_TE, GPIO_IRQ_EDGE_RISE);
+    }
+
+    host_clock_advance(end - now_us);
+    now_us = end;
+}
+
+// busy waits in display.c spin a microsecond at a time
+static void idle(void) 
+{
+    run_for(1);
+}
+
+static void run_frames(int frames) 
+{
+    static int frame;
+
+    for (int n = 0; n < frames; n++, frame++) 
+    {
+        bool alt = scenario->render_alt_us && (frame & 1);
+        run_for(alt ? scenario->render_alt_us : scenario->render_us);
+
+        display_wait_for_frame_complete();
+        display_swap_buffers();
+    }
+}
+
+static uint32_t difference(uint32_t a, uint32_t b) 
+{
+    return a > b ? a - b : b - a;
+}
+
+static bool run_scenario(const Scenario* run) 
+{
+    scenario = run;
+    next_te_us = now_us;
+    schedule_te();
+
+    display_set_pacing(run->pacing);
+    run_frames(WARMUP_FRAMES);
+    display_take_timing();
+    run_frames(FRAMES);
+
+    DisplayTiming timing = display_take_timing();
+    bool passed = timing.frames && difference(timing.frame_time_us, run->frame_time_us) <= 1 &&
+                  timing.jitter_us <= run->jitter_us && (!run->te_jitter_us || timing.jitter_us);
+
+    printf("  %-20s %6lu us a frame, jitter %5lu us, %3lu frames, %3lu te pulses%s\n", run->name,
+           (unsigned long)timing.frame_time_us, (unsigned long)timing.jitter_us, (unsigned long)timing.frames,
+           (unsigned long)timing.te_pulses, passed ? "" : "  FAILED");
+
+    if (!passed) 
+    {
+        printf("  %s: expected %lu us a frame with at most %lu us jitter\n", run->name,
+               (unsigned long)run->frame_time_us, (unsigned long)run->jitter_us);
+    }
+
+    return passed;
+}
+
+int main(void) 
+{
+    host_clock_start(1000000);
+    now_us = 1000000;
+    host_idle = idle;
+
+    // bring-up waits out the panel's reset and sleep out, no TE yet
+    scenario = &scenarios[0];
+    display_init(pio0, 0);
+    while (!display_poll_init()) 
+    {
+        now_us += 1000;
+        host_clock_advance(1000);
+    }
+
+    bool passed = true;
+    for (size_t n = 0; n < count_of(scenarios); n++) 
+    {
+        passed = run_scenario(&scenarios[n]) && passed;
+    }
+
+    printf("display pacing test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#include "display.h"
+
+// one frame buffer that never goes out, the tests read it back directly
+static uint16_t frame[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+
+uint16_t* display_get_next_buffer(void) 
+{
+    return frame;
+}
+
+void display_swap_buffers(void) {}
+void display_wait_for_frame_complete(void) {}
+
+static uint8_t pacing;
+
+bool display_set_pacing(uint8_t mode) 
+{
+    if (mode > DISPLAY_PACING_30) 
+        return false;
+
+    pacing = mode;
+    return true;
+}
+
+uint8_t display_get_pacing(void) 
+{
+    return pacing;
+}
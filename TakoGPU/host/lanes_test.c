@@ -0,0 +1,295 @@
+#include "command_exec.h"
+#include "capture.h"
+#include "sprite_engine.h"
+#include <stdio.h>
+#include <string.h>
+
+// Checks the order commands come off the lanes: CMD_FLAG_HIGH_PRIORITY and
+// the priority types jump the normal lane, which only gives up its
+// CMD_BULK_BYTES_PER_FRAME a frame while priority commands drain regardless.
+// Then checks CMD_RESET and CMD_FLAG_RESET_STATE, which only bump the
+// engine's generation, leave nothing from before them on screen.
+#define BULK_LEN        200
+#define PRIORITY_LEN    300
+
+// both read the same in either byte order, palettes are stored swapped
+#define SPRITE_COLOR    0xFFFF
+#define SPRITE_X        10
+#define SPRITE_Y        10
+#define OTHER_X         40
+#define THIRD_X         70
+
+// a nop tagged with an id, padded out to its length
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    uint16_t id;
+    uint8_t padding[PRIORITY_LEN];
+} TaggedNop;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    UpdateSpriteData sprite;
+} UpdateSprite;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPaletteData palette;
+    uint16_t colors[COLORS_PER_PALETTE];
+} LoadPalette;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPatternData pattern;
+    uint8_t data[32];
+} LoadPattern;
+
+static CommandLanes lanes;
+static TransferState transfer;
+static uint16_t line[DISPLAY_WIDTH];
+
+static bool push_nop(uint16_t id, uint8_t flags, uint16_t len) 
+{
+    TaggedNop nop = { .header = { CMD_NOP, flags }, .id = id };
+    return cmd_lanes_push(&lanes, &nop, len, false, 0);
+}
+
+static bool push_type(uint8_t cmd) 
+{
+    GpuCommandHeader header = { cmd, 0 };
+    return cmd_lanes_push(&lanes, &header, sizeof(header), false, 0);
+}
+
+// the command popped as an id, its type for untagged ones, 0xFFFF for none
+static uint16_t pop(bool allow_normal, bool* was_priority) 
+{
+    static uint8_t buffer[CMD_DATA_BUFFER_SIZE];
+    uint16_t len;
+    bool needs_response;
+    uint16_t response_len;
+
+    if (!cmd_lanes_pop(&lanes, 0, allow_normal, buffer, &len, &needs_response, &response_len, was_priority))
+        return 0xFFFF;
+
+    const TaggedNop* nop = (const TaggedNop*)buffer;
+    return nop->header.cmd == CMD_NOP ? nop->id : nop->header.cmd;
+}
+
+static bool expect(const char* name, bool allow_normal, uint16_t expected, bool priority) 
+{
+    bool was_priority = false;
+    uint16_t popped = pop(allow_normal, &was_priority);
+
+    if (popped != expected || (expected != 0xFFFF && was_priority != priority)) 
+    {
+        printf("  %s: popped %u from the %s lane, expected %u from the %s lane\n", name, popped,
+               was_priority ? "priority" : "normal", expected, priority ? "priority" : "normal");
+        return false;
+    }
+
+    return true;
+}
+
+static bool check_priority_flag(void) 
+{
+    bool passed = true;
+
+    cmd_lanes_init(&lanes);
+    push_nop(1, 0, BULK_LEN);
+    push_nop(2, 0, BULK_LEN);
+    push_nop(3, CMD_FLAG_HIGH_PRIORITY, BULK_LEN);
+    push_nop(4, CMD_FLAG_HIGH_PRIORITY, BULK_LEN);
+
+    // the flagged ones go first, each lane keeps its own order
+    passed = expect("priority flag", true, 3, true) && passed;
+    passed = expect("priority flag", true, 4, true) && passed;
+    passed = expect("priority flag", true, 1, false) && passed;
+    passed = expect("priority flag", true, 2, false) && passed;
+    passed = expect("priority flag", true, 0xFFFF, false) && passed;
+
+    if (passed)
+        printf("  priority flag ok\n");
+
+    return passed;
+}
+
+static bool check_priority_types(void) 
+{
+    static const uint8_t types[] = { CMD_STATUS, CMD_GET_PERF, CMD_GET_PSRAM_DIAG, CMD_RESET };
+    bool passed = true;
+
+    cmd_lanes_init(&lanes);
+    push_nop(1, 0, BULK_LEN);
+
+    for (size_t n = 0; n < sizeof(types); n++) 
+    {
+        push_type(types[n]);
+    }
+
+    // queries and resets take the priority lane unflagged, and with the
+    // normal lane closed only they come off
+    for (size_t n = 0; n < sizeof(types); n++) 
+    {
+        passed = expect("priority types", false, types[n], true) && passed;
+    }
+
+    passed = expect("priority types", false, 0xFFFF, false) && passed;
+    passed = expect("priority types", true, 1, false) && passed;
+
+    if (passed)
+        printf("  priority types ok\n");
+
+    return passed;
+}
+
+static bool check_bulk_budget(void) 
+{
+    const uint8_t bulk = CMD_DATA_BUFFER_SIZE / BULK_LEN;
+    const uint8_t priority = CMD_DATA_BUFFER_SIZE / PRIORITY_LEN;
+    const uint8_t per_frame = (CMD_BULK_BYTES_PER_FRAME + BULK_LEN - 1) / BULK_LEN;
+
+    if (per_frame >= bulk) 
+    {
+        printf("  bulk budget: a full lane fits in one frame's budget, it never binds\n");
+        return false;
+    }
+
+    cmd_lanes_init(&lanes);
+
+    for (int n = 0; n < bulk; n++) 
+    {
+        push_nop(n, 0, BULK_LEN);
+    }
+
+    // more than the budget on the priority lane too, it isn't held to it
+    for (int n = 0; n < priority; n++) 
+    {
+        push_nop(n, CMD_FLAG_HIGH_PRIORITY, PRIORITY_LEN);
+    }
+
+    uint8_t left = bulk;
+
+    for (uint32_t frame = 0; left; frame++) 
+    {
+        cmd_exec_drain(frame);
+
+        uint8_t expected = left > per_frame ? left - per_frame : 0;
+        if (cmd_queue_get_count(&lanes.priority) || cmd_queue_get_count(&lanes.normal) != expected) 
+        {
+            printf("  bulk budget: frame %lu left %u priority and %u normal commands, expected 0 and %u\n",
+                   (unsigned long)frame, cmd_queue_get_count(&lanes.priority),
+                   cmd_queue_get_count(&lanes.normal), expected);
+            return false;
+        }
+
+        left = expected;
+    }
+
+    printf("  bulk budget ok\n");
+    return true;
+}
+
+static void load_palette(void) 
+{
+    LoadPalette palette = { .header = { CMD_LOAD_PALETTE, 0 }, .palette = { 0 } };
+    palette.colors[1] = SPRITE_COLOR;
+    cmd_execute((const uint8_t*)&palette, sizeof(palette));
+}
+
+static void update_sprite(uint8_t sprite_num, uint16_t x, uint8_t flags) 
+{
+    UpdateSprite update = {
+        .header = { CMD_UPDATE_SPRITE, flags },
+        .sprite = {
+            .sprite_num = sprite_num,
+            .x = x,
+            .y = SPRITE_Y,
+            .pattern = 0,
+            .attr = SPRITE_SIZE_8x8,
+            .ctrl = SPRITE_CTRL_ENABLE
+        }
+    };
+    cmd_execute((const uint8_t*)&update, sizeof(update));
+}
+
+static uint16_t pixel(int16_t x) 
+{
+    sprite_engine_start_frame();
+    sprite_engine_render_line(SPRITE_Y, line, DISPLAY_WIDTH);
+    return line[x];
+}
+
+static bool check_reset(void) 
+{
+    LoadPattern pattern = { .header = { CMD_LOAD_PATTERN, 0 }, .pattern = { 0, SPRITE_SIZE_8x8 } };
+    memset(pattern.data, 0x11, sizeof(pattern.data));
+    cmd_execute((const uint8_t*)&pattern, sizeof(pattern));
+
+    load_palette();
+    update_sprite(0, SPRITE_X, 0);
+    if (pixel(SPRITE_X) != SPRITE_COLOR) 
+    {
+        printf("  reset: the sprite isn't on screen to begin with\n");
+        return false;
+    }
+
+    // the reset jumps the sprite update queued ahead of it
+    cmd_lanes_init(&lanes);
+    UpdateSprite update = {
+        .header = { CMD_UPDATE_SPRITE, 0 },
+        .sprite = {
+            .sprite_num = 1,
+            .x = OTHER_X,
+            .y = SPRITE_Y,
+            .pattern = 0,
+            .attr = SPRITE_SIZE_8x8,
+            .ctrl = SPRITE_CTRL_ENABLE
+        }
+    };
+    cmd_lanes_push(&lanes, &update, sizeof(update), false, 0);
+    push_type(CMD_RESET);
+    cmd_exec_drain(0);
+
+    // the palette went stale with the sprites, only the pattern in psram stays
+    if (pixel(SPRITE_X) || pixel(OTHER_X)) 
+    {
+        printf("  reset: state from before CMD_RESET is still on screen\n");
+        return false;
+    }
+
+    load_palette();
+    if (pixel(SPRITE_X) || pixel(OTHER_X) != SPRITE_COLOR) 
+    {
+        printf("  reset: the sprite queued ahead of CMD_RESET didn't come after it\n");
+        return false;
+    }
+
+    // the flag resets before its own command runs
+    update_sprite(0, SPRITE_X, 0);
+    update_sprite(2, THIRD_X, CMD_FLAG_RESET_STATE);
+    load_palette();
+    if (pixel(SPRITE_X) || pixel(OTHER_X) || pixel(THIRD_X) != SPRITE_COLOR) 
+    {
+        printf("  reset: CMD_FLAG_RESET_STATE left the earlier sprites up\n");
+        return false;
+    }
+
+    printf("  reset ok\n");
+    return true;
+}
+
+int main(void) 
+{
+    capture_init();
+    sprite_engine_init(pio2, 0, 1, 2);
+    cmd_exec_init(&lanes, &transfer);
+
+    bool passed = true;
+    passed = check_priority_flag() && passed;
+    passed = check_priority_types() && passed;
+    passed = check_bulk_budget() && passed;
+    passed = check_reset() && passed;
+
+    printf("lanes test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "psram_pair_stub.h"
+#include "hardware/clocks.h"
+#include <string.h>
+
+// Two psram chips as arrays, standing in for aps6404.c on the host. Reads
+// and writes are routed and cut into bursts by the same aps6404_route and
+// aps6404_burst_chunk, and every burst is logged, so tests see which chip
+// each one went to. A burst that runs off its chip fails the call.
+APS6404State host_chips[2];
+uint8_t host_chip_memory[2][APS6404_SIZE];
+uint32_t host_chip_stuck_low[2];
+
+HostBurst host_bursts[HOST_BURSTS];
+uint32_t host_burst_count;
+
+void host_chips_reset(void) 
+{
+    memset(host_chips, 0, sizeof(host_chips));
+    memset(host_chip_memory, 0, sizeof(host_chip_memory));
+    memset(host_chip_stuck_low, 0, sizeof(host_chip_stuck_low));
+    host_burst_count = 0;
+
+    for (int n = 0; n < 2; n++) 
+    {
+        host_chips[n].max_burst = APS6404_PAGE_SIZE;
+    }
+}
+
+static bool burst(const APS6404State* device, uint32_t addr, uint8_t* data, size_t len, bool write) 
+{
+    uint8_t chip = (uint8_t)(device - host_chips);
+
+    if (addr > APS6404_SIZE || len > APS6404_SIZE - addr)
+        return false;
+
+    if (host_burst_count < HOST_BURSTS)
+        host_bursts[host_burst_count] = (HostBurst){ chip, addr, (uint32_t)len, write };
+    host_burst_count++;
+
+    for (size_t n = 0; n < len; n++) 
+    {
+        uint8_t* cell = &host_chip_memory[chip][(addr + n) & ~host_chip_stuck_low[chip]];
+
+        if (write)
+            *cell = data[n];
+        else
+            data[n] = *cell;
+    }
+
+    return true;
+}
+
+void aps6404_attach(APS6404State* psram, APS6404State* second, uint8_t layout) 
+{
+    psram->second = second;
+    psram->layout = second ? layout : APS6404_LAYOUT_SINGLE;
+}
+
+uint32_t aps6404_capacity(const APS6404State* psram) 
+{
+    return psram->layout == APS6404_LAYOUT_INTERLEAVED ? APS6404_SIZE * 2 : APS6404_SIZE;
+}
+
+bool aps6404_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len) 
+{
+    while (len) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, addr, &device_addr);
+        size_t chunk = aps6404_burst_chunk(device, device_addr, len);
+
+        if (!burst(device, device_addr, (uint8_t*)data, chunk, true))
+            return false;
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+bool aps6404_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len) 
+{
+    while (len) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, addr, &device_addr);
+        size_t chunk = aps6404_burst_chunk(device, device_addr, len);
+
+        if (!burst(device, device_addr, data, chunk, false))
+            return false;
+
+        addr += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+
+    return true;
+}
+
+void aps6404_set_timing(APS6404State* psram, float clkdiv, uint8_t sample_point) 
+{
+    psram->clkdiv = clkdiv;
+    psram->sample_point = sample_point;
+    psram->max_burst = aps6404_max_burst(clock_get_hz(clk_sys), clkdiv);
+}
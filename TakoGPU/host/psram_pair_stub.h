@@ -0,0 +1,26 @@
+#pragma once
+
+#include "aps6404.h"
+
+// two psram chips as arrays, see psram_pair_stub.c
+#define HOST_BURSTS     256
+
+typedef struct {
+    uint8_t chip;       // index into host_chips
+    uint32_t addr;      // within the chip
+    uint32_t len;
+    bool write;
+} HostBurst;
+
+extern APS6404State host_chips[2];
+extern uint8_t host_chip_memory[2][APS6404_SIZE];
+
+// address lines held low on each chip, so writes alias
+extern uint32_t host_chip_stuck_low[2];
+
+// the bursts since the last host_chips_reset, the first HOST_BURSTS kept
+extern HostBurst host_bursts[HOST_BURSTS];
+extern uint32_t host_burst_count;
+
+// detached chips with page long bursts, cleared memory and no faults
+void host_chips_reset(void);
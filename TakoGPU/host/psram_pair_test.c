@@ -0,0 +1,282 @@
+#include "psram_pair_stub.h"
+#include "psram_test.h"
+#include <stdio.h>
+#include <string.h>
+
+// Checks two chips behind one aps6404 state: which chip and address each
+// layout routes to, the address line test run on each chip on its own, as
+// boot does before attaching them, and bursts cut where a page, tCEM or the
+// chip they're on ends. The chips are psram_pair_stub.c's arrays, routed by
+// the firmware's own aps6404_route.
+#define FAULT_BIT       12 // held low on the second chip
+
+typedef struct {
+    uint32_t addr;
+    uint8_t chip;
+    uint32_t device_addr;
+} Route;
+
+static const Route split_routes[] = {
+    { PSRAM_FRAME_BUFFER_BASE,                       0, PSRAM_FRAME_BUFFER_BASE },
+    { PSRAM_SPRITE_BASE - 1,                         0, PSRAM_SPRITE_BASE - 1 },
+    { PSRAM_SPRITE_BASE,                             1, PSRAM_SPRITE_BASE },
+    { PSRAM_SPRITE_BASE + PSRAM_SPRITE_SIZE - 1,     1, PSRAM_SPRITE_BASE + PSRAM_SPRITE_SIZE - 1 },
+    { PSRAM_TILEMAP_BASE,                            0, PSRAM_TILEMAP_BASE },
+    { PSRAM_DISPLAY_LIST_BASE,                       0, PSRAM_DISPLAY_LIST_BASE },
+    { PSRAM_FONT_BASE,                               1, PSRAM_FONT_BASE },
+    { PSRAM_FONT_BASE + PSRAM_FONT_SIZE - 1,         1, PSRAM_FONT_BASE + PSRAM_FONT_SIZE - 1 },
+    { PSRAM_FONT_BASE + PSRAM_FONT_SIZE,             0, PSRAM_FONT_BASE + PSRAM_FONT_SIZE },
+    { PSRAM_CAPTURE_BASE + PSRAM_CAPTURE_SIZE - 1,   0, PSRAM_CAPTURE_BASE + PSRAM_CAPTURE_SIZE - 1 },
+};
+
+static const Route interleaved_routes[] = {
+    { 0,                                0, 0 },
+    { APS6404_PAGE_SIZE - 1,            0, APS6404_PAGE_SIZE - 1 },
+    { APS6404_PAGE_SIZE,                1, 0 },
+    { 2 * APS6404_PAGE_SIZE,            0, APS6404_PAGE_SIZE },
+    { 3 * APS6404_PAGE_SIZE + 5,        1, APS6404_PAGE_SIZE + 5 },
+    { 2 * APS6404_SIZE - 1,             1, APS6404_SIZE - 1 },
+};
+
+static APS6404State* attach(uint8_t layout) 
+{
+    host_chips_reset();
+    aps6404_attach(&host_chips[0], &host_chips[1], layout);
+    return &host_chips[0];
+}
+
+static bool check_routes(const char* name, uint8_t layout, const Route* routes, size_t count) 
+{
+    APS6404State* psram = attach(layout);
+
+    for (size_t n = 0; n < count; n++) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, routes[n].addr, &device_addr);
+
+        if (device != &host_chips[routes[n].chip] || device_addr != routes[n].device_addr) 
+        {
+            printf("  %s: %06lx went to chip %d at %06lx, expected chip %u at %06lx\n", name,
+                   (unsigned long)routes[n].addr, (int)(device - host_chips), (unsigned long)device_addr,
+                   routes[n].chip, (unsigned long)routes[n].device_addr);
+            return false;
+        }
+    }
+
+    printf("  %s routes ok\n", name);
+    return true;
+}
+
+// attaching without a second chip leaves everything on the first
+static bool check_single(void) 
+{
+    host_chips_reset();
+    aps6404_attach(&host_chips[0], NULL, APS6404_LAYOUT_INTERLEAVED);
+
+    uint32_t device_addr;
+    if (host_chips[0].layout != APS6404_LAYOUT_SINGLE || aps6404_capacity(&host_chips[0]) != APS6404_SIZE ||
+        aps6404_route(&host_chips[0], PSRAM_SPRITE_BASE + APS6404_PAGE_SIZE, &device_addr) != &host_chips[0] ||
+        device_addr != PSRAM_SPRITE_BASE + APS6404_PAGE_SIZE) 
+    {
+        printf("  single: a lone chip didn't keep everything\n");
+        return false;
+    }
+
+    printf("  single ok\n");
+    return true;
+}
+
+static bool check_chip_tests(void) 
+{
+    host_chips_reset();
+
+    bool first = psram_test_chip(&host_chips[0], 0, PSRAM_TEST_QUICK);
+    bool second = psram_test_chip(&host_chips[1], 1, PSRAM_TEST_QUICK);
+    const PsramDiagnostics* diag = psram_test_results();
+
+    if (!first || !second || diag->bad_address_bits || diag->second_bad_address_bits || diag->failed_stage) 
+    {
+        printf("  chip tests: good chips failed\n");
+        return false;
+    }
+
+    host_chip_stuck_low[1] = 1u << FAULT_BIT;
+
+    first = psram_test_chip(&host_chips[0], 0, PSRAM_TEST_QUICK);
+    second = psram_test_chip(&host_chips[1], 1, PSRAM_TEST_QUICK);
+
+    if (!first || second || diag->bad_address_bits || !(diag->second_bad_address_bits & (1u << FAULT_BIT)) ||
+        diag->failed_stage != PSRAM_STAGE_ADDRESS || diag->failed_device != 1) 
+    {
+        printf("  chip tests: line %d stuck on the second chip gave %s/%s, bad bits %08lx/%08lx, stage %u on chip %u\n",
+               FAULT_BIT, first ? "pass" : "fail", second ? "pass" : "fail", (unsigned long)diag->bad_address_bits,
+               (unsigned long)diag->second_bad_address_bits, diag->failed_stage, diag->failed_device);
+        return false;
+    }
+
+    // the first chip's results start the set over, so a clean run clears it
+    host_chip_stuck_low[1] = 0;
+    psram_test_chip(&host_chips[0], 0, PSRAM_TEST_QUICK);
+    psram_test_chip(&host_chips[1], 1, PSRAM_TEST_QUICK);
+
+    if (diag->second_bad_address_bits || diag->failed_stage) 
+    {
+        printf("  chip tests: the fault outlived a clean run\n");
+        return false;
+    }
+
+    printf("  chip tests ok\n");
+    return true;
+}
+
+// a round trip's write bursts, then the same again for the read
+static bool expect_bursts(const char* name, const HostBurst* expected, uint32_t count) 
+{
+    bool passed = host_burst_count == 2 * count;
+
+    for (uint32_t n = 0; passed && n < 2 * count; n++) 
+    {
+        const HostBurst* burst = &host_bursts[n];
+        const HostBurst* want = &expected[n % count];
+        passed = burst->chip == want->chip && burst->addr == want->addr && burst->len == want->len && burst->write == (n < count);
+    }
+
+    if (!passed) 
+    {
+        printf("  %s: %lu bursts, expected %lu\n", name, (unsigned long)host_burst_count, (unsigned long)(2 * count));
+        for (uint32_t n = 0; n < host_burst_count && n < HOST_BURSTS; n++) 
+        {
+            printf("    chip %u at %06lx, %lu bytes\n", host_bursts[n].chip, (unsigned long)host_bursts[n].addr,
+                   (unsigned long)host_bursts[n].len);
+        }
+    }
+
+    return passed;
+}
+
+// writes a run of bytes, reads it back and checks every byte is on the
+// chip and at the address the route gives
+static bool round_trip(const char* name, APS6404State* psram, uint32_t addr, uint32_t len) 
+{
+    static uint8_t data[4 * APS6404_PAGE_SIZE];
+    static uint8_t readback[4 * APS6404_PAGE_SIZE];
+
+    for (uint32_t n = 0; n < len; n++) 
+    {
+        data[n] = (uint8_t)(n * 7 + 1);
+    }
+
+    host_burst_count = 0;
+    if (!aps6404_write(psram, addr, data, len) || !aps6404_read(psram, addr, readback, len) || memcmp(data, readback, len)) 
+    {
+        printf("  %s: %lu bytes at %06lx didn't read back\n", name, (unsigned long)len, (unsigned long)addr);
+        return false;
+    }
+
+    for (uint32_t n = 0; n < len; n++) 
+    {
+        uint32_t device_addr;
+        APS6404State* device = aps6404_route(psram, addr + n, &device_addr);
+
+        if (host_chip_memory[device - host_chips][device_addr] != data[n]) 
+        {
+            printf("  %s: byte %06lx isn't on chip %d at %06lx\n", name, (unsigned long)(addr + n),
+                   (int)(device - host_chips), (unsigned long)device_addr);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool check_bursts(void) 
+{
+    bool passed = true;
+
+    APS6404State* psram = attach(APS6404_LAYOUT_INTERLEAVED);
+    const HostBurst interleaved[] = {
+        { 0, 1000, 24 },
+        { 1, 0, APS6404_PAGE_SIZE },
+        { 0, APS6404_PAGE_SIZE, APS6404_PAGE_SIZE },
+        { 1, APS6404_PAGE_SIZE, 28 },
+    };
+    passed = round_trip("interleaved bursts", psram, 1000, 2100) &&
+             expect_bursts("interleaved bursts", interleaved, count_of(interleaved)) && passed;
+
+    psram = attach(APS6404_LAYOUT_SPLIT);
+    const HostBurst split[] = {
+        { 0, PSRAM_SPRITE_BASE - 32, 32 },
+        { 1, PSRAM_SPRITE_BASE, 32 },
+    };
+    passed = round_trip("split bursts", psram, PSRAM_SPRITE_BASE - 32, 64) &&
+             expect_bursts("split bursts", split, count_of(split)) && passed;
+
+    const HostBurst font_end[] = {
+        { 1, PSRAM_FONT_BASE + PSRAM_FONT_SIZE - 100, 100 },
+        { 0, PSRAM_FONT_BASE + PSRAM_FONT_SIZE, 100 },
+    };
+    passed = round_trip("split font end", psram, PSRAM_FONT_BASE + PSRAM_FONT_SIZE - 100, 200) &&
+             expect_bursts("split font end", font_end, count_of(font_end)) && passed;
+
+    // tCEM cuts bursts short of a page at a slow clock, on whichever chip
+    psram = attach(APS6404_LAYOUT_INTERLEAVED);
+    aps6404_set_timing(&host_chips[0], 2.0f, APS6404_SAMPLE_RISE);
+    aps6404_set_timing(&host_chips[1], 4.0f, APS6404_SAMPLE_RISE);
+    passed = round_trip("short bursts", psram, 3000, 3000) && passed;
+
+    for (uint32_t n = 0; n < host_burst_count && n < HOST_BURSTS; n++) 
+    {
+        const HostBurst* burst = &host_bursts[n];
+        uint32_t page_left = APS6404_PAGE_SIZE - (burst->addr & (APS6404_PAGE_SIZE - 1));
+
+        if (burst->len > host_chips[burst->chip].max_burst || burst->len > page_left) 
+        {
+            printf("  short bursts: %lu bytes at %06lx on chip %u, past a page or %u bytes\n", (unsigned long)burst->len,
+                   (unsigned long)burst->addr, burst->chip, host_chips[burst->chip].max_burst);
+            passed = false;
+            break;
+        }
+    }
+
+    if (passed)
+        printf("  bursts ok\n");
+
+    return passed;
+}
+
+// the pattern test then runs over the attached pair, as at boot
+static bool check_attached_run(void) 
+{
+    APS6404State* psram = attach(APS6404_LAYOUT_INTERLEAVED);
+
+    psram_test_chip(&host_chips[0], 0, PSRAM_TEST_QUICK);
+    psram_test_chip(&host_chips[1], 1, PSRAM_TEST_QUICK);
+
+    bool passed = psram_test_run(psram, PSRAM_TEST_QUICK);
+    const PsramDiagnostics* diag = psram_test_results();
+
+    if (!passed || diag->devices != 2 || diag->layout != APS6404_LAYOUT_INTERLEAVED || diag->errors) 
+    {
+        printf("  attached run: %s on %u chips, layout %u, %lu errors\n", passed ? "passed" : "failed", diag->devices,
+               diag->layout, (unsigned long)diag->errors);
+        return false;
+    }
+
+    printf("  attached run ok\n");
+    return true;
+}
+
+int main(void) 
+{
+    bool passed = true;
+    passed = check_routes("split", APS6404_LAYOUT_SPLIT, split_routes, count_of(split_routes)) && passed;
+    passed = check_routes("interleaved", APS6404_LAYOUT_INTERLEAVED, interleaved_routes, count_of(interleaved_routes)) && passed;
+    passed = check_single() && passed;
+    passed = check_chip_tests() && passed;
+    passed = check_bursts() && passed;
+    passed = check_attached_run() && passed;
+
+    printf("psram pair test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+#include "aps6404.h"
+#include <string.h>
+
+// The psram as a plain array, standing in for aps6404.c on the host. It
+// only checks that accesses stay on the chip.
+APS6404State psram;
+
+static uint8_t memory[APS6404_SIZE];
+
+uint32_t aps6404_capacity(const APS6404State* state) 
+{
+    return APS6404_SIZE;
+}
+
+bool aps6404_write(APS6404State* state, uint32_t addr, const uint8_t* data, size_t len) 
+{
+    if (addr > APS6404_SIZE || len > APS6404_SIZE - addr) 
+        return false;
+
+    memcpy(memory + addr, data, len);
+    return true;
+}
+
+bool aps6404_read(APS6404State* state, uint32_t addr, uint8_t* data, size_t len) 
+{
+    if (addr > APS6404_SIZE || len > APS6404_SIZE - addr) 
+        return false;
+
+    memcpy(data, memory + addr, len);
+    return true;
+}
+
+void aps6404_set_timing(APS6404State* state, float clkdiv, uint8_t sample_point) 
+{
+    state->clkdiv = clkdiv;
+    state->sample_point = sample_point;
+}
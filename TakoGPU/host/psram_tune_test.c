@@ -0,0 +1,274 @@
+#include "aps6404.h"
+#include "psram_tune.h"
+#include "hardware/clocks.h"
+#include <stdio.h>
+#include <string.h>
+
+// Runs the psram timing sweep against a simulated chip with injected
+// timing faults, in place of aps6404.c.
+//
+// The chip drives each nibble for a window of sample delays, in system
+// clocks after the rising edge the pio samples on. The window is a full sck
+// period less what the chip's output delay and the board's skew eat, so it
+// shrinks as the divider goes down. A sample point's delay is half a period
+// for the falling edge, less the synchronizers' delay, as they see the data
+// that much older. Faults knock out single points on top.
+#define SIM_HZ              150000000
+#define FAST_HZ             300000000
+#define SIM_SYNC_DELAY      1.5f    // system clocks, the second synchronizer stage lands anywhere in its clock
+
+typedef struct {
+    const char* name;
+    float window_start;                                            // system clocks
+    float window_loss;                                             // system clocks off a period
+    uint8_t dead[PSRAM_TUNE_DIVIDERS + 1];                         // sample point bits by divider, always wrong
+    uint8_t flaky[PSRAM_TUNE_DIVIDERS + 1];                        // sample point bits by divider, one read in PSRAM_TUNE_REPEATS wrong
+    bool tuned;
+    uint8_t clkdiv;
+    uint8_t sample_point;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    // rising edge points pass from a divider of 2, the falling one's past the window
+    { "nominal", -1.5f, 1.5f, {0}, {0}, true, 2, APS6404_SAMPLE_RISE },
+
+    // at a divider of 1 only the first two points by number pass, the
+    // earliest and the third in delay order, so neither has a passing point
+    // on both sides
+    { "window edge", -1.5f, 0.0f, { [1] = 1 << APS6404_SAMPLE_FALL_SYNC }, {0}, true, 2, APS6404_SAMPLE_RISE },
+
+    // the middle of the divider 2 window is dead, which leaves no point with
+    // two passing neighbours there
+    { "dead point", -1.5f, 1.5f, { [2] = 1 << APS6404_SAMPLE_RISE }, {0}, true, 3, APS6404_SAMPLE_RISE },
+
+    // a point that fails one read in a few only shows up on the repeats
+    { "intermittent", -1.5f, 1.5f, {0}, { [2] = 1 << APS6404_SAMPLE_FALL_SYNC }, true, 3, APS6404_SAMPLE_RISE },
+
+    // never more than one point in the window
+    { "no window", -1.5f, 0.0f, { [1] = 0xF, [2] = 0xE, [3] = 0xE, [4] = 0xE, [5] = 0xE, [6] = 0xE }, {0}, false, 0, 0 },
+};
+
+static const Scenario* scenario;
+static float sim_clkdiv;
+static uint8_t sim_sample_point;
+static uint32_t sim_reads;
+static bool sim_bad_timing;
+static uint8_t memory[APS6404_PAGE_SIZE];
+
+static float sample_delay(float clkdiv, uint8_t sample_point) 
+{
+    bool fall = sample_point == APS6404_SAMPLE_FALL_SYNC || sample_point == APS6404_SAMPLE_FALL;
+    bool sync = sample_point == APS6404_SAMPLE_RISE_SYNC || sample_point == APS6404_SAMPLE_FALL_SYNC;
+
+    return (fall ? clkdiv : 0.0f) - (sync ? SIM_SYNC_DELAY : 0.0f);
+}
+
+static bool sim_reads_right(void) 
+{
+    int divider = (int)sim_clkdiv;
+    float delay = sample_delay(sim_clkdiv, sim_sample_point);
+    float window_end = scenario->window_start + 2.0f * sim_clkdiv - scenario->window_loss;
+    uint8_t bit = 1 << sim_sample_point;
+
+    if (sim_clkdiv != divider || divider > PSRAM_TUNE_DIVIDERS)
+        return false;
+
+    if (delay < scenario->window_start || delay > window_end || (scenario->dead[divider] & bit))
+        return false;
+
+    return !((scenario->flaky[divider] & bit) && sim_reads % PSRAM_TUNE_REPEATS == 0);
+}
+
+void aps6404_set_timing(APS6404State* psram, float clkdiv, uint8_t sample_point) 
+{
+    // the sweep only ever asks for whole dividers and sck the chip can take
+    if (clkdiv != (int)clkdiv || SIM_HZ / (2.0f * clkdiv) > APS6404_MAX_SCK_HZ)
+        sim_bad_timing = true;
+
+    psram->clkdiv = clkdiv;
+    psram->sample_point = sample_point;
+    psram->max_burst = aps6404_max_burst(SIM_HZ, clkdiv);
+    sim_clkdiv = clkdiv;
+    sim_sample_point = sample_point;
+}
+
+uint32_t aps6404_capacity(const APS6404State* psram) 
+{
+    return APS6404_SIZE;
+}
+
+bool aps6404_write(APS6404State* psram, uint32_t addr, const uint8_t* data, size_t len) 
+{
+    if (addr > sizeof(memory) || len > sizeof(memory) - addr)
+        return false;
+
+    memcpy(memory + addr, data, len);
+    return true;
+}
+
+bool aps6404_read(APS6404State* psram, uint32_t addr, uint8_t* data, size_t len) 
+{
+    if (addr > sizeof(memory) || len > sizeof(memory) - addr)
+        return false;
+
+    sim_reads++;
+    memcpy(data, memory + addr, len);
+
+    // wrong timing reads some nibbles a clock late
+    if (!sim_reads_right()) 
+    {
+        for (size_t n = 0; n < len; n += 7) 
+        {
+            data[n] = (uint8_t)(data[n] << 4 | data[n + 1 < len ? n + 1 : n] >> 4);
+        }
+    }
+
+    return true;
+}
+
+static bool point_passed(uint32_t map, uint8_t clkdiv, uint8_t sample_point) 
+{
+    return (map >> ((clkdiv - 1) * APS6404_SAMPLE_POINTS + sample_point)) & 1;
+}
+
+static bool check_scenario(const Scenario* test) 
+{
+    APS6404State chip = { .clkdiv = 2.0f, .sample_point = APS6404_SAMPLE_RISE_SYNC };
+
+    scenario = test;
+    sim_reads = 0;
+    sim_bad_timing = false;
+
+    bool tuned = psram_tune_run(&chip, 0);
+    const PsramTuneResult* result = psram_tune_result(0);
+    bool passed = !sim_bad_timing && tuned == test->tuned && result->tuned == test->tuned;
+
+    if (test->tuned) 
+    {
+        passed = passed && result->clkdiv == test->clkdiv && result->sample_point == test->sample_point;
+        passed = passed && chip.clkdiv == test->clkdiv && chip.sample_point == test->sample_point;
+    }
+    else 
+    {
+        // left at the setting it came in with
+        passed = passed && chip.clkdiv == 2.0f && chip.sample_point == APS6404_SAMPLE_RISE_SYNC;
+    }
+
+    printf("  %-12s %s: %s clkdiv %.0f, sample point %u\n", test->name, passed ? "ok" : "FAILED",
+           result->tuned ? "tuned to" : "kept", result->clkdiv, result->sample_point);
+
+    return passed;
+}
+
+// whatever the sweep takes has to have passed on both sides of it in delay
+// order, whether the neighbours are next to it in the enum or not
+static bool check_neighbours(void) 
+{
+    bool passed = true;
+
+    for (size_t n = 0; n < count_of(scenarios); n++) 
+    {
+        scenario = &scenarios[n];
+        APS6404State chip = { .clkdiv = 2.0f };
+        psram_tune_run(&chip, 1);
+
+        const PsramTuneResult* result = psram_tune_result(1);
+        if (!result->tuned)
+            continue;
+
+        uint8_t clkdiv = (uint8_t)result->clkdiv;
+        float delay = sample_delay(clkdiv, result->sample_point);
+        int earlier = 0;
+        int later = 0;
+
+        for (uint8_t point = 0; point < APS6404_SAMPLE_POINTS; point++) 
+        {
+            if (!point_passed(result->pass_map, clkdiv, point))
+                continue;
+            if (sample_delay(clkdiv, point) < delay)
+                earlier++;
+            if (sample_delay(clkdiv, point) > delay)
+                later++;
+        }
+
+        if (!earlier || !later) 
+        {
+            printf("  %s took sample point %u at clkdiv %u without a passing point either side\n",
+                   scenarios[n].name, result->sample_point, clkdiv);
+            passed = false;
+        }
+    }
+
+    return passed;
+}
+
+static bool probe_everything(void* ctx, float clkdiv, uint8_t sample_point) 
+{
+    float* fastest_sck = (float*)ctx;
+    float sck = FAST_HZ / (2.0f * clkdiv);
+
+    if (sck > *fastest_sck)
+        *fastest_sck = sck;
+
+    return true;
+}
+
+// with every point passing at a 300 MHz system clock, a divider of 1 would
+// run sck past the chip's limit, so the sweep has to start at 2
+static bool check_sck_limit(void) 
+{
+    float fastest_sck = 0.0f;
+    PsramTuneResult result = psram_tune_sweep(probe_everything, &fastest_sck, FAST_HZ);
+    bool passed = result.tuned && result.clkdiv == 2.0f && fastest_sck <= APS6404_MAX_SCK_HZ;
+
+    printf("  sck limit    %s: clkdiv %.0f, fastest sck tried %.1f MHz\n", passed ? "ok" : "FAILED",
+           result.clkdiv, fastest_sck / 1000000.0f);
+
+    return passed;
+}
+
+// a burst, command to last byte, has to fit in tCEM less the slack at any
+// divider the sweep can pick
+static bool check_max_burst(void) 
+{
+    static const uint32_t sys_hz[] = { SIM_HZ, FAST_HZ };
+    bool passed = true;
+
+    for (size_t n = 0; n < count_of(sys_hz); n++) 
+    {
+        for (int clkdiv = 1; clkdiv <= PSRAM_TUNE_DIVIDERS; clkdiv++) 
+        {
+            uint16_t burst = aps6404_max_burst(sys_hz[n], clkdiv);
+            double select_ns = (APS6404_BURST_OVERHEAD + 2.0 * burst) * 2.0 * clkdiv * 1e9 / sys_hz[n];
+
+            if (!burst || burst > APS6404_PAGE_SIZE || select_ns > APS6404_MAX_SELECT_NS - APS6404_SELECT_SLACK_NS) 
+            {
+                printf("  max burst at %lu MHz clkdiv %d is %u bytes, chip select low %.0f ns\n",
+                       (unsigned long)(sys_hz[n] / 1000000), clkdiv, burst, select_ns);
+                passed = false;
+            }
+        }
+    }
+
+    printf("  max burst    %s\n", passed ? "ok" : "FAILED");
+
+    return passed;
+}
+
+int main(void) 
+{
+    bool passed = true;
+
+    for (size_t n = 0; n < count_of(scenarios); n++) 
+    {
+        passed = check_scenario(&scenarios[n]) && passed;
+    }
+
+    passed = check_neighbours() && passed;
+    passed = check_sck_limit() && passed;
+    passed = check_max_burst() && passed;
+
+    printf("psram tune test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
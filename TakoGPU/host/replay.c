@@ -0,0 +1,209 @@
+#include "replay.h"
+#include "blitter.h"
+#include "capture.h"
+#include "command_exec.h"
+#include "display.h"
+#include "display_list.h"
+#include "perf.h"
+#include "render.h"
+#include "sprite_engine.h"
+#include "surface.h"
+#include "text_layer.h"
+#include "trace.h"
+#include "transfer_stub.h"
+#include "pico/time.h"
+#include <stdio.h>
+#include <string.h>
+
+static CommandLanes lanes;
+static TransferState transfer;
+static uint16_t* frame;
+
+void replay_init(void) 
+{
+    perf_init();
+    capture_init();
+    display_list_init();
+    surface_init();
+    sprite_engine_init(pio2, 0, 1, 2);
+    blitter_init();
+    text_layer_clear();
+
+    frame = display_get_next_buffer();
+}
+
+// the record at pos and its command, false if it doesn't fit in what's left
+static bool read_record(const uint8_t* capture, uint32_t length, uint32_t pos, CaptureRecord* record, 
+                        const uint8_t** cmd) 
+{
+    if (length - pos < sizeof(CaptureRecord)) 
+        return false;
+
+    memcpy(record, capture + pos, sizeof(*record));
+    *cmd = capture + pos + sizeof(*record);
+
+    return record->length >= sizeof(GpuCommandHeader) && record->length <= CMD_DATA_BUFFER_SIZE &&
+           record->length <= length - pos - sizeof(*record);
+}
+
+// a copy with the response flag cleared, nobody's waiting for one
+static const uint8_t* prepare(const uint8_t* cmd, uint16_t len) 
+{
+    static uint8_t buffer[CMD_DATA_BUFFER_SIZE];
+
+    memcpy(buffer, cmd, len);
+    ((GpuCommandHeader*)buffer)->flags &= ~CMD_FLAG_NEEDS_RESPONSE;
+
+    return buffer;
+}
+
+static void render(uint32_t frame_num, ReplayStats* stats) 
+{
+    uint64_t start = time_us_64();
+
+    sprite_engine_start_frame();
+    render_frame(frame);
+    cmd_exec_retire_fences(frame_num);
+
+    stats->render_us += time_us_64() - start;
+    stats->frames++;
+}
+
+static bool run_max_speed(const uint8_t* capture, uint32_t length, ReplayStats* stats) 
+{
+    CaptureRecord record;
+    const uint8_t* cmd;
+    uint32_t pos = 0;
+
+    trace_event(TRACE_FRAME_START, 0, 0);
+
+    for (; pos < length; pos += sizeof(record) + record.length) 
+    {
+        if (!read_record(capture, length, pos, &record, &cmd)) 
+            return false;
+
+        if (cmd_is_streamed((const GpuCommandHeader*)cmd)) 
+        {
+            stats->skipped++;
+            continue;
+        }
+
+        const uint8_t* prepared = prepare(cmd, record.length);
+        uint64_t start = time_us_64();
+        cmd_execute(prepared, record.length);
+        stats->exec_us += time_us_64() - start;
+        stats->commands++;
+    }
+
+    render(0, stats);
+    return true;
+}
+
+static bool lanes_empty(void) 
+{
+    return cmd_queue_is_empty(&lanes.priority) && cmd_queue_is_empty(&lanes.normal);
+}
+
+static bool run_recorded(const uint8_t* capture, uint32_t length, ReplayStats* stats) 
+{
+    CaptureRecord record;
+    const uint8_t* cmd;
+    uint32_t pos = 0;
+    uint32_t drain_frames = 0;
+
+    for (uint32_t frame_num = 0; pos < length || (!lanes_empty() && drain_frames++ < REPLAY_DRAIN_FRAMES); frame_num++) 
+    {
+        uint64_t start = time_us_64();
+        trace_event(TRACE_FRAME_START, 0, (uint16_t)frame_num);
+
+        // on the gpu the bus keeps pushing while the frame drains, so a full
+        // queue is drained here and only what still won't fit waits a frame
+        while (pos < length) 
+        {
+            if (!read_record(capture, length, pos, &record, &cmd)) 
+                return false;
+
+            if (record.frame > frame_num) 
+                break;
+
+            if (cmd_is_streamed((const GpuCommandHeader*)cmd)) 
+            {
+                stats->skipped++;
+            }
+            else 
+            {
+                const uint8_t* prepared = prepare(cmd, record.length);
+
+                if (!cmd_lanes_push(&lanes, prepared, record.length, false, 0)) 
+                {
+                    cmd_exec_drain(frame_num);
+
+                    if (!cmd_lanes_push(&lanes, prepared, record.length, false, 0)) 
+                        break;
+                }
+
+                stats->commands++;
+            }
+
+            pos += sizeof(record) + record.length;
+        }
+
+        cmd_exec_drain(frame_num);
+        stats->exec_us += time_us_64() - start;
+
+        render(frame_num, stats);
+    }
+
+    stats->held = cmd_queue_get_count(&lanes.priority) + cmd_queue_get_count(&lanes.normal);
+    stats->commands -= stats->held;
+    return true;
+}
+
+bool replay_run(const uint8_t* capture, uint32_t length, bool max_speed, ReplayStats* stats) 
+{
+    memset(stats, 0, sizeof(*stats));
+    cmd_lanes_init(&lanes);
+    cmd_exec_init(&lanes, &transfer);
+
+    return max_speed ? run_max_speed(capture, length, stats) : run_recorded(capture, length, stats);
+}
+
+const uint16_t* replay_frame(void) 
+{
+    return frame;
+}
+
+// asks for the ring a chunk at a time as a host would, so the file holds
+// exactly what the gpu sends back
+bool replay_write_trace(const char* path) 
+{
+    typedef struct __attribute__((packed)) {
+        GpuCommandHeader header;
+        GetTraceData request;
+    } GetTrace;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) 
+        return false;
+
+    GetTrace get = { .header = { CMD_GET_TRACE, CMD_FLAG_NEEDS_RESPONSE }, .request = { 0, 0 } };
+    TraceChunk chunk;
+    bool written = true;
+
+    do 
+    {
+        host_response_len = 0;
+        cmd_execute((const uint8_t*)&get, sizeof(get));
+        if (host_response_len < sizeof(chunk) - sizeof(chunk.events)) 
+        {
+            written = false;
+            break;
+        }
+
+        memcpy(&chunk, host_response, host_response_len);
+        written = fwrite(host_response, 1, host_response_len, file) == host_response_len && written;
+        get.request.from = chunk.first + chunk.count;
+    } while (chunk.count);
+
+    return fclose(file) == 0 && written;
+}
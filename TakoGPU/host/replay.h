@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Replays a command capture, the CaptureRecord stream CMD_READ_CAPTURE reads
+// back, through the firmware's command execution on the host.
+//
+// At recorded speed each record is pushed on the frame it was captured on
+// and drained with the firmware's per frame budget, a frame rendered after
+// each. The exec time then includes pushing. At max speed every record runs back to back through
+// cmd_execute and one frame is rendered at the end. Streamed commands are
+// skipped as on the gpu, their payloads were never captured.
+typedef struct {
+    uint32_t commands;
+    uint32_t skipped;
+    uint32_t held;      // still queued when the replay gave up on them, see REPLAY_DRAIN_FRAMES
+    uint32_t frames;
+    uint64_t exec_us;
+    uint64_t render_us;
+} ReplayStats;
+
+// frames rendered past the last record for targeted commands still waiting
+#define REPLAY_DRAIN_FRAMES 600
+
+void replay_init(void);
+bool replay_run(const uint8_t* capture, uint32_t length, bool max_speed, ReplayStats* stats);
+
+// the frame the last replay ended on
+const uint16_t* replay_frame(void);
+
+// writes the trace ring as CMD_GET_TRACE responses back to back, what
+// tools/trace_to_chrome.py --chunks reads
+bool replay_write_trace(const char* path);
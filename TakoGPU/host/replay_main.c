@@ -0,0 +1,79 @@
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replays a capture read back from the gpu with CMD_READ_CAPTURE.
+//
+//   tako_replay FILE              at the speed it was captured, a frame per captured frame
+//   tako_replay FILE --max        every command back to back
+//   tako_replay FILE --trace OUT  also writes the trace ring to OUT for tools/trace_to_chrome.py --chunks
+int main(int argc, char** argv) 
+{
+    bool max_speed = false;
+    const char* trace_path = NULL;
+    bool usage = argc < 2;
+
+    for (int n = 2; n < argc && !usage; n++) 
+    {
+        if (!strcmp(argv[n], "--max")) 
+            max_speed = true;
+        else if (!strcmp(argv[n], "--trace") && n + 1 < argc) 
+            trace_path = argv[++n];
+        else 
+            usage = true;
+    }
+
+    if (usage) 
+    {
+        fprintf(stderr, "usage: %s FILE [--max] [--trace OUT]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (!file) 
+    {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* capture = malloc(length > 0 ? length : 1);
+    bool read = capture && fread(capture, 1, length, file) == (size_t)length;
+    fclose(file);
+
+    if (!read) 
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 1;
+    }
+
+    ReplayStats stats;
+    replay_init();
+
+    if (!replay_run(capture, (uint32_t)length, max_speed, &stats)) 
+    {
+        fprintf(stderr, "%s: truncated or corrupt record after %lu commands\n", argv[1], (unsigned long)stats.commands);
+        return 1;
+    }
+
+    printf("%lu commands over %lu frames, %lu streamed skipped, %lu held\n", (unsigned long)stats.commands,
+           (unsigned long)stats.frames, (unsigned long)stats.skipped, (unsigned long)stats.held);
+    printf("execute %.2f ms, %.2f us/command\n", stats.exec_us / 1000.0,
+           stats.commands ? (double)stats.exec_us / stats.commands : 0.0);
+    printf("render %.2f ms, %.2f ms/frame\n", stats.render_us / 1000.0,
+           stats.frames ? stats.render_us / 1000.0 / stats.frames : 0.0);
+
+    free(capture);
+
+    if (trace_path && !replay_write_trace(trace_path)) 
+    {
+        fprintf(stderr, "can't write %s\n", trace_path);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "replay.h"
+#include "capture.h"
+#include "command_exec.h"
+#include "display.h"
+#include "render.h"
+#include "sprite_engine.h"
+#include <stdio.h>
+#include <string.h>
+
+// Captures a few frames of sprite traffic through the command lanes, then
+// checks the gpu's own max speed replay gets through the whole capture in
+// one frame however many queues' worth it holds, and that the host replayer
+// ends on the frame the live run did at either speed.
+#define FRAMES              8
+#define SPRITES_PER_FRAME   48 // more than a queue holds
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    UpdateSpriteData sprite;
+} UpdateSprite;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPaletteData palette;
+    uint16_t colors[COLORS_PER_PALETTE];
+} LoadPalette;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    LoadPatternData pattern;
+    uint8_t data[32];
+} LoadPattern;
+
+static CommandLanes lanes;
+static TransferState transfer;
+static uint16_t live_frame[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+static uint8_t capture[0x10000];
+static uint32_t commands_sent;
+
+static void send(const void* cmd, uint16_t len, uint32_t frame) 
+{
+    // a full queue is drained, as the frame loop would before long
+    while (!cmd_lanes_push(&lanes, cmd, len, false, 0)) 
+    {
+        cmd_exec_drain(frame);
+    }
+
+    commands_sent++;
+}
+
+static void send_frame(uint32_t frame) 
+{
+    if (frame == 0) 
+    {
+        LoadPalette palette = { .header = { CMD_LOAD_PALETTE, 0 }, .palette = { 0 } };
+        LoadPattern pattern = { .header = { CMD_LOAD_PATTERN, 0 }, .pattern = { 0, SPRITE_SIZE_8x8 } };
+
+        for (int n = 0; n < COLORS_PER_PALETTE; n++) 
+        {
+            palette.colors[n] = (uint16_t)(n * 0x1111);
+        }
+
+        for (int n = 0; n < (int)sizeof(pattern.data); n++) 
+        {
+            pattern.data[n] = (uint8_t)(n * 7 + 1);
+        }
+
+        send(&palette, sizeof(palette), frame);
+        send(&pattern, sizeof(pattern), frame);
+    }
+
+    for (uint8_t n = 0; n < SPRITES_PER_FRAME; n++) 
+    {
+        UpdateSprite update = {
+            .header = { CMD_UPDATE_SPRITE, 0 },
+            .sprite = {
+                .sprite_num = n,
+                .x = (uint16_t)((n * 37 + frame * 5) % (DISPLAY_WIDTH - 8)),
+                .y = (uint16_t)((n * 23 + frame * 3) % (DISPLAY_HEIGHT - 8)),
+                .pattern = 0,
+                .attr = SPRITE_SIZE_8x8,
+                .ctrl = SPRITE_CTRL_ENABLE
+            }
+        };
+        send(&update, sizeof(update), frame);
+    }
+}
+
+static uint32_t run_live(void) 
+{
+    uint16_t* frame = display_get_next_buffer();
+
+    cmd_lanes_init(&lanes);
+    cmd_exec_init(&lanes, &transfer);
+    capture_start();
+
+    for (uint32_t n = 0; n < FRAMES; n++) 
+    {
+        capture_start_frame(&lanes, n);
+        send_frame(n);
+        cmd_exec_drain(n);
+
+        sprite_engine_start_frame();
+        render_frame(frame);
+    }
+
+    capture_stop();
+    capture_start_frame(&lanes, FRAMES);
+    memcpy(live_frame, frame, sizeof(live_frame));
+
+    uint32_t length = 0;
+    uint16_t read;
+
+    while ((read = capture_read(length, capture + length, CAPTURE_READ_CHUNK)) && length + read <= sizeof(capture)) 
+    {
+        length += read;
+    }
+
+    return length;
+}
+
+static bool check_gpu_max_speed(void) 
+{
+    uint32_t frame = FRAMES + 1;
+
+    capture_replay(true);
+    capture_start_frame(&lanes, frame);
+    cmd_exec_drain(frame);
+
+    CaptureStatus status = capture_get_status();
+    if (status.replaying || status.replayed != commands_sent) 
+    {
+        printf("  gpu max speed: %lu of %lu commands replayed in the first frame\n",
+               (unsigned long)status.replayed, (unsigned long)commands_sent);
+        return false;
+    }
+
+    printf("  gpu max speed ok\n");
+    return true;
+}
+
+static bool check_replay(uint32_t length, bool max_speed) 
+{
+    const char* name = max_speed ? "host max speed" : "host recorded";
+    ReplayStats stats;
+
+    sprite_engine_reset();
+
+    if (!replay_run(capture, length, max_speed, &stats)) 
+    {
+        printf("  %s: the capture didn't parse\n", name);
+        return false;
+    }
+
+    uint32_t frames = max_speed ? 1 : FRAMES;
+    if (stats.commands != commands_sent || stats.skipped || stats.held || stats.frames != frames) 
+    {
+        printf("  %s: %lu commands over %lu frames, expected %lu over %lu\n", name, (unsigned long)stats.commands,
+               (unsigned long)stats.frames, (unsigned long)commands_sent, (unsigned long)frames);
+        return false;
+    }
+
+    if (memcmp(replay_frame(), live_frame, sizeof(live_frame))) 
+    {
+        printf("  %s: the last frame differs from the live run\n", name);
+        return false;
+    }
+
+    printf("  %s ok\n", name);
+    return true;
+}
+
+int main(void) 
+{
+    replay_init();
+
+    uint32_t length = run_live();
+    CaptureStatus status = capture_get_status();
+    bool passed = status.commands == commands_sent && !status.dropped;
+
+    if (!passed) 
+    {
+        printf("  capture: %lu of %lu commands captured\n", (unsigned long)status.commands, (unsigned long)commands_sent);
+    }
+
+    passed = check_gpu_max_speed() && passed;
+    passed = check_replay(length, false) && passed;
+    passed = check_replay(length, true) && passed;
+
+    printf("replay test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
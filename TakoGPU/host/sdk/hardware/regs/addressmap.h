@@ -0,0 +1,3 @@
+#pragma once
+
+#define XIP_BASE 0x10000000u
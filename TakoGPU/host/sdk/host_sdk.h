@@ -0,0 +1,140 @@
+#pragma once
+
+// Just enough of the Pico SDK for the hardware independent parts of the
+// firmware to build and run on the host. PIO calls and pins do nothing,
+// time is the host's monotonic clock unless a test simulates it.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+#define __not_in_flash_func(x) x
+#define __no_inline_not_in_flash_func(x) x
+#define __time_critical_func(x) x
+
+// hardware/pio.h
+typedef struct {
+    volatile uint32_t txf[4];
+    volatile uint32_t rxf[4];
+} pio_hw_t;
+
+typedef pio_hw_t* PIO;
+
+extern pio_hw_t host_pio[3];
+#define pio0 (&host_pio[0])
+#define pio1 (&host_pio[1])
+#define pio2 (&host_pio[2])
+
+typedef struct {
+    uint32_t offset;
+} pio_sm_config;
+
+typedef struct {
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+uint pio_add_program(PIO pio, const pio_program_t* program);
+void pio_sm_init(PIO pio, uint sm, uint offset, const pio_sm_config* config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+void sm_config_set_in_pins(pio_sm_config* config, uint base);
+void sm_config_set_out_pins(pio_sm_config* config, uint base, uint count);
+void sm_config_set_sideset_pins(pio_sm_config* config, uint base);
+void sm_config_set_clkdiv(pio_sm_config* config, float div);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+// hardware/gpio.h, an irq callback is kept for host_gpio_irq to call
+#define GPIO_IN             false
+#define GPIO_OUT            true
+#define GPIO_IRQ_EDGE_RISE  0x8u
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback);
+
+// runs the irq callback as if the pin had seen the events
+void host_gpio_irq(uint gpio, uint32_t event_mask);
+
+// hardware/dma.h, a transfer runs to completion as soon as it's triggered
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+    uint8_t size;
+    bool read_increment;
+    bool write_increment;
+} dma_channel_config;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config* config, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config* config, bool increment);
+void channel_config_set_write_increment(dma_channel_config* config, bool increment);
+void channel_config_set_dreq(dma_channel_config* config, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_start(uint channel);
+
+static inline void dma_channel_wait_for_finish_blocking(uint channel) {}
+
+// hardware/clocks.h
+enum clock_index { clk_sys };
+uint32_t clock_get_hz(enum clock_index clock);
+
+// hardware/sync.h, one thread so a spin lock only has to mask interrupts
+typedef volatile uint32_t spin_lock_t;
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+uint spin_lock_claim_unused(bool required);
+spin_lock_t* spin_lock_init(uint lock_num);
+
+static inline uint32_t spin_lock_blocking(spin_lock_t* lock) 
+{
+    return save_and_disable_interrupts();
+}
+
+static inline void spin_unlock(spin_lock_t* lock, uint32_t saved) 
+{
+    restore_interrupts(saved);
+}
+
+// hardware/structs/m33.h, the cycle counter runs off the host clock at clock_get_hz
+#define M33_DEMCR_TRCENA_BITS       (1u << 24)
+#define M33_DWT_CTRL_CYCCNTENA_BITS (1u << 0)
+
+typedef struct {
+    volatile uint32_t demcr;
+    volatile uint32_t dwt_ctrl;
+    volatile uint32_t dwt_cyccnt;
+} m33_hw_t;
+
+m33_hw_t* host_m33(void);
+#define m33_hw (host_m33())
+
+// pico/time.h
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+
+// simulated time for tests that drive the clock themselves. once started
+// the clock only moves through host_clock_advance and sleeps, and a busy
+// wait calls host_idle, which the test points at whatever happens meanwhile
+void host_clock_start(uint64_t now_us);
+void host_clock_advance(uint64_t us);
+extern void (*host_idle)(void);
+
+static inline void tight_loop_contents(void) 
+{
+    if (host_idle) 
+        host_idle();
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "host_sdk.h"
+
+// stands in for the pioasm output, the program never runs on the host
+extern const pio_program_t sprite_lookup_program;
+
+static inline pio_sm_config sprite_lookup_program_get_default_config(uint offset) 
+{
+    pio_sm_config config = { offset };
+    return config;
+}
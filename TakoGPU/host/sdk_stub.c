@@ -0,0 +1,209 @@
+#include "host_sdk.h"
+#include <time.h>
+#include <unistd.h>
+#include "sprite_lookup.pio.h"
+#include "sprite_pattern.pio.h"
+#include "sprite_compose.pio.h"
+#include "display_spi.pio.h"
+
+pio_hw_t host_pio[3];
+
+const pio_program_t sprite_lookup_program;
+const pio_program_t sprite_pattern_program;
+const pio_program_t sprite_compose_program;
+const pio_program_t display_spi_program;
+
+uint pio_add_program(PIO pio, const pio_program_t* program) 
+{
+    return 0;
+}
+
+void pio_sm_init(PIO pio, uint sm, uint offset, const pio_sm_config* config) {}
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {}
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) 
+{
+    return 0;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) 
+{
+    return true;
+}
+
+void sm_config_set_in_pins(pio_sm_config* config, uint base) {}
+void sm_config_set_out_pins(pio_sm_config* config, uint base, uint count) {}
+void sm_config_set_sideset_pins(pio_sm_config* config, uint base) {}
+void sm_config_set_clkdiv(pio_sm_config* config, float div) {}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) 
+{
+    return 0;
+}
+
+static gpio_irq_callback_t gpio_callback;
+
+void gpio_init(uint gpio) {}
+void gpio_set_dir(uint gpio, bool out) {}
+void gpio_put(uint gpio, bool value) {}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback) 
+{
+    gpio_callback = callback;
+}
+
+void host_gpio_irq(uint gpio, uint32_t event_mask) 
+{
+    if (gpio_callback) 
+        gpio_callback(gpio, event_mask);
+}
+
+int dma_claim_unused_channel(bool required) 
+{
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) 
+{
+    dma_channel_config config = { DMA_SIZE_32, true, false };
+    return config;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config* config, enum dma_channel_transfer_size size) 
+{
+    config->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config* config, bool increment) 
+{
+    config->read_increment = increment;
+}
+
+void channel_config_set_write_increment(dma_channel_config* config, bool increment) 
+{
+    config->write_increment = increment;
+}
+
+void channel_config_set_dreq(dma_channel_config* config, uint dreq) {}
+
+// what each channel was last configured with, for dma_channel_start
+typedef struct {
+    dma_channel_config config;
+    volatile void* write_addr;
+    const volatile void* read_addr;
+    uint transfer_count;
+} DmaChannel;
+
+static DmaChannel dma_channels[16];
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr,
+                           const volatile void* read_addr, uint transfer_count, bool trigger) 
+{
+    DmaChannel* dma = &dma_channels[channel % count_of(dma_channels)];
+
+    dma->config = *config;
+    dma->write_addr = write_addr;
+    dma->read_addr = read_addr;
+    dma->transfer_count = transfer_count;
+
+    if (trigger) 
+        dma_channel_start(channel);
+}
+
+void dma_channel_start(uint channel) 
+{
+    const DmaChannel* dma = &dma_channels[channel % count_of(dma_channels)];
+    const dma_channel_config* config = &dma->config;
+    size_t size = (size_t)1 << config->size;
+    volatile uint8_t* write = (volatile uint8_t*)dma->write_addr;
+    const volatile uint8_t* read = (const volatile uint8_t*)dma->read_addr;
+
+    for (uint n = 0; n < dma->transfer_count; n++) 
+    {
+        for (size_t byte = 0; byte < size; byte++) 
+        {
+            write[byte] = read[byte];
+        }
+
+        read += config->read_increment ? size : 0;
+        write += config->write_increment ? size : 0;
+    }
+}
+
+uint32_t clock_get_hz(enum clock_index clock) 
+{
+    return 150000000;
+}
+
+uint32_t save_and_disable_interrupts(void) 
+{
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) {}
+
+static spin_lock_t spin_locks[32];
+static uint spin_locks_claimed;
+
+uint spin_lock_claim_unused(bool required) 
+{
+    return spin_locks_claimed++ % count_of(spin_locks);
+}
+
+spin_lock_t* spin_lock_init(uint lock_num) 
+{
+    return &spin_locks[lock_num];
+}
+
+m33_hw_t* host_m33(void) 
+{
+    static m33_hw_t m33;
+
+    m33.dwt_cyccnt = (uint32_t)(time_us_64() * (clock_get_hz(clk_sys) / 1000000));
+    return &m33;
+}
+
+static bool clock_simulated;
+static uint64_t clock_now;
+
+void (*host_idle)(void);
+
+void host_clock_start(uint64_t now_us) 
+{
+    clock_simulated = true;
+    clock_now = now_us;
+}
+
+void host_clock_advance(uint64_t us) 
+{
+    clock_now += us;
+}
+
+uint64_t time_us_64(void) 
+{
+    if (clock_simulated) 
+        return clock_now;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t time_us_32(void) 
+{
+    return (uint32_t)time_us_64();
+}
+
+void sleep_ms(uint32_t ms) 
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void sleep_us(uint64_t us) 
+{
+    if (clock_simulated) 
+        host_clock_advance(us);
+    else 
+        usleep(us);
+}
@@ -0,0 +1,134 @@
+#include "sprite_engine.h"
+#include <stdio.h>
+#include <string.h>
+
+// Resets the sprite engine past the wrap of its generation counter and
+// checks nothing bound before the resets comes back. A reset only bumps
+// the counter, so anything compared against it has to be cleared when it
+// wraps or it matches again 255 resets later.
+#define RESETS          256
+
+// both read the same in either byte order, palettes are stored swapped
+#define SPRITE_COLOR    0xFFFF
+#define ANIM_COLOR      0xF0F0
+#define SPRITE_X        10
+#define SPRITE_Y        10
+#define GROUP_X         100
+#define GROUP_Y         100
+
+static uint16_t line[DISPLAY_WIDTH];
+
+static void load_pattern(uint16_t pattern_num, uint8_t color_index) 
+{
+    uint8_t data[32];
+
+    memset(data, color_index << 4 | color_index, sizeof(data));
+    pattern_load(pattern_num, data, SPRITE_SIZE_8x8);
+}
+
+// palettes and sprites go stale on reset, the patterns in psram don't
+static void place_sprite(uint8_t index) 
+{
+    uint16_t colors[COLORS_PER_PALETTE] = { 0 };
+    colors[1] = SPRITE_COLOR;
+    colors[2] = ANIM_COLOR;
+    palette_load(0, colors);
+
+    Sprite sprite = {
+        .x = SPRITE_X,
+        .y = SPRITE_Y,
+        .pattern = 0,
+        .attr = SPRITE_SIZE_8x8,
+        .ctrl = SPRITE_CTRL_ENABLE
+    };
+    sprite_update(index, &sprite);
+}
+
+static uint16_t pixel(int16_t x, int16_t y) 
+{
+    sprite_engine_render_line(y, line, DISPLAY_WIDTH);
+    return line[x];
+}
+
+static bool check_groups(void) 
+{
+    SpriteGroupMember member = { .sprite_num = 0, .x = 0, .y = 0 };
+
+    sprite_engine_reset();
+    place_sprite(0);
+    sprite_group_set(0, &member, 1);
+    sprite_group_move(0, GROUP_X, GROUP_Y, 0);
+
+    sprite_engine_start_frame();
+    if (!pixel(GROUP_X, GROUP_Y) || pixel(SPRITE_X, SPRITE_Y)) 
+    {
+        printf("  groups: the grouped sprite isn't at the group origin\n");
+        return false;
+    }
+
+    // the sprite comes back ungrouped after every reset
+    for (int reset = 1; reset <= RESETS; reset++) 
+    {
+        sprite_engine_reset();
+        place_sprite(0);
+        sprite_engine_start_frame();
+
+        if (pixel(GROUP_X, GROUP_Y) || !pixel(SPRITE_X, SPRITE_Y)) 
+        {
+            printf("  groups: the old group link moved the sprite again after %d resets\n", reset);
+            return false;
+        }
+    }
+
+    printf("  groups ok\n");
+    return true;
+}
+
+static bool check_animations(void) 
+{
+    AnimationStep step = { .pattern = 1, .duration = 1, .flip = 0 };
+
+    sprite_engine_reset();
+    place_sprite(1);
+    animation_load(0, &step, 1, ANIMATION_LOOP);
+    sprite_bind_animation(1, 0, 0);
+
+    sprite_engine_start_frame();
+    if (pixel(SPRITE_X, SPRITE_Y) != ANIM_COLOR) 
+    {
+        printf("  animations: the bound sprite isn't showing its animation\n");
+        return false;
+    }
+
+    // the sprite comes back with its own pattern after every reset
+    for (int reset = 1; reset <= RESETS; reset++) 
+    {
+        sprite_engine_reset();
+        place_sprite(1);
+        sprite_engine_start_frame();
+
+        if (pixel(SPRITE_X, SPRITE_Y) != SPRITE_COLOR) 
+        {
+            printf("  animations: the old binding animated the sprite again after %d resets\n", reset);
+            return false;
+        }
+    }
+
+    printf("  animations ok\n");
+    return true;
+}
+
+int main(void) 
+{
+    sprite_engine_init(pio2, 0, 1, 2);
+    load_pattern(0, 1);
+    load_pattern(1, 2);
+
+    bool passed = true;
+    passed = check_groups() && passed;
+    passed = check_animations() && passed;
+
+    printf("sprite reset test %s\n", passed ? "passed" : "FAILED");
+
+    return passed ? 0 : 1;
+}
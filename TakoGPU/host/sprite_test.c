@@ -0,0 +1,194 @@
+#include "self_test.h"
+#include "sprite_engine.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Runs the boot sprite test on the host.
+//
+//   sprite_test                      every scene against the reference renderer and the goldens,
+//                                    which have to exist for the configuration
+//   sprite_test --goldens            prints this configuration's golden table for self_test.c
+//   sprite_test --bench FILE         times the scenes against the baseline in FILE
+//   sprite_test --bench FILE --update  writes this run's timings to FILE
+//
+// Host timings say nothing about the RP2350, so the benchmark compares the
+// engine's speed relative to the reference renderer, which both run on the
+// same machine, against the baseline's.
+#define BENCH_RUNS          20
+#define BENCH_TOLERANCE     0.35 // fraction of the baseline speedup that may be lost
+
+static bool run_quiet(SpriteSceneResult results[SPRITE_TEST_SCENES]) 
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    bool passed = run_sprite_test_results(results);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(null);
+    close(saved);
+
+    return passed;
+}
+
+static int print_goldens(void) 
+{
+    SpriteSceneResult results[SPRITE_TEST_SCENES];
+
+    // only the reference comparison has to hold, the goldens are what's being replaced
+    run_quiet(results);
+    for (int n = 0; n < SPRITE_TEST_SCENES; n++) 
+    {
+        if (results[n].mismatches || !results[n].crc) 
+        {
+            fprintf(stderr, "%s doesn't match the reference renderer, not printing goldens\n", results[n].name);
+            return 1;
+        }
+    }
+
+    printf("// DISPLAY_WIDTH == %d && DISPLAY_HEIGHT == %d && MAX_SPRITES_PER_LINE == %d\n",
+           DISPLAY_WIDTH, DISPLAY_HEIGHT, MAX_SPRITES_PER_LINE);
+    printf("static const uint32_t golden_crcs[count_of(scenes)] = {\n    ");
+    for (int n = 0; n < SPRITE_TEST_SCENES; n++) 
+    {
+        printf("0x%08X%s", (unsigned)results[n].crc, n + 1 < SPRITE_TEST_SCENES ? ", " : "\n");
+    }
+    printf("};\n");
+
+    return 0;
+}
+
+typedef struct {
+    char name[16];
+    unsigned long engine_us;
+    unsigned long reference_us;
+} Baseline;
+
+static int load_baseline(const char* path, Baseline baseline[SPRITE_TEST_SCENES]) 
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return 0;
+
+    char line[128];
+    int count = 0;
+    while (count < SPRITE_TEST_SCENES && fgets(line, sizeof(line), file)) 
+    {
+        Baseline* entry = &baseline[count];
+        if (line[0] != '#' && sscanf(line, "%15s %lu %lu", entry->name, &entry->engine_us, &entry->reference_us) == 3)
+            count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+static int bench(const char* path, bool update) 
+{
+    SpriteSceneResult best[SPRITE_TEST_SCENES];
+    SpriteSceneResult results[SPRITE_TEST_SCENES];
+
+    // best of several runs, the host is never idle
+    for (int run = 0; run < BENCH_RUNS; run++) 
+    {
+        if (!run_quiet(results)) 
+        {
+            fprintf(stderr, "sprite test failed, run sprite_test for details\n");
+            return 1;
+        }
+
+        for (int n = 0; n < SPRITE_TEST_SCENES; n++) 
+        {
+            if (!run || results[n].engine_us < best[n].engine_us)
+                best[n].engine_us = results[n].engine_us;
+            if (!run || results[n].reference_us < best[n].reference_us)
+                best[n].reference_us = results[n].reference_us;
+            best[n].name = results[n].name;
+        }
+    }
+
+    if (update) 
+    {
+        FILE* file = fopen(path, "w");
+        if (!file) 
+        {
+            perror(path);
+            return 1;
+        }
+
+        fprintf(file, "# sprite test on the host, %dx%d, best of %d runs\n", DISPLAY_WIDTH, DISPLAY_HEIGHT, BENCH_RUNS);
+        fprintf(file, "# scene engine_us reference_us\n");
+        for (int n = 0; n < SPRITE_TEST_SCENES; n++) 
+        {
+            fprintf(file, "%s %lu %lu\n", best[n].name, (unsigned long)best[n].engine_us, (unsigned long)best[n].reference_us);
+        }
+
+        fclose(file);
+        printf("wrote %s\n", path);
+        return 0;
+    }
+
+    Baseline baseline[SPRITE_TEST_SCENES];
+    if (load_baseline(path, baseline) != SPRITE_TEST_SCENES) 
+    {
+        fprintf(stderr, "%s: no baseline for every scene, write one with --update\n", path);
+        return 1;
+    }
+
+    bool passed = true;
+    for (int n = 0; n < SPRITE_TEST_SCENES; n++) 
+    {
+        const SpriteSceneResult* result = &best[n];
+        if (strcmp(baseline[n].name, result->name)) 
+        {
+            fprintf(stderr, "%s: expected %s on line %d, found %s\n", path, result->name, n + 1, baseline[n].name);
+            return 1;
+        }
+
+        double speedup = (double)result->reference_us / (result->engine_us ? result->engine_us : 1);
+        double expected = (double)baseline[n].reference_us / (baseline[n].engine_us ? baseline[n].engine_us : 1);
+        bool ok = speedup >= expected * (1.0 - BENCH_TOLERANCE);
+
+        printf("  %-9s %s: engine %lu us (baseline %lu), %.2fx the reference (baseline %.2fx)\n", result->name,
+               ok ? "ok" : "SLOWER", (unsigned long)result->engine_us, baseline[n].engine_us, speedup, expected);
+        passed = passed && ok;
+    }
+
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char** argv) 
+{
+    sprite_engine_init(pio2, 0, 1, 2);
+
+    if (argc == 2 && !strcmp(argv[1], "--goldens"))
+        return print_goldens();
+
+    if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--bench"))
+        return bench(argv[2], argc == 4 && !strcmp(argv[3], "--update"));
+
+    if (argc != 1) 
+    {
+        fprintf(stderr, "usage: %s [--goldens | --bench FILE [--update]]\n", argv[0]);
+        return 2;
+    }
+
+    SpriteSceneResult results[SPRITE_TEST_SCENES];
+    bool passed = run_sprite_test_results(results);
+
+    // the firmware gets by on the reference comparison alone, the host build doesn't
+    if (!results[0].has_golden) 
+    {
+        fprintf(stderr, "no golden crcs for %dx%d with MAX_SPRITES_PER_LINE %d, add them to self_test.c from --goldens\n",
+                DISPLAY_WIDTH, DISPLAY_HEIGHT, MAX_SPRITES_PER_LINE);
+        passed = false;
+    }
+
+    return passed ? 0 : 1;
+}
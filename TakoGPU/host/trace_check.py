@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Decode the host build's trace with tools/trace_to_chrome.py.
+
+Runs trace_test, converts the CMD_GET_TRACE chunks and the stdio dump it
+wrote, and checks both come out the same: every event there, a marker per
+frame and a named slice per command.
+
+  trace_check.py TRACE_TEST TRACE_TO_CHROME
+"""
+
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+def convert(tool, source, output, chunks):
+    command = [sys.executable, tool, source, "-o", output] + (["--chunks"] if chunks else [])
+    subprocess.run(command, check=True)
+    with open(output) as f:
+        return json.load(f)
+
+
+def check(name, trace, frames, commands, events):
+    entries = trace["traceEvents"]
+    markers = [entry for entry in entries if entry["name"].startswith("frame ")]
+    slices = [entry for entry in entries if entry.get("tid") == "commands" and entry["ph"] == "X"]
+    problems = []
+
+    if trace["otherData"]["events"] != events:
+        problems.append(f"{trace['otherData']['events']} events decoded, expected {events}")
+    if len(markers) != frames:
+        problems.append(f"{len(markers)} frame markers, expected {frames}")
+    if len(slices) != commands:
+        problems.append(f"{len(slices)} command slices, expected {commands}")
+    if any(entry["name"] != "UPDATE_SPRITE" for entry in slices):
+        problems.append("command slices without the opcode's name")
+
+    for problem in problems:
+        print(f"  {name}: {problem}")
+    if not problems:
+        print(f"  {name} ok")
+    return not problems
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.splitlines()[-1].strip(), file=sys.stderr)
+        return 2
+    trace_test, tool = sys.argv[1:]
+
+    with tempfile.TemporaryDirectory() as directory:
+        chunks = os.path.join(directory, "trace.bin")
+        dump = os.path.join(directory, "trace.log")
+
+        result = subprocess.run([trace_test, chunks, dump], capture_output=True, text=True)
+        print(result.stdout, end="")
+        summary = re.match(r"(\d+) frames, (\d+) commands, (\d+) events", result.stdout)
+        if result.returncode or not summary:
+            print("trace check FAILED")
+            return 1
+        frames, commands, events = (int(group) for group in summary.groups())
+
+        passed = check("chunks", convert(tool, chunks, chunks + ".json", True), frames, commands, events)
+        passed = check("stdio dump", convert(tool, dump, dump + ".json", False), frames, commands, events) and passed
+
+    print(f"trace check {'passed' if passed else 'FAILED'}")
+    return 0 if passed else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,79 @@
+#include "replay.h"
+#include "capture.h"
+#include "command_exec.h"
+#include "sprite_engine.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+// Replays a few frames of sprite updates and writes the trace they left in
+// both forms the gpu sends it back in: CMD_GET_TRACE responses to CHUNKS and
+// the TRACE_REQUEST_STDIO dump to DUMP. trace_check.py runs this and feeds
+// both through tools/trace_to_chrome.py.
+//
+//   trace_test CHUNKS DUMP
+#define FRAMES              8
+#define SPRITES_PER_FRAME   12
+
+typedef struct __attribute__((packed)) {
+    CaptureRecord record;
+    GpuCommandHeader header;
+    UpdateSpriteData sprite;
+} RecordedUpdate;
+
+typedef struct __attribute__((packed)) {
+    GpuCommandHeader header;
+    GetTraceData request;
+} GetTrace;
+
+static RecordedUpdate capture[FRAMES * SPRITES_PER_FRAME];
+
+int main(int argc, char** argv) 
+{
+    if (argc != 3) 
+    {
+        fprintf(stderr, "usage: %s CHUNKS DUMP\n", argv[0]);
+        return 2;
+    }
+
+    for (int n = 0; n < FRAMES * SPRITES_PER_FRAME; n++) 
+    {
+        RecordedUpdate* update = &capture[n];
+
+        update->record.frame = n / SPRITES_PER_FRAME;
+        update->record.length = sizeof(update->header) + sizeof(update->sprite);
+        update->header.cmd = CMD_UPDATE_SPRITE;
+        update->sprite.sprite_num = n % SPRITES_PER_FRAME;
+        update->sprite.x = (uint16_t)(n * 3);
+        update->sprite.y = (uint16_t)(n * 2);
+        update->sprite.attr = SPRITE_SIZE_8x8;
+        update->sprite.ctrl = SPRITE_CTRL_ENABLE;
+    }
+
+    ReplayStats stats;
+    replay_init();
+
+    if (!replay_run((const uint8_t*)capture, sizeof(capture), false, &stats) || stats.frames != FRAMES) 
+    {
+        printf("trace test: the replay ran %lu frames, expected %d\n", (unsigned long)stats.frames, FRAMES);
+        return 1;
+    }
+
+    if (!replay_write_trace(argv[1])) 
+    {
+        printf("trace test: can't write %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%d frames, %d commands, %lu events\n", FRAMES, FRAMES * SPRITES_PER_FRAME, (unsigned long)trace_head);
+    fflush(stdout);
+
+    // the dump goes to stdout on the gpu too
+    if (!freopen(argv[2], "w", stdout))
+        return 1;
+
+    GetTrace get = { .header = { CMD_GET_TRACE, 0 }, .request = { 0, TRACE_REQUEST_STDIO } };
+    cmd_execute((const uint8_t*)&get, sizeof(get));
+
+    return fclose(stdout) == 0 ? 0 : 1;
+}
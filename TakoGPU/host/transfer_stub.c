@@ -0,0 +1,42 @@
+#include "transfer_stub.h"
+#include "gpu_protocol.h"
+#include <string.h>
+
+// The host side of the bus for the host build. Responses are counted and
+// the last one kept for tests to look at, nothing ever arrives on the bus,
+// so a streamed payload is never there to be read.
+uint32_t host_responses;
+uint32_t host_acks_failed;
+
+uint8_t host_response[HOST_RESPONSE_SIZE];
+size_t host_response_len;
+
+bool transfer_send_response(TransferState* state, const void* data, size_t len) 
+{
+    host_responses++;
+
+    host_response_len = len < HOST_RESPONSE_SIZE ? len : HOST_RESPONSE_SIZE;
+    memcpy(host_response, data, host_response_len);
+    return true;
+}
+
+bool transfer_send_ack(TransferState* state, bool success) 
+{
+    host_responses++;
+    host_acks_failed += !success;
+    return true;
+}
+
+void transfer_flush_responses(TransferState* state) {}
+
+bool transfer_stream(TransferState* state, size_t len, StreamSinkFn sink, void* ctx) 
+{
+    return false;
+}
+
+bool transfer_discard(TransferState* state, size_t len) 
+{
+    return false;
+}
+
+void transfer_resync(TransferState* state) {}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// what the stubbed bus has seen go out, see transfer_stub.c
+#define HOST_RESPONSE_SIZE 512
+
+extern uint32_t host_responses;
+extern uint32_t host_acks_failed;
+
+// the last response sent, truncated to HOST_RESPONSE_SIZE
+extern uint8_t host_response[HOST_RESPONSE_SIZE];
+extern size_t host_response_len;
@@ -3,15 +3,17 @@
 //=====================================
 // PIO Assignments
 //=====================================
-// PIO0: CPU Communication & PSRAM
-// SM0: PSRAM
+// PIO0: CPU Communication & Display
+// SM0: Display SPI
 // SM1: CPU Receive
 // SM2: CPU Transmit
 // SM3: Reserved
 
-// PIO1: Display
-// SM0: Display SPI
-// SM1-3: Reserved
+// PIO1: PSRAM (both read programs, shared by the chips)
+// SM0: Reserved
+// SM1: PSRAM
+// SM2: Second PSRAM
+// SM3: Reserved
 
 // PIO2: Sprite Engine
 // SM0: Sprite Lookup
@@ -31,6 +33,20 @@
 #define PIN_PSRAM_D3     22  // Data 3 (SIO3 in QSPI mode)
 #define PIN_PSRAM_CS     23  // Chip Select (active low)
 
+// With the qmi backend (TAKO_PSRAM_BACKEND) the chip shares the flash's
+// qspi clock and data pins instead and only needs the xip chip select,
+// which can go on 0, 8 or 19. The pins above are free then.
+#define PIN_PSRAM_XIP_CS1 19
+
+// Optional second chip (TAKO_PSRAM_LAYOUT other than single). It takes
+// every free pin, the status LED's included.
+#define PIN_PSRAM1_SCK   24
+#define PIN_PSRAM1_D0    26
+#define PIN_PSRAM1_D1    27
+#define PIN_PSRAM1_D2    28
+#define PIN_PSRAM1_D3    29
+#define PIN_PSRAM1_CS    25
+
 //=====================================
 // Display Interface (ST7789)
 //=====================================
@@ -41,6 +57,7 @@
 #define PIN_DISP_DC      15  // Data/Command control
 #define PIN_DISP_RST     16  // Reset (active low)
 #define PIN_DISP_BL      17  // Backlight control
+#define PIN_DISP_TE      11  // Tearing effect output from the panel
 
 //=====================================
 // CPU Communication Interface
@@ -61,7 +78,7 @@
 //=====================================
 // Status
 //=====================================
-#define PIN_LED          25  // Built-in LED for status
+#define PIN_LED          25  // Built-in LED for status, unused with a second PSRAM
 
 //=====================================
 // Pin Groups
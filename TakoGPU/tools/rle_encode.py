@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Encode assets for compressed uploads (CMD_FLAG_COMPRESSED).
+
+Produces the byte RLE stream gpu/rle.c decodes:
+
+  control 0x00-0x7F: (control + 1) literal bytes follow
+  control 0x80-0xFF: the next byte repeats (control & 0x7F) + 3 times
+
+Every stream is decoded again before it's written, and the ratio is
+printed per file, so this doubles as a way to see what an asset gains.
+
+  rle_encode.py sprites.bin font.bin          # ratios only
+  rle_encode.py -o out/ sprites.bin           # writes out/sprites.bin.rle
+  rle_encode.py --payload -o out/ tiles.bin   # prefixed with CompressedPayload
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+LITERAL_MAX = 128
+REPEAT_MIN = 3
+REPEAT_MAX = 130
+
+# CompressedPayload.length is a uint16_t
+PAYLOAD_MAX = 0xFFFF
+
+
+def encode(data):
+    out = bytearray()
+    literals = bytearray()
+
+    def flush_literals():
+        while literals:
+            chunk = literals[:LITERAL_MAX]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+            del literals[:LITERAL_MAX]
+
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and run < REPEAT_MAX and data[i + run] == data[i]:
+            run += 1
+
+        if run >= REPEAT_MIN:
+            flush_literals()
+            out.append(0x80 | (run - REPEAT_MIN))
+            out.append(data[i])
+        else:
+            literals.extend(data[i:i + run])
+
+        i += run
+
+    flush_literals()
+    return bytes(out)
+
+
+# mirrors rle_feed/rle_finish, including rejecting streams that overrun
+def decode(stream, expected):
+    out = bytearray()
+    i = 0
+    while i < len(stream):
+        control = stream[i]
+        i += 1
+        if control & 0x80:
+            if i >= len(stream):
+                raise ValueError("repeat without a value")
+            out.extend(bytes([stream[i]]) * ((control & 0x7F) + REPEAT_MIN))
+            i += 1
+        else:
+            count = control + 1
+            if i + count > len(stream):
+                raise ValueError("literal run past the end")
+            out.extend(stream[i:i + count])
+            i += count
+        if len(out) > expected:
+            raise ValueError("stream decodes past the expected size")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+")
+    parser.add_argument("-o", "--output", help="directory for the .rle files")
+    parser.add_argument("--payload", action="store_true",
+                        help="prefix each stream with its CompressedPayload")
+    args = parser.parse_args()
+
+    raw_total = 0
+    packed_total = 0
+    failed = False
+
+    for path in args.files:
+        with open(path, "rb") as f:
+            data = f.read()
+
+        stream = encode(data)
+        if decode(stream, len(data)) != data:
+            print(f"{path}: round trip failed", file=sys.stderr)
+            failed = True
+            continue
+
+        raw_total += len(data)
+        packed_total += len(stream)
+        ratio = len(data) / len(stream) if stream else 0.0
+        note = ""
+        if len(stream) >= len(data):
+            note = "  (no gain, send it raw)"
+        if len(stream) > PAYLOAD_MAX:
+            note = "  (too long for one CompressedPayload)"
+            failed = failed or args.payload
+        print(f"{path}: {len(data)} -> {len(stream)} bytes, {ratio:.2f}:1{note}")
+
+        if args.output:
+            os.makedirs(args.output, exist_ok=True)
+            out_path = os.path.join(args.output, os.path.basename(path) + ".rle")
+            with open(out_path, "wb") as f:
+                if args.payload:
+                    f.write(struct.pack("<H", len(stream)))
+                f.write(stream)
+
+    if len(args.files) > 1 and packed_total:
+        print(f"total: {raw_total} -> {packed_total} bytes, {raw_total / packed_total:.2f}:1")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Turn a trace ring read back from the GPU into a chrome://tracing file.
+
+Takes either form the firmware produces (see gpu/trace.h):
+
+  - the stdio dump from CMD_GET_TRACE with TRACE_REQUEST_STDIO, a
+    "trace: N events, HZ hz" line then "cycles type arg8 arg16" per event,
+    anywhere in a serial log
+  - raw TraceChunk responses to CMD_GET_TRACE written back to back (--chunks)
+
+  trace_to_chrome.py uart.log -o trace.json
+  trace_to_chrome.py --chunks trace.bin -o trace.json
+
+Open the result in chrome://tracing or https://ui.perfetto.dev.
+"""
+
+import argparse
+import json
+import os
+import re
+import struct
+import sys
+
+TRACE_FRAME_START = 0x01
+TRACE_CMD_BEGIN = 0x02
+TRACE_CMD_END = 0x03
+TRACE_DMA_START = 0x04
+TRACE_DMA_END = 0x05
+TRACE_QUEUE_FULL = 0x06
+TRACE_RESPONSE_SENT = 0x07
+TRACE_RESPONSE_DROPPED = 0x08
+TRACE_STREAM_TIMEOUT = 0x09
+
+DMA_NAMES = {0: "scanout", 1: "response"}
+
+# TraceChunk: cpu_hz, head, first, count, then count packed TraceEvents
+CHUNK_HEADER = struct.Struct("<IIIB")
+EVENT = struct.Struct("<IBBH")
+
+COMMANDS_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "gpu", "gpu_commands.h")
+
+
+# opcode names straight from the command enum, so they never go stale
+def load_opcodes():
+    names = {}
+    try:
+        with open(COMMANDS_H) as f:
+            for match in re.finditer(r"\bCMD_([A-Z0-9_]+)\s*=\s*(0x[0-9A-Fa-f]+)", f.read()):
+                names[int(match.group(2), 16)] = match.group(1)
+    except OSError:
+        pass
+    return names
+
+
+def read_dump(path):
+    hz = None
+    events = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            header = re.match(r"\s*trace: (\d+) events, (\d+) hz", line)
+            if header:
+                # a later dump replaces an earlier one in the same log
+                hz = int(header.group(2))
+                events = []
+                continue
+            if hz is None:
+                continue
+            fields = line.split()
+            if len(fields) == 4 and all(field.isdigit() for field in fields):
+                events.append(tuple(int(field) for field in fields))
+    if hz is None:
+        raise ValueError(f"{path}: no trace dump found")
+    return hz, events
+
+
+def read_chunks(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    hz = None
+    events = []
+    expected = None
+    offset = 0
+    while offset + CHUNK_HEADER.size <= len(data):
+        hz, head, first, count = CHUNK_HEADER.unpack_from(data, offset)
+        offset += CHUNK_HEADER.size
+        if expected is not None and first != expected:
+            print(f"warning: {first - expected} events overwritten before position {first}", file=sys.stderr)
+        for n in range(count):
+            events.append(EVENT.unpack_from(data, offset + n * EVENT.size))
+        offset += count * EVENT.size
+        expected = first + count
+    if hz is None:
+        raise ValueError(f"{path}: no trace chunks found")
+    return hz, events
+
+
+def convert(hz, events, opcodes):
+    trace = []
+    open_slices = {}
+    last = None
+    total = 0
+
+    def emit(name, ph, tid, ts, **extra):
+        event = {"name": name, "ph": ph, "pid": 0, "tid": tid, "ts": ts}
+        event.update(extra)
+        trace.append(event)
+
+    for cycles, type_, arg8, arg16 in events:
+        # the cycle counter wraps every few seconds, only its deltas count
+        if last is not None:
+            total += (cycles - last) & 0xFFFFFFFF
+        last = cycles
+        ts = total * 1e6 / hz
+
+        if type_ == TRACE_FRAME_START:
+            emit(f"frame {arg16}", "i", "frames", ts, s="g")
+        elif type_ in (TRACE_CMD_BEGIN, TRACE_CMD_END):
+            name = opcodes.get(arg8, f"0x{arg8:02X}")
+            key = ("cmd", arg8)
+            if type_ == TRACE_CMD_BEGIN:
+                open_slices[key] = ts
+            elif key in open_slices:
+                start = open_slices.pop(key)
+                emit(name, "X", "commands", start, dur=ts - start)
+        elif type_ in (TRACE_DMA_START, TRACE_DMA_END):
+            name = DMA_NAMES.get(arg8, f"dma {arg8}")
+            key = ("dma", arg8)
+            if type_ == TRACE_DMA_START:
+                open_slices[key] = (ts, arg16)
+            elif key in open_slices:
+                start, kilobytes = open_slices.pop(key)
+                emit(name, "X", "dma", start, dur=ts - start, args={"kilobytes": kilobytes})
+        elif type_ == TRACE_QUEUE_FULL:
+            emit("queue full", "i", "commands", ts, s="t", args={"opcode": opcodes.get(arg8, arg8)})
+        elif type_ == TRACE_RESPONSE_SENT:
+            emit("response", "i", "bus", ts, s="t", args={"bytes": arg16})
+        elif type_ == TRACE_RESPONSE_DROPPED:
+            emit("response dropped", "i", "bus", ts, s="t", args={"type": arg8, "bytes": arg16})
+        elif type_ == TRACE_STREAM_TIMEOUT:
+            emit("stream timeout", "i", "bus", ts, s="t", args={"bytes_missing": arg16})
+        else:
+            emit(f"event 0x{type_:02X}", "i", "other", ts, s="t", args={"arg8": arg8, "arg16": arg16})
+
+    return {"traceEvents": trace, "displayTimeUnit": "ms", "otherData": {"cpu_hz": hz, "events": len(events)}}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input")
+    parser.add_argument("--chunks", action="store_true", help="input is raw TraceChunk responses")
+    parser.add_argument("-o", "--output", help="json file to write, stdout if left out")
+    args = parser.parse_args()
+
+    try:
+        hz, events = read_chunks(args.input) if args.chunks else read_dump(args.input)
+    except ValueError as error:
+        print(error, file=sys.stderr)
+        return 1
+
+    result = convert(hz, events, load_opcodes())
+    out = open(args.output, "w") if args.output else sys.stdout
+    json.dump(result, out, indent=1)
+    if args.output:
+        out.close()
+        print(f"{len(events)} events, {len(result['traceEvents'])} trace entries -> {args.output}", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())